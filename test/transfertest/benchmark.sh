@@ -0,0 +1,56 @@
+#!/bin/sh
+
+# Runs transfertest against a throwaway server instance built from the
+# files in run/. Any arguments are passed on to transfertest, e.g.:
+#
+#   test/transfertest/benchmark.sh -c 20 -s 64k,1m,16m -m 80 -r 10 -t 30 -o results.json
+#
+# To see how bulk transfers affect interactive file operations, add -l to
+# measure directory listing latency and compare runs with IO_PRIORITY set
+# to normal, low or idle.
+
+top_srcdir=`cd \`dirname $0\`/../.. && pwd`
+rundir="$top_srcdir/run"
+
+WIRED=${WIRED:-"$rundir/wired"}
+TRANSFERTEST=${TRANSFERTEST:-"$rundir/transfertest"}
+PORT=${PORT:-4872}
+
+for tool in "$WIRED" "$TRANSFERTEST"; do
+	if [ ! -x "$tool" ]; then
+		echo "$tool: not found, run make first" >&2
+		exit 1
+	fi
+done
+
+root=`mktemp -d "${TMPDIR:-/tmp}/transfertest.XXXXXX"` || exit 1
+
+trap 'kill $pid 2>/dev/null; wait $pid 2>/dev/null; rm -rf "$root"' EXIT INT TERM
+
+for file in banlist banner.png board events groups users wired.xml; do
+	cp -R "$rundir/$file" "$root/"
+done
+
+mkdir "$root/etc" "$root/files"
+
+cat > "$root/etc/wired.conf" <<CONF
+name = Transfer Benchmark
+port = $PORT
+files = files
+banner = banner.png
+total downloads = 100
+total uploads = 100
+transfer io priority = ${IO_PRIORITY:-low}
+CONF
+
+"$WIRED" -X -D -d "$root" -f "$root/etc/wired.conf" 2>"$root/wired.log" &
+pid=$!
+
+sleep 1
+
+if ! kill -0 $pid 2>/dev/null; then
+	cat "$root/wired.log" >&2
+	exit 1
+fi
+
+"$TRANSFERTEST" -d "$root" -u admin "$@" "localhost:$PORT"
@@ -28,18 +28,60 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <wired/wired.h>
 
+#define WC_MAX_SIZES					32
+
+
+enum _wc_direction {
+	WC_DOWNLOAD							= 0,
+	WC_UPLOAD
+};
+typedef enum _wc_direction				wc_direction_t;
+
+
+struct _wc_sample {
+	wi_p7_uint64_t						bytes;
+	wi_time_interval_t					first_byte;
+	wi_time_interval_t					latency;
+};
+typedef struct _wc_sample				wc_sample_t;
+
+
+struct _wc_results {
+	wi_uinteger_t						count, capacity;
+	wi_uinteger_t						resumed;
+	wi_p7_uint64_t						bytes;
+	double								*first_bytes;
+	double								*latencies;
+};
+typedef struct _wc_results				wc_results_t;
+
+
 static void						wc_usage(void);
 
-static void						wc_test(wi_url_t *, wi_uinteger_t, wi_string_t *);
+static void						wc_test(wi_url_t *, wi_string_t *);
 static void						wc_test_thread(wi_runtime_instance_t *);
-static void						wc_download(wi_p7_socket_t *, wi_string_t *);
-static void						wc_upload(wi_p7_socket_t *, wi_string_t *);
+static void						wc_list_thread(wi_runtime_instance_t *);
+static void						wc_download(wi_p7_socket_t *, wi_string_t *, wi_p7_uint64_t, wi_p7_uint64_t, wc_sample_t *);
+static void						wc_upload(wi_p7_socket_t *, wi_string_t *, wi_p7_uint64_t, wc_sample_t *);
+
+static wi_p7_uint64_t			wc_size_with_string(const char *);
+static wi_p7_uint64_t			wc_random_size(void);
+static void						wc_add_sample(wc_direction_t, wc_sample_t *, wi_boolean_t);
+static void						wc_add_listing(wi_time_interval_t);
+static void						wc_report(FILE *, wi_time_interval_t);
+static void						wc_report_results(FILE *, const char *, wc_results_t *, wi_time_interval_t);
+static void						wc_report_percentiles(FILE *, const char *, double *, wi_uinteger_t);
+static int						wc_compare_intervals(const void *, const void *);
+
 static wi_p7_socket_t *			wc_connect(wi_url_t *);
 static wi_boolean_t				wc_login(wi_p7_socket_t *, wi_url_t *);
 static wi_p7_message_t *		wc_write_message_and_read_reply(wi_p7_socket_t *, wi_p7_message_t *, wi_string_t *);
@@ -47,39 +89,92 @@ static wi_p7_message_t *		wc_write_message_and_read_reply(wi_p7_socket_t *, wi_p
 
 static wi_p7_spec_t				*wc_spec;
 
+static wi_uinteger_t			wc_concurrency = 10;
+static wi_uinteger_t			wc_download_percentage = 50;
+static wi_uinteger_t			wc_resume_percentage = 0;
+static wi_time_interval_t		wc_run_time = 60.0;
+static wi_time_interval_t		wc_list_interval = 0.0;
+static wi_p7_uint64_t			wc_sizes[WC_MAX_SIZES];
+static wi_uinteger_t			wc_sizes_count;
+
+static wi_lock_t				*wc_results_lock;
+static wc_results_t				wc_results[2];
+static wc_results_t				wc_listings;
+
 
 int main(int argc, const char **argv) {
 	wi_pool_t			*pool;
 	wi_string_t			*user, *password, *root_path;
 	wi_mutable_url_t	*url;
+	FILE				*fp;
+	char				*size, *sizes;
+	const char			*output;
 	int					ch;
 	
 	wi_initialize();
 	wi_load(argc, argv);
 	
 	wi_log_tool 	= true;
-	wi_log_level 	= WI_LOG_DEBUG;
+	wi_log_level 	= WI_LOG_WARN;
 	
 	pool			= wi_pool_init(wi_pool_alloc());
 	
-	user 			= WI_STR("guest");
+	user 			= WI_STR("admin");
 	password		= WI_STR("");
 	root_path		= WI_STR(WD_ROOT);
+	output			= NULL;
 	
-	while((ch = getopt(argc, (char * const *) argv, "d:p:u:")) != -1) {
+	while((ch = getopt(argc, (char * const *) argv, "c:d:l:m:o:p:r:s:t:u:v")) != -1) {
 		switch(ch) {
+			case 'c':
+				wc_concurrency = WI_MAX(1, strtoul(optarg, NULL, 10));
+				break;
+				
 			case 'd':
 				root_path = wi_string_with_cstring(optarg);
 				break;
 				
+			case 'l':
+				wc_list_interval = WI_MAX(0.0, strtod(optarg, NULL));
+				break;
+				
+			case 'm':
+				wc_download_percentage = WI_MIN(100, strtoul(optarg, NULL, 10));
+				break;
+				
+			case 'o':
+				output = optarg;
+				break;
+				
 			case 'p':
 				password = wi_string_with_cstring(optarg);
 				break;
 				
+			case 'r':
+				wc_resume_percentage = WI_MIN(100, strtoul(optarg, NULL, 10));
+				break;
+				
+			case 's':
+				sizes = strdup(optarg);
+				
+				while((size = strsep(&sizes, ",")) && wc_sizes_count < WC_MAX_SIZES) {
+					if(*size)
+						wc_sizes[wc_sizes_count++] = wc_size_with_string(size);
+				}
+				break;
+				
+			case 't':
+				wc_run_time = WI_MAX(1.0, strtod(optarg, NULL));
+				break;
+				
 			case 'u':
 				user = wi_string_with_cstring(optarg);
 				break;
 				
+			case 'v':
+				wi_log_level = WI_LOG_DEBUG;
+				break;
+				
 			case '?':
 			case 'h':
 			default:
@@ -94,6 +189,9 @@ int main(int argc, const char **argv) {
 	if(argc != 1)
 		wc_usage();
 	
+	if(wc_sizes_count == 0)
+		wc_sizes[wc_sizes_count++] = 1048576;
+	
 	if(!wi_fs_change_directory(root_path))
 		wi_log_fatal(WI_STR("Could not change directory to %@: %m"), root_path);
 	
@@ -117,9 +215,25 @@ int main(int argc, const char **argv) {
 	if(!wi_url_is_valid(url))
 		wc_usage();
 	
+	if(output) {
+		fp = fopen(output, "w");
+		
+		if(!fp)
+			wi_log_fatal(WI_STR("Could not open %s: %s"), output, strerror(errno));
+	} else {
+		fp = stdout;
+	}
+	
 	signal(SIGPIPE, SIG_IGN);
+	srandom(time(NULL) ^ getpid());
+	
+	wc_results_lock = wi_lock_init(wi_lock_alloc());
+	
+	wc_test(url, WI_STR("/transfertest"));
+	wc_report(fp, wc_run_time);
 	
-	wc_test(url, 10, WI_STR("/transfertest"));
+	if(fp != stdout)
+		fclose(fp);
 	
 	wi_release(pool);
 	
@@ -130,11 +244,25 @@ int main(int argc, const char **argv) {
 
 static void wc_usage(void) {
 	fprintf(stderr,
-"Usage: wiredclient [-p password] [-u user] host\n\
+"Usage: transfertest [-c concurrency] [-d root] [-l seconds] [-m percentage] [-o file]\n\
+                    [-p password] [-r percentage] [-s size,...] [-t seconds] [-u user] [-v] host\n\
 \n\
 Options:\n\
+    -c concurrency      number of connections transferring at once (default 10)\n\
+    -d root             directory containing wired.xml\n\
+    -l seconds          list the test directory this often on a separate connection\n\
+                        and report the listing latency\n\
+    -m percentage       percentage of transfers that are downloads (default 50)\n\
+    -o file             write results to file instead of standard output\n\
     -p password         password\n\
-    -u user             user\n\
+    -r percentage       percentage of downloads that resume at a random offset\n\
+    -s size,...         file sizes to pick from at random, with k, m or g suffix\n\
+                        (default 1m)\n\
+    -t seconds          run time (default 60)\n\
+    -u user             user (default admin)\n\
+    -v                  log progress\n\
+\n\
+Results are written as JSON when the run time has passed.\n\
 \n\
 By Axel Andersson <axel@zankasoftware.com>\n");
 	
@@ -145,7 +273,7 @@ By Axel Andersson <axel@zankasoftware.com>\n");
 
 #pragma mark -
 
-static void wc_test(wi_url_t *url, wi_uinteger_t count, wi_string_t *path) {
+static void wc_test(wi_url_t *url, wi_string_t *path) {
 	wi_p7_socket_t		*socket;
 	wi_p7_message_t		*message;
 	wi_mutable_url_t	*testurl;
@@ -156,7 +284,7 @@ static void wc_test(wi_url_t *url, wi_uinteger_t count, wi_string_t *path) {
 	socket = wc_connect(url);
 	
 	if(!socket)
-		return;
+		wi_log_fatal(WI_STR("Could not connect to %@: %m"), wi_url_host(url));
 	
 	if(!wc_login(socket, url))
 		wi_log_fatal(WI_STR("Could not login: %m"));
@@ -171,16 +299,25 @@ static void wc_test(wi_url_t *url, wi_uinteger_t count, wi_string_t *path) {
 
 	wi_log_info(WI_STR("Connecting test sockets..."));
 	
-	for(i = 0; i < count; i++) {
+	for(i = 0; i < wc_concurrency; i++) {
 		testurl = wi_autorelease(wi_mutable_copy(url));
 		
-		wi_mutable_url_set_path(testurl, wi_string_with_format(WI_STR("/transfertest/%u"), i));
+		wi_mutable_url_set_path(testurl, wi_string_with_format(WI_STR("%@/%u"), path, i));
 
 		if(!wi_thread_create_thread(wc_test_thread, testurl))
 			wi_log_error(WI_STR("Could not create a thread: %m"));
 	}
 	
-	wi_thread_sleep(86400.0);
+	if(wc_list_interval > 0.0) {
+		testurl = wi_autorelease(wi_mutable_copy(url));
+		
+		wi_mutable_url_set_path(testurl, path);
+		
+		if(!wi_thread_create_thread(wc_list_thread, testurl))
+			wi_log_error(WI_STR("Could not create a thread: %m"));
+	}
+	
+	wi_thread_sleep(wc_run_time);
 }
 
 
@@ -190,6 +327,9 @@ static void wc_test_thread(wi_runtime_instance_t *argument) {
 	wi_p7_socket_t		*socket;
 	wi_url_t			*url = argument;
 	wi_string_t			*path;
+	wc_sample_t			sample;
+	wi_p7_uint64_t		size, offset;
+	wi_boolean_t		resume;
 	
 	pool = wi_pool_init(wi_pool_alloc());
 	
@@ -202,10 +342,83 @@ static void wc_test_thread(wi_runtime_instance_t *argument) {
 		wi_log_fatal(WI_STR("Could not login: %m"));
 	
 	path = wi_url_path(url);
+	size = 0;
 	
 	while(true) {
-		wc_upload(socket, path);
-		wc_download(socket, path);
+		if(size > 0 && (wi_uinteger_t) (random() % 100) < wc_download_percentage) {
+			resume = ((wi_uinteger_t) (random() % 100) < wc_resume_percentage);
+			offset = resume ? (size * (random() % 100)) / 100 : 0;
+			
+			wc_download(socket, path, size, offset, &sample);
+			wc_add_sample(WC_DOWNLOAD, &sample, resume);
+		} else {
+			size = wc_random_size();
+			
+			wc_upload(socket, path, size, &sample);
+			wc_add_sample(WC_UPLOAD, &sample, false);
+		}
+		
+		wi_pool_drain(pool);
+	}
+	
+	wi_release(pool);
+}
+
+
+
+static void wc_list_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t			*pool;
+	wi_p7_socket_t		*socket;
+	wi_p7_message_t		*message;
+	wi_url_t			*url = argument;
+	wi_string_t			*path, *name;
+	wi_time_interval_t	start;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	socket = wc_connect(url);
+	
+	if(!socket)
+		return;
+	
+	if(!wc_login(socket, url))
+		wi_log_fatal(WI_STR("Could not login: %m"));
+	
+	path = wi_url_path(url);
+	
+	while(true) {
+		message = wi_p7_message_with_name(WI_STR("wired.file.list_directory"), wc_spec);
+		wi_p7_message_set_string_for_name(message, path, WI_STR("wired.file.path"));
+		
+		start = wi_time_interval();
+		
+		if(!wi_p7_socket_write_message(socket, 0.0, message))
+			wi_log_fatal(WI_STR("Could not write message for %@: %m"), path);
+		
+		do {
+			message = wi_p7_socket_read_message(socket, 0.0);
+			
+			if(!message)
+				wi_log_fatal(WI_STR("Could not read message for %@: %m"), path);
+			
+			name = wi_p7_message_name(message);
+			
+			if(wi_is_equal(name, WI_STR("wired.error"))) {
+				wi_log_fatal(WI_STR("Could not list %@: %@"), path, wi_p7_message_enum_name_for_name(message, WI_STR("wired.error")));
+			}
+			else if(wi_is_equal(name, WI_STR("wired.send_ping"))) {
+				message = wi_p7_message_with_name(WI_STR("wired.ping"), wc_spec);
+				
+				if(!wi_p7_socket_write_message(socket, 0.0, message))
+					wi_log_fatal(WI_STR("Could not write message for %@: %m"), path);
+			}
+		} while(!wi_is_equal(name, WI_STR("wired.file.file_list.done")));
+		
+		wc_add_listing(wi_time_interval() - start);
+		
+		wi_pool_drain(pool);
+		
+		wi_thread_sleep(wc_list_interval);
 	}
 	
 	wi_release(pool);
@@ -213,19 +426,21 @@ static void wc_test_thread(wi_runtime_instance_t *argument) {
 
 
 
-static void wc_download(wi_p7_socket_t *socket, wi_string_t *path) {
+static void wc_download(wi_p7_socket_t *socket, wi_string_t *path, wi_p7_uint64_t size, wi_p7_uint64_t offset, wc_sample_t *sample) {
 	wi_p7_message_t		*message, *reply;
 	wi_string_t			*name, *error;
 	void				*file;
+	wi_time_interval_t	start;
 	wi_p7_uint32_t		queue;
-	wi_p7_uint64_t		size;
 	wi_integer_t		readsize;
 	
 	message = wi_p7_message_with_name(WI_STR("wired.transfer.download_file"), wc_spec);
 	wi_p7_message_set_string_for_name(message, path, WI_STR("wired.file.path"));
-	wi_p7_message_set_uint64_for_name(message, 0, WI_STR("wired.transfer.data_offset"));
+	wi_p7_message_set_uint64_for_name(message, offset, WI_STR("wired.transfer.data_offset"));
 	wi_p7_message_set_uint64_for_name(message, 0, WI_STR("wired.transfer.rsrc_offset"));
 	
+	start = wi_time_interval();
+	
 	if(!wi_p7_socket_write_message(socket, 0.0, message))
 		wi_log_fatal(WI_STR("Could not write message for %@: %m"), path);
 	
@@ -242,15 +457,23 @@ static void wc_download(wi_p7_socket_t *socket, wi_string_t *path) {
 			
 			wi_log_info(WI_STR("Downloading %@..."), path);
 			
+			sample->bytes		= size;
+			sample->first_byte	= wi_time_interval() - start;
+			
 			while(size > 0) {
 				readsize = wi_p7_socket_read_oobdata(socket, 0.0, &file);
 				
 				if(readsize < 0)
 					wi_log_fatal(WI_STR("Could not read download for %@: %m"), path);
 				
+				if(size == sample->bytes)
+					sample->first_byte = wi_time_interval() - start;
+				
 				size -= readsize;
 			}
 			
+			sample->latency = wi_time_interval() - start;
+			
 			return;
 		}
 		else if(wi_is_equal(name, WI_STR("wired.transfer.queue"))) {
@@ -277,18 +500,17 @@ static void wc_download(wi_p7_socket_t *socket, wi_string_t *path) {
 
 
 
-static void wc_upload(wi_p7_socket_t *socket, wi_string_t *path) {
+static void wc_upload(wi_p7_socket_t *socket, wi_string_t *path, wi_p7_uint64_t size, wc_sample_t *sample) {
 	wi_p7_message_t		*message, *reply;
 	wi_string_t			*name, *error;
 	char				file[8192];
+	wi_time_interval_t	start;
 	wi_uinteger_t		sendsize;
-	wi_p7_uint64_t		size, offset;
+	wi_p7_uint64_t		remaining, offset;
 	wi_p7_uint32_t		queue;
 	
 	memset(file, 42, sizeof(file));
 	
-	size = 1000 * sizeof(file);
-	
 	wi_log_info(WI_STR("Deleting %@..."), path);
 	
 	message = wi_p7_message_with_name(WI_STR("wired.file.delete"), wc_spec);
@@ -301,6 +523,8 @@ static void wc_upload(wi_p7_socket_t *socket, wi_string_t *path) {
 	wi_p7_message_set_uint64_for_name(message, size, WI_STR("wired.transfer.data_size"));
 	wi_p7_message_set_uint64_for_name(message, 0, WI_STR("wired.transfer.rsrc_size"));
 	
+	start = wi_time_interval();
+	
 	if(!wi_p7_socket_write_message(socket, 0.0, message))
 		wi_log_fatal(WI_STR("Could not write message for %@: %m"), path);
 	
@@ -317,24 +541,30 @@ static void wc_upload(wi_p7_socket_t *socket, wi_string_t *path) {
 			
 			wi_log_info(WI_STR("Uploading %@..."), path);
 			
+			remaining			= size - offset;
+			sample->bytes		= remaining;
+			sample->first_byte	= wi_time_interval() - start;
+			
 			message = wi_p7_message_with_name(WI_STR("wired.transfer.upload"), wc_spec);
 			wi_p7_message_set_string_for_name(message, path, WI_STR("wired.file.path"));
-			wi_p7_message_set_oobdata_for_name(message, size - offset, WI_STR("wired.transfer.data"));
+			wi_p7_message_set_oobdata_for_name(message, remaining, WI_STR("wired.transfer.data"));
 			wi_p7_message_set_oobdata_for_name(message, 0, WI_STR("wired.transfer.rsrc"));
 			wi_p7_message_set_data_for_name(message, wi_data(), WI_STR("wired.transfer.finderinfo"));
 			
 			if(!wi_p7_socket_write_message(socket, 0.0, message))
 				wi_log_fatal(WI_STR("Could not write message for %@: %m"), path);
 			
-			while(size - offset > 0) {
-				sendsize = WI_MIN(size - offset, sizeof(file));
+			while(remaining > 0) {
+				sendsize = WI_MIN(remaining, sizeof(file));
 				
 				if(!wi_p7_socket_write_oobdata(socket, 0.0, file, sendsize))
 					wi_log_fatal(WI_STR("Could not write data for %@: %m"), path);
 				
-				size -= sendsize;
+				remaining -= sendsize;
 			}
 			
+			sample->latency = wi_time_interval() - start;
+			
 			return;
 		}
 		else if(wi_is_equal(name, WI_STR("wired.transfer.queue"))) {
@@ -361,6 +591,157 @@ static void wc_upload(wi_p7_socket_t *socket, wi_string_t *path) {
 
 
 
+#pragma mark -
+
+static wi_p7_uint64_t wc_size_with_string(const char *string) {
+	char				*end;
+	wi_p7_uint64_t		size;
+	
+	size = strtoull(string, &end, 10);
+	
+	switch(*end) {
+		case 'g':
+		case 'G':
+			size *= 1024;
+			
+		case 'm':
+		case 'M':
+			size *= 1024;
+			
+		case 'k':
+		case 'K':
+			size *= 1024;
+			break;
+	}
+	
+	return size;
+}
+
+
+
+static wi_p7_uint64_t wc_random_size(void) {
+	return wc_sizes[random() % wc_sizes_count];
+}
+
+
+
+static void wc_add_sample(wc_direction_t direction, wc_sample_t *sample, wi_boolean_t resumed) {
+	wc_results_t		*results;
+	
+	wi_lock_lock(wc_results_lock);
+	
+	results = &wc_results[direction];
+	
+	if(results->count == results->capacity) {
+		results->capacity		= WI_MAX(256, results->capacity * 2);
+		results->first_bytes	= wi_realloc(results->first_bytes, results->capacity * sizeof(double));
+		results->latencies		= wi_realloc(results->latencies, results->capacity * sizeof(double));
+	}
+	
+	results->first_bytes[results->count]	= sample->first_byte;
+	results->latencies[results->count]		= sample->latency;
+	results->bytes							+= sample->bytes;
+	results->count++;
+	
+	if(resumed)
+		results->resumed++;
+	
+	wi_lock_unlock(wc_results_lock);
+}
+
+
+
+static void wc_add_listing(wi_time_interval_t interval) {
+	wi_lock_lock(wc_results_lock);
+	
+	if(wc_listings.count == wc_listings.capacity) {
+		wc_listings.capacity	= WI_MAX(256, wc_listings.capacity * 2);
+		wc_listings.latencies	= wi_realloc(wc_listings.latencies, wc_listings.capacity * sizeof(double));
+	}
+	
+	wc_listings.latencies[wc_listings.count++] = interval;
+	
+	wi_lock_unlock(wc_results_lock);
+}
+
+
+
+#pragma mark -
+
+static void wc_report(FILE *fp, wi_time_interval_t interval) {
+	wi_lock_lock(wc_results_lock);
+	
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"run_time\": %.3f,\n", interval);
+	fprintf(fp, "  \"concurrency\": %lu,\n", (unsigned long) wc_concurrency);
+	fprintf(fp, "  \"download_percentage\": %lu,\n", (unsigned long) wc_download_percentage);
+	fprintf(fp, "  \"resume_percentage\": %lu,\n", (unsigned long) wc_resume_percentage);
+	
+	wc_report_results(fp, "downloads", &wc_results[WC_DOWNLOAD], interval);
+	fprintf(fp, ",\n");
+	wc_report_results(fp, "uploads", &wc_results[WC_UPLOAD], interval);
+	
+	if(wc_list_interval > 0.0) {
+		fprintf(fp, ",\n  \"listings\": {\n");
+		fprintf(fp, "    \"count\": %lu,\n", (unsigned long) wc_listings.count);
+		wc_report_percentiles(fp, "latency", wc_listings.latencies, wc_listings.count);
+		fprintf(fp, "\n  }");
+	}
+	
+	fprintf(fp, "\n}\n");
+	
+	wi_lock_unlock(wc_results_lock);
+}
+
+
+
+static void wc_report_results(FILE *fp, const char *name, wc_results_t *results, wi_time_interval_t interval) {
+	fprintf(fp, "  \"%s\": {\n", name);
+	fprintf(fp, "    \"count\": %lu,\n", (unsigned long) results->count);
+	fprintf(fp, "    \"resumed\": %lu,\n", (unsigned long) results->resumed);
+	fprintf(fp, "    \"bytes\": %llu,\n", (unsigned long long) results->bytes);
+	fprintf(fp, "    \"bytes_per_second\": %.0f,\n", (double) results->bytes / interval);
+	
+	wc_report_percentiles(fp, "time_to_first_byte", results->first_bytes, results->count);
+	fprintf(fp, ",\n");
+	wc_report_percentiles(fp, "latency", results->latencies, results->count);
+	fprintf(fp, "\n  }");
+}
+
+
+
+static void wc_report_percentiles(FILE *fp, const char *name, double *values, wi_uinteger_t count) {
+	if(count == 0) {
+		fprintf(fp, "    \"%s\": null", name);
+		
+		return;
+	}
+	
+	qsort(values, count, sizeof(double), wc_compare_intervals);
+	
+	fprintf(fp, "    \"%s\": { \"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f }",
+		name,
+		values[(count - 1) * 50 / 100],
+		values[(count - 1) * 90 / 100],
+		values[(count - 1) * 99 / 100],
+		values[count - 1]);
+}
+
+
+
+static int wc_compare_intervals(const void *p1, const void *p2) {
+	double		d1 = *(const double *) p1, d2 = *(const double *) p2;
+	
+	if(d1 < d2)
+		return -1;
+	else if(d1 > d2)
+		return 1;
+	
+	return 0;
+}
+
+
+
 #pragma mark -
 
 static wi_p7_socket_t * wc_connect(wi_url_t *url) {
@@ -1678,6 +1678,9 @@ static void wd_accounts_reload_account(wd_user_t *user, wi_string_t *name) {
 	
 	wd_user_set_login(user, wd_account_name(newaccount));
 	
+	if(wd_user_session_id(user) != 0)
+		return;
+	
 	newcolor = wd_account_color(newaccount);
 	
 	if(wd_user_color(user) != newcolor) {
@@ -1768,15 +1771,15 @@ static void wd_accounts_notify_subscribers(void) {
 	wi_p7_message_t		*message;
 	wd_user_t			*user;
 	
+	message = wi_p7_message_with_name(WI_STR("wired.account.accounts_changed"), wd_p7_spec);
+	
 	wi_dictionary_rdlock(wd_users);
 	
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((user = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_is_subscribed_accounts(user)) {
-			message = wi_p7_message_with_name(WI_STR("wired.account.accounts_changed"), wd_p7_spec);
+		if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_session_id(user) == 0 && wd_user_is_subscribed_accounts(user))
 			wd_user_send_message(user, message);
-		}
 	}
 	
 	wi_dictionary_unlock(wd_users);
@@ -64,6 +64,7 @@ static wi_boolean_t								wd_boards_convert_news_to_database(wi_string_t *, wi_
 static wd_board_privileges_t *					wd_boards_privileges_for_path(wi_string_t *);
 
 static void										wd_boards_changed_thread(wi_uuid_t *, wd_board_privileges_t *);
+static wi_p7_message_t *						wd_boards_board_message(wi_p7_message_t *[2][2], wi_string_t *, wi_string_t *, wi_boolean_t, wi_boolean_t);
 static wd_board_privileges_t *					wd_boards_privileges_for_board(wi_string_t *);
 static wd_board_privileges_t *					wd_boards_privileges_for_thread(wi_uuid_t *);
 static wd_board_privileges_t *					wd_boards_privileges_for_post(wi_uuid_t *);
@@ -451,7 +452,7 @@ wi_boolean_t wd_boards_reply_thread(wi_uuid_t *thread, wd_user_t *user, wi_p7_me
 
 wi_boolean_t wd_boards_add_board(wi_string_t *board, wd_user_t *user, wi_p7_message_t *message) {
 	wi_enumerator_t			*enumerator;
-	wi_p7_message_t			*broadcast;
+	wi_p7_message_t			*broadcasts[2][2] = { { NULL, NULL }, { NULL, NULL } };
 	wd_user_t				*peer;
 	wd_board_privileges_t	*privileges;
 	wi_boolean_t			readable, writable;
@@ -475,17 +476,12 @@ wi_boolean_t wd_boards_add_board(wi_string_t *board, wd_user_t *user, wi_p7_mess
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			readable = wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer));
 			writable = wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer));
 
-			if(readable || writable) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_added"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
-				wi_p7_message_set_bool_for_name(broadcast, readable, WI_STR("wired.board.readable"));
-				wi_p7_message_set_bool_for_name(broadcast, writable, WI_STR("wired.board.writable"));
-				wd_user_send_message(peer, broadcast);
-			}
+			if(readable || writable)
+				wd_user_send_message(peer, wd_boards_board_message(broadcasts, WI_STR("wired.board.board_added"), board, readable, writable));
 		}
 	}
 	
@@ -514,19 +510,19 @@ wi_boolean_t wd_boards_rename_board(wi_string_t *oldboard, wi_string_t *newboard
 	
 	privileges = wd_boards_privileges_for_board(newboard);
 	
+	broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_renamed"), wd_p7_spec);
+	wi_p7_message_set_string_for_name(broadcast, oldboard, WI_STR("wired.board.board"));
+	wi_p7_message_set_string_for_name(broadcast, newboard, WI_STR("wired.board.new_board"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer)) ||
-			   wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer))) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_renamed"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, oldboard, WI_STR("wired.board.board"));
-				wi_p7_message_set_string_for_name(broadcast, newboard, WI_STR("wired.board.new_board"));
+			   wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer)))
 				wd_user_send_message(peer, broadcast);
-			}
 		}
 	}
 	
@@ -555,19 +551,19 @@ wi_boolean_t wd_boards_move_board(wi_string_t *oldboard, wi_string_t *newboard,
 	
 	privileges = wd_boards_privileges_for_board(newboard);
 	
+	broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_moved"), wd_p7_spec);
+	wi_p7_message_set_string_for_name(broadcast, oldboard, WI_STR("wired.board.board"));
+	wi_p7_message_set_string_for_name(broadcast, newboard, WI_STR("wired.board.new_board"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer)) ||
-			   wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer))) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_moved"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, oldboard, WI_STR("wired.board.board"));
-				wi_p7_message_set_string_for_name(broadcast, newboard, WI_STR("wired.board.new_board"));
+			   wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer)))
 				wd_user_send_message(peer, broadcast);
-			}
 		}
 	}
 	
@@ -595,18 +591,18 @@ wi_boolean_t wd_boards_delete_board(wi_string_t *board, wd_user_t *user, wi_p7_m
 		return false;
 	}
 	
+	broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_deleted"), wd_p7_spec);
+	wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer)) ||
-			   wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer))) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_deleted"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
+			   wd_board_privileges_is_writable_by_account(privileges, wd_user_account(peer)))
 				wd_user_send_message(peer, broadcast);
-			}
 		}
 	}
 	
@@ -643,6 +639,8 @@ wi_boolean_t wd_boards_get_board_info(wi_string_t *board, wd_user_t *user, wi_p7
 wi_boolean_t wd_boards_set_board_info(wi_string_t *board, wd_user_t *user, wi_p7_message_t *message) {
 	wi_enumerator_t			*enumerator;
 	wi_p7_message_t			*broadcast;
+	wi_p7_message_t			*added[2][2] = { { NULL, NULL }, { NULL, NULL } };
+	wi_p7_message_t			*changed[2][2] = { { NULL, NULL }, { NULL, NULL } };
 	wd_user_t				*peer;
 	wd_board_privileges_t	*oldprivileges, *newprivileges;
 	wi_boolean_t			oldreadable, newreadable;
@@ -663,36 +661,26 @@ wi_boolean_t wd_boards_set_board_info(wi_string_t *board, wd_user_t *user, wi_p7
 		return false;
 	}
 	
+	broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_deleted"), wd_p7_spec);
+	wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			oldreadable = wd_board_privileges_is_readable_by_account(oldprivileges, wd_user_account(peer));
 			newreadable = wd_board_privileges_is_readable_by_account(newprivileges, wd_user_account(peer));
 			oldwritable = wd_board_privileges_is_writable_by_account(oldprivileges, wd_user_account(peer));
 			newwritable = wd_board_privileges_is_writable_by_account(newprivileges, wd_user_account(peer));
 			
-			if((oldreadable || oldwritable) && (!newreadable && !newwritable)) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_deleted"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
-				wd_user_send_message(peer, broadcast);
-			}
-			else if((!oldreadable && !oldwritable) && (newreadable || newwritable)) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_added"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
-				wi_p7_message_set_bool_for_name(broadcast, newreadable, WI_STR("wired.board.readable"));
-				wi_p7_message_set_bool_for_name(broadcast, newwritable, WI_STR("wired.board.writable"));
-				wd_user_send_message(peer, broadcast);
-			}
-			else if((oldreadable || oldwritable) && (newreadable || newwritable)) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.board_info_changed"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
-				wi_p7_message_set_bool_for_name(broadcast, newreadable, WI_STR("wired.board.readable"));
-				wi_p7_message_set_bool_for_name(broadcast, newwritable, WI_STR("wired.board.writable"));
+			if((oldreadable || oldwritable) && (!newreadable && !newwritable))
 				wd_user_send_message(peer, broadcast);
-			}
+			else if((!oldreadable && !oldwritable) && (newreadable || newwritable))
+				wd_user_send_message(peer, wd_boards_board_message(added, WI_STR("wired.board.board_added"), board, newreadable, newwritable));
+			else if((oldreadable || oldwritable) && (newreadable || newwritable))
+				wd_user_send_message(peer, wd_boards_board_message(changed, WI_STR("wired.board.board_info_changed"), board, newreadable, newwritable));
 		}
 	}
 	
@@ -804,11 +792,12 @@ wi_string_t * wd_boards_subject_for_post(wi_uuid_t *post) {
 
 wi_boolean_t wd_boards_add_thread(wi_string_t *board, wi_string_t *subject, wi_string_t *text, wd_user_t *user, wi_p7_message_t *message) {
 	wi_enumerator_t			*enumerator;
-	wi_p7_message_t			*broadcast;
+	wi_p7_message_t			*broadcasts[2] = { NULL, NULL };
 	wi_uuid_t				*thread;
 	wi_date_t				*postdate;
 	wd_user_t				*peer;
 	wd_board_privileges_t	*privileges;
+	wi_boolean_t			own;
 	
 	privileges = wd_boards_privileges_for_board(board);
 	
@@ -846,18 +835,23 @@ wi_boolean_t wd_boards_add_thread(wi_string_t *board, wi_string_t *subject, wi_s
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer))) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_added"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, board, WI_STR("wired.board.board"));
-				wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
-				wi_p7_message_set_date_for_name(broadcast, postdate, WI_STR("wired.board.post_date"));
-				wi_p7_message_set_string_for_name(broadcast, subject, WI_STR("wired.board.subject"));
-				wi_p7_message_set_uint32_for_name(broadcast, 0, WI_STR("wired.board.replies"));
-				wi_p7_message_set_bool_for_name(broadcast, wi_is_equal(wd_user_login(peer), wd_user_login(user)), WI_STR("wired.board.own_thread"));
-				wi_p7_message_set_string_for_name(broadcast, wd_user_nick(user), WI_STR("wired.user.nick"));
-				wi_p7_message_set_data_for_name(broadcast, wd_user_icon(user), WI_STR("wired.user.icon"));
-				wd_user_send_message(peer, broadcast);
+				own = wi_is_equal(wd_user_login(peer), wd_user_login(user)) ? 1 : 0;
+				
+				if(!broadcasts[own]) {
+					broadcasts[own] = wi_p7_message_with_name(WI_STR("wired.board.thread_added"), wd_p7_spec);
+					wi_p7_message_set_string_for_name(broadcasts[own], board, WI_STR("wired.board.board"));
+					wi_p7_message_set_uuid_for_name(broadcasts[own], thread, WI_STR("wired.board.thread"));
+					wi_p7_message_set_date_for_name(broadcasts[own], postdate, WI_STR("wired.board.post_date"));
+					wi_p7_message_set_string_for_name(broadcasts[own], subject, WI_STR("wired.board.subject"));
+					wi_p7_message_set_uint32_for_name(broadcasts[own], 0, WI_STR("wired.board.replies"));
+					wi_p7_message_set_bool_for_name(broadcasts[own], own, WI_STR("wired.board.own_thread"));
+					wi_p7_message_set_string_for_name(broadcasts[own], wd_user_nick(user), WI_STR("wired.user.nick"));
+					wi_p7_message_set_data_for_name(broadcasts[own], wd_user_icon(user), WI_STR("wired.user.icon"));
+				}
+				
+				wd_user_send_message(peer, broadcasts[own]);
 			}
 		}
 	}
@@ -923,12 +917,12 @@ wi_boolean_t wd_boards_edit_thread(wi_uuid_t *thread, wi_string_t *subject, wi_s
 
 wi_boolean_t wd_boards_move_thread(wi_uuid_t *thread, wi_string_t *newboard, wd_user_t *user, wi_p7_message_t *message) {
 	wi_enumerator_t			*enumerator;
-	wi_p7_message_t			*broadcast;
+	wi_p7_message_t			*moved, *deleted, *added[2] = { NULL, NULL };
 	wi_dictionary_t			*results;
 	wi_runtime_instance_t	*postdate, *editdate, *login;
 	wd_user_t				*peer;
 	wd_board_privileges_t	*oldprivileges, *newprivileges;
-	wi_boolean_t			oldreadable, newreadable;
+	wi_boolean_t			oldreadable, newreadable, own;
 	
 	results = wi_sqlite3_execute_statement(wd_database, WI_STR("SELECT board, thread, post_date, edit_date, subject, nick, login, icon "
 															   "FROM threads "
@@ -969,44 +963,51 @@ wi_boolean_t wd_boards_move_thread(wi_uuid_t *thread, wi_string_t *newboard, wd_
 		return false;
 	}
 	
+	moved = wi_p7_message_with_name(WI_STR("wired.board.thread_moved"), wd_p7_spec);
+	wi_p7_message_set_uuid_for_name(moved, thread, WI_STR("wired.board.thread"));
+	wi_p7_message_set_string_for_name(moved, newboard, WI_STR("wired.board.new_board"));
+	
+	deleted = wi_p7_message_with_name(WI_STR("wired.board.thread_deleted"), wd_p7_spec);
+	wi_p7_message_set_uuid_for_name(deleted, thread, WI_STR("wired.board.thread"));
+	
+	postdate	= wi_dictionary_data_for_key(results, WI_STR("post_date"));
+	editdate	= wi_dictionary_data_for_key(results, WI_STR("edit_date"));
+	login		= wi_dictionary_data_for_key(results, WI_STR("login"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
 			oldreadable = wd_board_privileges_is_readable_by_account(oldprivileges, wd_user_account(peer));
 			newreadable = wd_board_privileges_is_readable_by_account(newprivileges, wd_user_account(peer));
 			
 			if(oldreadable && newreadable) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_moved"), wd_p7_spec);
-				wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
-				wi_p7_message_set_string_for_name(broadcast, newboard, WI_STR("wired.board.new_board"));
-				wd_user_send_message(peer, broadcast);
+				wd_user_send_message(peer, moved);
 			}
 			else if(oldreadable) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_deleted"), wd_p7_spec);
-				wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
-				wd_user_send_message(peer, broadcast);
+				wd_user_send_message(peer, deleted);
 			}
 			else if(newreadable) {
-				postdate	= wi_dictionary_data_for_key(results, WI_STR("post_date"));
-				editdate	= wi_dictionary_data_for_key(results, WI_STR("edit_date"));
-				login		= wi_dictionary_data_for_key(results, WI_STR("login"));
-
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_added"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(broadcast, newboard, WI_STR("wired.board.board"));
-				wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
-				wi_p7_message_set_date_for_name(broadcast, wi_date_with_sqlite3_string(postdate), WI_STR("wired.board.post_date"));
+				own = wi_is_equal(login, wd_user_login(user)) ? 1 : 0;
 				
-				if(editdate != wi_null())
-					wi_p7_message_set_date_for_name(broadcast, wi_date_with_sqlite3_string(editdate), WI_STR("wired.board.edit_date"));
+				if(!added[own]) {
+					added[own] = wi_p7_message_with_name(WI_STR("wired.board.thread_added"), wd_p7_spec);
+					wi_p7_message_set_string_for_name(added[own], newboard, WI_STR("wired.board.board"));
+					wi_p7_message_set_uuid_for_name(added[own], thread, WI_STR("wired.board.thread"));
+					wi_p7_message_set_date_for_name(added[own], wi_date_with_sqlite3_string(postdate), WI_STR("wired.board.post_date"));
+					
+					if(editdate != wi_null())
+						wi_p7_message_set_date_for_name(added[own], wi_date_with_sqlite3_string(editdate), WI_STR("wired.board.edit_date"));
+					
+					wi_p7_message_set_bool_for_name(added[own], own, WI_STR("wired.board.post_date"));
+					wi_p7_message_set_string_for_name(added[own], wi_dictionary_data_for_key(results, WI_STR("subject")), WI_STR("wired.board.subject"));
+					wi_p7_message_set_string_for_name(added[own], wi_dictionary_data_for_key(results, WI_STR("nick")), WI_STR("wired.user.nick"));
+					wi_p7_message_set_data_for_name(added[own], wi_dictionary_data_for_key(results, WI_STR("icon")), WI_STR("wired.user.icon"));
+				}
 				
-				wi_p7_message_set_bool_for_name(broadcast, wi_is_equal(login, wd_user_login(user)), WI_STR("wired.board.post_date"));
-				wi_p7_message_set_string_for_name(broadcast, wi_dictionary_data_for_key(results, WI_STR("subject")), WI_STR("wired.board.subject"));
-				wi_p7_message_set_string_for_name(broadcast, wi_dictionary_data_for_key(results, WI_STR("nick")), WI_STR("wired.user.nick"));
-				wi_p7_message_set_data_for_name(broadcast, wi_dictionary_data_for_key(results, WI_STR("icon")), WI_STR("wired.user.icon"));
-				wd_user_send_message(peer, broadcast);
+				wd_user_send_message(peer, added[own]);
 			}
 		}
 	}
@@ -1068,17 +1069,17 @@ wi_boolean_t wd_boards_delete_thread(wi_uuid_t *thread, wd_user_t *user, wi_p7_m
 		return false;
 	}
 	
+	broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_deleted"), wd_p7_spec);
+	wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(peer)) {
-			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer))) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_deleted"), wd_p7_spec);
-				wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_boards(peer)) {
+			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(peer)))
 				wd_user_send_message(peer, broadcast);
-			}
 		}
 	}
 	
@@ -1686,30 +1687,29 @@ static void wd_boards_changed_thread(wi_uuid_t *thread, wd_board_privileges_t *p
 	latestreply			= wi_dictionary_data_for_key(results, WI_STR("latest_reply"));
 	latestreplydate		= wi_dictionary_data_for_key(results, WI_STR("latest_reply_date"));
 	
+	broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_changed"), wd_p7_spec);
+	wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
+	wi_p7_message_set_string_for_name(broadcast, subject, WI_STR("wired.board.subject"));
+
+	if(editdate != wi_null())
+		wi_p7_message_set_date_for_name(broadcast, wi_date_with_sqlite3_string(editdate), WI_STR("wired.board.edit_date"));
+	
+	wi_p7_message_set_number_for_name(broadcast, replies, WI_STR("wired.board.replies"));
+	
+	if(latestreply != wi_null())
+		wi_p7_message_set_uuid_for_name(broadcast, wi_uuid_with_string(latestreply), WI_STR("wired.board.latest_reply"));
+	
+	if(latestreplydate != wi_null())
+		wi_p7_message_set_date_for_name(broadcast, wi_date_with_sqlite3_string(latestreplydate), WI_STR("wired.board.latest_reply_date"));
+	
 	wi_dictionary_rdlock(wd_users);
 
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((user = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_is_subscribed_boards(user)) {
-			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(user))) {
-				broadcast = wi_p7_message_with_name(WI_STR("wired.board.thread_changed"), wd_p7_spec);
-				wi_p7_message_set_uuid_for_name(broadcast, thread, WI_STR("wired.board.thread"));
-				wi_p7_message_set_string_for_name(broadcast, subject, WI_STR("wired.board.subject"));
-
-				if(editdate != wi_null())
-					wi_p7_message_set_date_for_name(broadcast, wi_date_with_sqlite3_string(editdate), WI_STR("wired.board.edit_date"));
-				
-				wi_p7_message_set_number_for_name(broadcast, replies, WI_STR("wired.board.replies"));
-				
-				if(latestreply != wi_null())
-					wi_p7_message_set_uuid_for_name(broadcast, wi_uuid_with_string(latestreply), WI_STR("wired.board.latest_reply"));
-				
-				if(latestreplydate != wi_null())
-					wi_p7_message_set_date_for_name(broadcast, wi_date_with_sqlite3_string(latestreplydate), WI_STR("wired.board.latest_reply_date"));
-				
+		if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_session_id(user) == 0 && wd_user_is_subscribed_boards(user)) {
+			if(wd_board_privileges_is_readable_by_account(privileges, wd_user_account(user)))
 				wd_user_send_message(user, broadcast);
-			}
 		}
 	}
 	
@@ -1718,6 +1718,27 @@ static void wd_boards_changed_thread(wi_uuid_t *thread, wd_board_privileges_t *p
 
 
 
+static wi_p7_message_t * wd_boards_board_message(wi_p7_message_t *messages[2][2], wi_string_t *name, wi_string_t *board, wi_boolean_t readable, wi_boolean_t writable) {
+	wi_p7_message_t		*message;
+	
+	readable = readable ? 1 : 0;
+	writable = writable ? 1 : 0;
+	message = messages[readable][writable];
+	
+	if(!message) {
+		message = wi_p7_message_with_name(name, wd_p7_spec);
+		wi_p7_message_set_string_for_name(message, board, WI_STR("wired.board.board"));
+		wi_p7_message_set_bool_for_name(message, readable, WI_STR("wired.board.readable"));
+		wi_p7_message_set_bool_for_name(message, writable, WI_STR("wired.board.writable"));
+		
+		messages[readable][writable] = message;
+	}
+	
+	return message;
+}
+
+
+
 static wd_board_privileges_t * wd_boards_privileges_for_board(wi_string_t *board) {
 	wi_dictionary_t		*results;
 	
@@ -0,0 +1,430 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <wired/wired.h>
+
+#include "caches.h"
+#include "metrics.h"
+#include "settings.h"
+
+#define WD_CACHES_MAX_CANDIDATES		4096
+
+
+struct _wd_cache_entry {
+	wi_runtime_base_t					base;
+	
+	wi_string_t							*path;
+	wi_fs_stat_t						sb;
+	
+	wi_data_t							*data;
+	wi_data_t							*finderinfo;
+	
+	wi_uinteger_t						downloads;
+	
+	struct _wd_cache_entry				*previous, *next;
+};
+
+
+static wd_cache_entry_t *				wd_cache_entry_alloc(void);
+static wd_cache_entry_t *				wd_cache_entry_init_with_path(wd_cache_entry_t *, wi_string_t *, wi_fs_stat_t *);
+static void								wd_cache_entry_dealloc(wi_runtime_instance_t *);
+static wi_boolean_t						wd_cache_entry_matches(wd_cache_entry_t *, wi_fs_stat_t *);
+
+static void								wd_caches_remove_entry(wd_cache_entry_t *);
+static void								wd_caches_link_entry(wd_cache_entry_t *);
+static void								wd_caches_unlink_entry(wd_cache_entry_t *);
+static void								wd_caches_remove_candidates(void);
+static void								wd_caches_evict(wi_file_offset_t);
+static wi_data_t *						wd_caches_read_file(int, wi_file_offset_t);
+
+
+static wi_mutable_dictionary_t			*wd_caches_entries;
+static wd_cache_entry_t					*wd_caches_head, *wd_caches_tail;
+static wi_lock_t						*wd_caches_lock;
+
+static wi_file_offset_t					wd_caches_size, wd_caches_max_size, wd_caches_file_size;
+static wi_uinteger_t					wd_caches_files, wd_caches_candidates, wd_caches_threshold;
+
+static wi_runtime_id_t					wd_cache_entry_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_cache_entry_runtime_class = {
+	"wd_cache_entry_t",
+	wd_cache_entry_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+
+
+void wd_caches_initialize(void) {
+	wd_cache_entry_runtime_id = wi_runtime_register_class(&wd_cache_entry_runtime_class);
+
+	wd_caches_entries = wi_dictionary_init(wi_mutable_dictionary_alloc());
+	wd_caches_lock = wi_lock_init(wi_lock_alloc());
+}
+
+
+
+void wd_caches_apply_settings(wi_set_t *changes) {
+	wi_lock_lock(wd_caches_lock);
+	
+	wd_caches_max_size		= WI_MAX(0, wi_config_integer_for_name(wd_config, WI_STR("transfer cache size")));
+	wd_caches_file_size		= WI_MAX(0, wi_config_integer_for_name(wd_config, WI_STR("transfer cache file size")));
+	wd_caches_threshold		= WI_MAX(1, wi_config_integer_for_name(wd_config, WI_STR("transfer cache threshold")));
+	
+	wd_caches_evict(0);
+	
+	wi_lock_unlock(wd_caches_lock);
+}
+
+
+
+#pragma mark -
+
+wd_cache_entry_t * wd_caches_entry_for_path(wi_string_t *path, wi_fs_stat_t *sb) {
+	wd_cache_entry_t	*entry;
+	
+	wi_lock_lock(wd_caches_lock);
+	
+	if(wd_caches_max_size == 0) {
+		wi_lock_unlock(wd_caches_lock);
+		
+		return NULL;
+	}
+	
+	entry = wi_dictionary_data_for_key(wd_caches_entries, path);
+	
+	if(entry && entry->data) {
+		if(wd_cache_entry_matches(entry, sb)) {
+			wd_caches_unlink_entry(entry);
+			wd_caches_link_entry(entry);
+			
+			wi_retain(entry);
+		} else {
+			wd_caches_remove_entry(entry);
+			
+			wd_metrics_add(WD_METRIC_CACHE_INVALIDATIONS, 1);
+			
+			entry = NULL;
+		}
+	} else {
+		entry = NULL;
+	}
+	
+	wi_lock_unlock(wd_caches_lock);
+	
+	wd_metrics_add(entry ? WD_METRIC_CACHE_HITS : WD_METRIC_CACHE_MISSES, 1);
+
+	return wi_autorelease(entry);
+}
+
+
+
+wd_cache_entry_t * wd_caches_add_path(wi_string_t *path, wi_fs_stat_t *sb, int fd) {
+	wd_cache_entry_t	*entry;
+	wi_data_t			*data, *finderinfo;
+	wi_file_offset_t	length;
+	
+	wi_lock_lock(wd_caches_lock);
+	
+	length = WI_MIN(sb->size, wd_caches_file_size);
+	
+	if(length == 0 || length > wd_caches_max_size) {
+		wi_lock_unlock(wd_caches_lock);
+		
+		return NULL;
+	}
+	
+	entry = wi_dictionary_data_for_key(wd_caches_entries, path);
+	
+	if(entry && !wd_cache_entry_matches(entry, sb)) {
+		wd_caches_remove_entry(entry);
+		
+		entry = NULL;
+	}
+	
+	if(!entry) {
+		if(wd_caches_candidates >= WD_CACHES_MAX_CANDIDATES)
+			wd_caches_remove_candidates();
+		
+		entry = wd_cache_entry_init_with_path(wd_cache_entry_alloc(), path, sb);
+		wi_mutable_dictionary_set_data_for_key(wd_caches_entries, entry, path);
+		wi_release(entry);
+		
+		wd_caches_candidates++;
+	}
+	
+	if(entry->data || ++entry->downloads < wd_caches_threshold) {
+		wi_lock_unlock(wd_caches_lock);
+		
+		return NULL;
+	}
+	
+	wi_retain(entry);
+	
+	wi_lock_unlock(wd_caches_lock);
+	
+	/* Read outside the lock so that lookups for other files are not held up by the disk */
+	data = wd_caches_read_file(fd, length);
+	
+	if(!data) {
+		wi_log_error(WI_STR("Could not read \"%@\" into cache: %s"), path, strerror(errno));
+		wi_release(entry);
+		
+		return NULL;
+	}
+	
+	finderinfo = wi_fs_finder_info_for_path(path);
+	
+	wi_lock_lock(wd_caches_lock);
+	
+	if(!entry->data && wi_dictionary_data_for_key(wd_caches_entries, path) == entry) {
+		wd_caches_evict(length);
+		
+		entry->data			= wi_retain(data);
+		entry->finderinfo	= wi_retain(finderinfo ? finderinfo : wi_data());
+		
+		wd_caches_link_entry(entry);
+
+		wd_caches_size += length;
+		wd_caches_files++;
+		wd_caches_candidates--;
+		
+		wd_metrics_set(WD_METRIC_CACHE_FILES, wd_caches_files);
+		wd_metrics_set(WD_METRIC_CACHE_BYTES, wd_caches_size);
+	}
+	
+	if(!entry->data) {
+		wi_release(entry);
+		
+		entry = NULL;
+	}
+	
+	wi_lock_unlock(wd_caches_lock);
+	
+	return wi_autorelease(entry);
+}
+
+
+
+void wd_caches_remove_path(wi_string_t *path) {
+	wi_enumerator_t		*enumerator;
+	wi_string_t			*key, *prefix;
+	wd_cache_entry_t	*entry;
+	
+	prefix = wi_string_by_appending_string(path, WI_STR("/"));
+	
+	wi_lock_lock(wd_caches_lock);
+	
+	enumerator = wi_array_data_enumerator(wi_dictionary_all_keys(wd_caches_entries));
+	
+	while((key = wi_enumerator_next_data(enumerator))) {
+		if(wi_is_equal(key, path) || wi_string_has_prefix(key, prefix)) {
+			entry = wi_dictionary_data_for_key(wd_caches_entries, key);
+			
+			if(entry->data)
+				wd_metrics_add(WD_METRIC_CACHE_INVALIDATIONS, 1);
+			
+			wd_caches_remove_entry(entry);
+		}
+	}
+	
+	wi_lock_unlock(wd_caches_lock);
+}
+
+
+
+#pragma mark -
+
+static void wd_caches_remove_entry(wd_cache_entry_t *entry) {
+	if(entry->data) {
+		wd_caches_unlink_entry(entry);
+		
+		wd_caches_size -= wi_data_length(entry->data);
+		wd_caches_files--;
+		
+		wd_metrics_set(WD_METRIC_CACHE_FILES, wd_caches_files);
+		wd_metrics_set(WD_METRIC_CACHE_BYTES, wd_caches_size);
+	} else {
+		wd_caches_candidates--;
+	}
+	
+	wi_retain(entry);
+	wi_mutable_dictionary_remove_data_for_key(wd_caches_entries, entry->path);
+	wi_release(entry);
+}
+
+
+
+static void wd_caches_link_entry(wd_cache_entry_t *entry) {
+	entry->previous	= NULL;
+	entry->next		= wd_caches_head;
+	
+	if(wd_caches_head)
+		wd_caches_head->previous = entry;
+	else
+		wd_caches_tail = entry;
+	
+	wd_caches_head = entry;
+}
+
+
+
+static void wd_caches_unlink_entry(wd_cache_entry_t *entry) {
+	if(entry->previous)
+		entry->previous->next = entry->next;
+	else
+		wd_caches_head = entry->next;
+	
+	if(entry->next)
+		entry->next->previous = entry->previous;
+	else
+		wd_caches_tail = entry->previous;
+	
+	entry->previous	= NULL;
+	entry->next		= NULL;
+}
+
+
+
+static void wd_caches_remove_candidates(void) {
+	wi_enumerator_t		*enumerator;
+	wi_string_t			*key;
+	wd_cache_entry_t	*entry;
+	
+	enumerator = wi_array_data_enumerator(wi_dictionary_all_keys(wd_caches_entries));
+	
+	while((key = wi_enumerator_next_data(enumerator))) {
+		entry = wi_dictionary_data_for_key(wd_caches_entries, key);
+		
+		if(!entry->data)
+			wd_caches_remove_entry(entry);
+	}
+}
+
+
+
+static void wd_caches_evict(wi_file_offset_t length) {
+	/* Cached files are kept in use order, so the least recently used one is always at the tail */
+	while(wd_caches_tail && wd_caches_size + length > wd_caches_max_size) {
+		wd_caches_remove_entry(wd_caches_tail);
+		
+		wd_metrics_add(WD_METRIC_CACHE_EVICTIONS, 1);
+	}
+}
+
+
+
+static wi_data_t * wd_caches_read_file(int fd, wi_file_offset_t length) {
+	wi_data_t			*data;
+	char				*buffer;
+	wi_file_offset_t	offset;
+	ssize_t				bytes;
+	
+	buffer = wi_malloc(length);
+	offset = 0;
+	
+	while(offset < length) {
+		bytes = pread(fd, buffer + offset, length - offset, offset);
+		
+		if(bytes < 0 && errno == EINTR)
+			continue;
+		
+		if(bytes <= 0) {
+			if(bytes == 0)
+				errno = EIO;
+			
+			wi_free(buffer);
+			
+			return NULL;
+		}
+		
+		offset += bytes;
+	}
+	
+	data = wi_data_with_bytes(buffer, length);
+	
+	wi_free(buffer);
+	
+	return data;
+}
+
+
+
+#pragma mark -
+
+static wd_cache_entry_t * wd_cache_entry_alloc(void) {
+	return wi_runtime_create_instance(wd_cache_entry_runtime_id, sizeof(wd_cache_entry_t));
+}
+
+
+
+static wd_cache_entry_t * wd_cache_entry_init_with_path(wd_cache_entry_t *entry, wi_string_t *path, wi_fs_stat_t *sb) {
+	entry->path		= wi_copy(path);
+	entry->sb		= *sb;
+	
+	return entry;
+}
+
+
+
+static void wd_cache_entry_dealloc(wi_runtime_instance_t *instance) {
+	wd_cache_entry_t		*entry = instance;
+	
+	wi_release(entry->path);
+	wi_release(entry->data);
+	wi_release(entry->finderinfo);
+}
+
+
+
+static wi_boolean_t wd_cache_entry_matches(wd_cache_entry_t *entry, wi_fs_stat_t *sb) {
+	return (entry->sb.dev == sb->dev && entry->sb.ino == sb->ino &&
+			entry->sb.size == sb->size && entry->sb.mtime == sb->mtime);
+}
+
+
+
+#pragma mark -
+
+wi_data_t * wd_cache_entry_data(wd_cache_entry_t *entry) {
+	return entry->data;
+}
+
+
+
+wi_data_t * wd_cache_entry_finder_info(wd_cache_entry_t *entry) {
+	return entry->finderinfo;
+}
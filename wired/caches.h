@@ -0,0 +1,47 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WD_CACHES_H
+#define WD_CACHES_H 1
+
+#include <wired/wired.h>
+
+typedef struct _wd_cache_entry			wd_cache_entry_t;
+
+
+void									wd_caches_initialize(void);
+void									wd_caches_apply_settings(wi_set_t *);
+
+wd_cache_entry_t *						wd_caches_entry_for_path(wi_string_t *, wi_fs_stat_t *);
+wd_cache_entry_t *						wd_caches_add_path(wi_string_t *, wi_fs_stat_t *, int);
+void									wd_caches_remove_path(wi_string_t *);
+
+wi_data_t *								wd_cache_entry_data(wd_cache_entry_t *);
+wi_data_t *								wd_cache_entry_finder_info(wd_cache_entry_t *);
+
+#endif /* WD_CACHES_H */
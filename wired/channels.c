@@ -0,0 +1,223 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <wired/wired.h>
+
+#include "channels.h"
+#include "main.h"
+#include "users.h"
+
+#define WD_CHANNELS_TOKEN_TIMEOUT		30.0
+
+
+/*
+ * A channel is a separate connection that carries transfers on behalf of a
+ * logged in session. The session asks for a token, and the client presents
+ * it on a fresh connection in place of a login. Tokens are good for one
+ * join, only from the session's address, and only for a short while.
+ */
+
+struct _wd_channel_token {
+	wi_runtime_base_t					base;
+	
+	wd_uid_t							session_id;
+	wi_string_t							*ip;
+	wi_time_interval_t					expiration;
+};
+typedef struct _wd_channel_token		wd_channel_token_t;
+
+
+static void								wd_channels_remove_expired_tokens(wi_time_interval_t);
+
+static wd_channel_token_t *				wd_channel_token_alloc(void);
+static wd_channel_token_t *				wd_channel_token_init_with_user(wd_channel_token_t *, wd_user_t *);
+static void								wd_channel_token_dealloc(wi_runtime_instance_t *);
+
+
+static wi_mutable_dictionary_t			*wd_channels_tokens;
+
+static wi_runtime_id_t					wd_channel_token_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_channel_token_runtime_class = {
+	"wd_channel_token_t",
+	wd_channel_token_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+
+
+void wd_channels_initialize(void) {
+	wd_channel_token_runtime_id = wi_runtime_register_class(&wd_channel_token_runtime_class);
+	
+	wd_channels_tokens = wi_dictionary_init(wi_mutable_dictionary_alloc());
+}
+
+
+
+#pragma mark -
+
+wi_uuid_t * wd_channels_create_token(wd_user_t *user) {
+	wd_channel_token_t		*token;
+	wi_uuid_t				*uuid;
+	
+	uuid	= wi_uuid();
+	token	= wd_channel_token_init_with_user(wd_channel_token_alloc(), user);
+	
+	wi_dictionary_wrlock(wd_channels_tokens);
+	
+	wd_channels_remove_expired_tokens(wi_time_interval());
+	
+	wi_mutable_dictionary_set_data_for_key(wd_channels_tokens, token, wi_uuid_string(uuid));
+	
+	wi_dictionary_unlock(wd_channels_tokens);
+	
+	wi_release(token);
+	
+	return uuid;
+}
+
+
+
+wd_user_t * wd_channels_join_session(wd_user_t *user, wi_uuid_t *uuid) {
+	wd_channel_token_t		*token;
+	wd_user_t				*session;
+	wi_string_t				*key;
+	
+	key = wi_uuid_string(uuid);
+	
+	wi_dictionary_wrlock(wd_channels_tokens);
+	
+	token = wi_autorelease(wi_retain(wi_dictionary_data_for_key(wd_channels_tokens, key)));
+	
+	if(token)
+		wi_mutable_dictionary_remove_data_for_key(wd_channels_tokens, key);
+	
+	wi_dictionary_unlock(wd_channels_tokens);
+	
+	if(!token || token->expiration < wi_time_interval() || !wi_is_equal(token->ip, wd_user_ip(user)))
+		return NULL;
+	
+	session = wd_users_user_with_id(token->session_id);
+	
+	if(!session || wd_user_state(session) != WD_USER_LOGGED_IN)
+		return NULL;
+	
+	wd_user_set_session_id(user, token->session_id);
+	wd_user_set_login(user, wd_user_login(session));
+	wd_user_set_nick(user, wd_user_nick(session));
+	wd_user_set_account(user, wd_user_account(session));
+	wd_user_set_color(user, wd_user_color(session));
+	wd_user_set_state(user, WD_USER_LOGGED_IN);
+	
+	return session;
+}
+
+
+
+void wd_channels_remove_session(wd_user_t *session) {
+	wi_enumerator_t			*enumerator;
+	wi_string_t				*key;
+	wd_channel_token_t		*token;
+	wd_user_t				*user;
+	wd_uid_t				id;
+	
+	id = wd_user_id(session);
+	
+	wi_dictionary_wrlock(wd_channels_tokens);
+	
+	enumerator = wi_array_data_enumerator(wi_dictionary_all_keys(wd_channels_tokens));
+	
+	while((key = wi_enumerator_next_data(enumerator))) {
+		token = wi_dictionary_data_for_key(wd_channels_tokens, key);
+		
+		if(token->session_id == id)
+			wi_mutable_dictionary_remove_data_for_key(wd_channels_tokens, key);
+	}
+	
+	wi_dictionary_unlock(wd_channels_tokens);
+	
+	wi_dictionary_rdlock(wd_users);
+	
+	enumerator = wi_dictionary_data_enumerator(wd_users);
+	
+	while((user = wi_enumerator_next_data(enumerator))) {
+		if(wd_user_session_id(user) == id)
+			wd_user_set_state(user, WD_USER_DISCONNECTED);
+	}
+	
+	wi_dictionary_unlock(wd_users);
+}
+
+
+
+#pragma mark -
+
+static void wd_channels_remove_expired_tokens(wi_time_interval_t interval) {
+	wi_enumerator_t			*enumerator;
+	wi_string_t				*key;
+	wd_channel_token_t		*token;
+	
+	enumerator = wi_array_data_enumerator(wi_dictionary_all_keys(wd_channels_tokens));
+	
+	while((key = wi_enumerator_next_data(enumerator))) {
+		token = wi_dictionary_data_for_key(wd_channels_tokens, key);
+		
+		if(token->expiration < interval)
+			wi_mutable_dictionary_remove_data_for_key(wd_channels_tokens, key);
+	}
+}
+
+
+
+#pragma mark -
+
+static wd_channel_token_t * wd_channel_token_alloc(void) {
+	return wi_runtime_create_instance(wd_channel_token_runtime_id, sizeof(wd_channel_token_t));
+}
+
+
+
+static wd_channel_token_t * wd_channel_token_init_with_user(wd_channel_token_t *token, wd_user_t *user) {
+	token->session_id	= wd_user_id(user);
+	token->ip			= wi_retain(wd_user_ip(user));
+	token->expiration	= wi_time_interval() + WD_CHANNELS_TOKEN_TIMEOUT;
+	
+	return token;
+}
+
+
+
+static void wd_channel_token_dealloc(wi_runtime_instance_t *instance) {
+	wd_channel_token_t		*token = instance;
+	
+	wi_release(token->ip);
+}
@@ -229,7 +229,7 @@ void wd_events_add_event(wi_string_t *event, wd_user_t *user, ...) {
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((peer = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_is_subscribed_events(peer))
+		if(wd_user_state(peer) == WD_USER_LOGGED_IN && wd_user_session_id(peer) == 0 && wd_user_is_subscribed_events(peer))
 			wd_user_send_message(peer, message);
 	}
 	
@@ -33,8 +33,10 @@
 #include <wired/wired.h>
 
 #include "accounts.h"
+#include "caches.h"
 #include "events.h"
 #include "files.h"
+#include "hashes.h"
 #include "index.h"
 #include "main.h"
 #include "server.h"
@@ -577,6 +579,8 @@ wi_boolean_t wd_files_delete_path(wi_string_t *path, wd_user_t *user, wi_p7_mess
 	if(result) {
 		wd_files_remove_comment(path, NULL, NULL);
 		wd_files_remove_label(path, NULL, NULL);
+		wd_hashes_remove_path(realpath);
+		wd_caches_remove_path(realpath);
 	} else {
 		wi_log_error(WI_STR("Could not delete \"%@\": %m"), realpath);
 		wd_user_reply_file_errno(user, message);
@@ -646,6 +650,8 @@ wi_boolean_t wd_files_move_path(wi_string_t *frompath, wi_string_t *topath, wd_u
 	if(result) {
 		wd_files_move_comment(frompath, topath, user, message);
 		wd_files_move_label(frompath, topath, user, message);
+		wd_hashes_move_path(realfrompath, realtopath);
+		wd_caches_remove_path(realfrompath);
 		
 		wd_index_delete_file(realfrompath);
 		wd_index_add_file(realtopath);
@@ -692,6 +698,8 @@ static void wd_files_move_thread(wi_runtime_instance_t *argument) {
 	if(wi_fs_copy_path_with_callback(realfrompath, realtopath, wd_files_move_path_copy_callback)) {
 		wd_files_move_comment(frompath, topath, NULL, NULL);
 		wd_files_move_label(frompath, topath, NULL, NULL);
+		wd_hashes_move_path(realfrompath, realtopath);
+		wd_caches_remove_path(realfrompath);
 		
 		if(!wi_fs_delete_path_with_callback(realfrompath, wd_files_move_path_delete_callback))
 			wi_log_error(WI_STR("Could not delete \"%@\": %m"), realfrompath);
@@ -799,6 +807,8 @@ static void wd_files_fsevents_callback(wi_string_t *path) {
 	
 	wi_retain(path);
 	
+	wd_caches_remove_path(path);
+	
 	exists = (wi_fs_path_exists(path, &directory) && directory);
 	
 	wi_dictionary_rdlock(wd_users);
@@ -806,7 +816,7 @@ static void wd_files_fsevents_callback(wi_string_t *path) {
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((user = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(user) == WD_USER_LOGGED_IN && wi_set_contains_data(wd_user_subscribed_paths(user), path)) {
+		if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_session_id(user) == 0 && wi_set_contains_data(wd_user_subscribed_paths(user), path)) {
 			pathenumerator = wi_array_data_enumerator(wd_user_subscribed_virtual_paths_for_path(user, path));
 			
 			while((virtualpath = wi_enumerator_next_data(pathenumerator))) {
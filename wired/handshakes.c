@@ -0,0 +1,317 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <wired/wired.h>
+
+#include "handshakes.h"
+#include "main.h"
+#include "metrics.h"
+#include "server.h"
+#include "settings.h"
+
+#define WD_HANDSHAKES_TIMEOUT				30.0
+#define WD_HANDSHAKES_FIRST_BYTE_TIMEOUT	5.0
+
+
+struct _wd_handshake_source;
+
+struct _wd_handshake {
+	wi_socket_t							*socket;
+	wi_time_interval_t					time;
+	struct _wd_handshake_source			*source;
+	
+	struct _wd_handshake				*next;
+};
+typedef struct _wd_handshake			wd_handshake_t;
+
+
+struct _wd_handshake_source {
+	wi_string_t							*ip;
+	wi_uinteger_t						count, active;
+	
+	wd_handshake_t						*head, *tail;
+	struct _wd_handshake_source			*next;
+};
+typedef struct _wd_handshake_source		wd_handshake_source_t;
+
+
+static void								wd_handshakes_thread(wi_runtime_instance_t *);
+static wd_handshake_t *					wd_handshakes_next_handshake(void);
+static void								wd_handshakes_finish_handshake(wd_handshake_t *);
+static void								wd_handshakes_schedule_source(wd_handshake_source_t *);
+
+
+static wi_condition_lock_t				*wd_handshakes_lock;
+static wi_mutable_dictionary_t			*wd_handshakes_sources;
+static wd_handshake_source_t			*wd_handshakes_head, *wd_handshakes_tail;
+static wi_uinteger_t					wd_handshakes_queued;
+static wi_uinteger_t					wd_handshakes_threads, wd_handshakes_max_threads;
+static wi_uinteger_t					wd_handshakes_max_queued, wd_handshakes_max_queued_per_ip;
+
+
+
+void wd_handshakes_initialize(void) {
+	wd_handshakes_lock = wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
+	
+	wd_handshakes_sources = wi_dictionary_init_with_capacity_and_callbacks(wi_mutable_dictionary_alloc(),
+		0, wi_dictionary_default_key_callbacks, wi_dictionary_null_value_callbacks);
+}
+
+
+
+void wd_handshakes_apply_settings(wi_set_t *changes) {
+	wi_integer_t	threads, depth, depth_per_ip;
+	
+	threads			= wi_config_integer_for_name(wd_config, WI_STR("handshake threads"));
+	depth			= wi_config_integer_for_name(wd_config, WI_STR("handshake queue depth"));
+	depth_per_ip	= wi_config_integer_for_name(wd_config, WI_STR("handshake queue depth per address"));
+	
+	wi_condition_lock_lock(wd_handshakes_lock);
+	
+	wd_handshakes_max_threads			= WI_MAX(1, threads);
+	wd_handshakes_max_queued			= WI_MAX(1, depth);
+	wd_handshakes_max_queued_per_ip		= WI_MAX(1, depth_per_ip);
+	
+	wi_condition_lock_unlock_with_condition(wd_handshakes_lock, wd_handshakes_head ? 1 : 0);
+}
+
+
+
+void wd_handshakes_schedule(void) {
+	wi_uinteger_t	threads;
+	
+	wi_condition_lock_lock(wd_handshakes_lock);
+	
+	threads = wd_handshakes_threads;
+	
+	while(wd_handshakes_threads < wd_handshakes_max_threads) {
+		if(!wi_thread_create_thread(wd_handshakes_thread, NULL)) {
+			wi_log_error(WI_STR("Could not create a handshake thread: %m"));
+			
+			break;
+		}
+		
+		wd_handshakes_threads++;
+	}
+	
+	wi_condition_lock_unlock_with_condition(wd_handshakes_lock, wd_handshakes_head ? 1 : 0);
+	
+	if(wd_handshakes_threads == 0)
+		wi_log_fatal(WI_STR("Could not create any handshake threads"));
+	
+	if(wd_handshakes_threads != threads)
+		wi_log_info(WI_STR("Running %u handshake threads"), wd_handshakes_threads);
+}
+
+
+
+#pragma mark -
+
+wi_boolean_t wd_handshakes_add_socket(wi_socket_t *socket) {
+	wd_handshake_source_t	*source;
+	wd_handshake_t			*handshake;
+	wi_string_t				*ip;
+	
+	ip = wi_address_string(wi_socket_address(socket));
+	
+	wi_condition_lock_lock(wd_handshakes_lock);
+	
+	source = wi_dictionary_data_for_key(wd_handshakes_sources, ip);
+	
+	if(wd_handshakes_queued >= wd_handshakes_max_queued ||
+	   (source && source->count + source->active >= wd_handshakes_max_queued_per_ip)) {
+		wi_condition_lock_unlock_with_condition(wd_handshakes_lock, wd_handshakes_head ? 1 : 0);
+		
+		wd_metrics_add(WD_METRIC_CONNECTIONS_REJECTED, 1);
+		
+		return false;
+	}
+	
+	if(!source) {
+		source		= wi_malloc(sizeof(wd_handshake_source_t));
+		source->ip	= wi_retain(ip);
+		
+		wi_mutable_dictionary_set_data_for_key(wd_handshakes_sources, source, ip);
+	}
+	
+	if(source->count == 0)
+		wd_handshakes_schedule_source(source);
+	
+	handshake			= wi_malloc(sizeof(wd_handshake_t));
+	handshake->socket	= wi_retain(socket);
+	handshake->time		= wi_time_interval();
+	handshake->source	= source;
+	
+	if(source->tail)
+		source->tail->next = handshake;
+	else
+		source->head = handshake;
+	
+	source->tail = handshake;
+	source->count++;
+	
+	wd_handshakes_queued++;
+	
+	wi_condition_lock_unlock_with_condition(wd_handshakes_lock, 1);
+	
+	wd_metrics_add(WD_METRIC_CONNECTIONS_QUEUED, 1);
+	
+	return true;
+}
+
+
+
+#pragma mark -
+
+static void wd_handshakes_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t				*pool;
+	wd_handshake_t			*handshake;
+	wi_socket_state_t		state;
+	wi_time_interval_t		wait;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	while(true) {
+		wi_condition_lock_lock_when_condition(wd_handshakes_lock, 1, 0.0);
+		
+		if(wd_handshakes_threads > wd_handshakes_max_threads) {
+			wd_handshakes_threads--;
+			
+			wi_condition_lock_unlock_with_condition(wd_handshakes_lock, wd_handshakes_head ? 1 : 0);
+			
+			break;
+		}
+		
+		handshake = wd_handshakes_next_handshake();
+		
+		wi_condition_lock_unlock_with_condition(wd_handshakes_lock, wd_handshakes_head ? 1 : 0);
+		
+		wd_metrics_add(WD_METRIC_CONNECTIONS_QUEUED, -1);
+		
+		wait = wi_time_interval() - handshake->time;
+		
+		if(wait < WD_HANDSHAKES_TIMEOUT) {
+			wd_metrics_add(WD_METRIC_CONNECTIONS_HANDSHAKING, 1);
+			
+			state = wi_socket_wait_descriptor(wi_socket_descriptor(handshake->socket),
+				WD_HANDSHAKES_FIRST_BYTE_TIMEOUT, true, false);
+			
+			if(state == WI_SOCKET_READY) {
+				wd_server_accept_socket(handshake->socket);
+			} else {
+				wi_log_info(WI_STR("Dropped connection from %@ after %.0f seconds without a handshake"),
+					wi_address_string(wi_socket_address(handshake->socket)), WD_HANDSHAKES_FIRST_BYTE_TIMEOUT);
+				
+				wi_socket_close(handshake->socket);
+				
+				wd_metrics_add(WD_METRIC_CONNECTIONS_EXPIRED, 1);
+			}
+			
+			wd_metrics_add(WD_METRIC_CONNECTIONS_HANDSHAKING, -1);
+		} else {
+			wi_log_info(WI_STR("Dropped connection from %@ after %.0f seconds in the handshake queue"),
+				wi_address_string(wi_socket_address(handshake->socket)), wait);
+			
+			wi_socket_close(handshake->socket);
+			
+			wd_metrics_add(WD_METRIC_CONNECTIONS_EXPIRED, 1);
+		}
+		
+		wd_handshakes_finish_handshake(handshake);
+		
+		wi_pool_drain(pool);
+	}
+	
+	wi_release(pool);
+}
+
+
+
+static wd_handshake_t * wd_handshakes_next_handshake(void) {
+	wd_handshake_source_t	*source;
+	wd_handshake_t			*handshake;
+	
+	source = wd_handshakes_head;
+	wd_handshakes_head = source->next;
+	
+	if(!wd_handshakes_head)
+		wd_handshakes_tail = NULL;
+	
+	handshake = source->head;
+	source->head = handshake->next;
+	
+	if(!source->head)
+		source->tail = NULL;
+	
+	source->count--;
+	source->active++;
+	wd_handshakes_queued--;
+	
+	if(source->count > 0)
+		wd_handshakes_schedule_source(source);
+	
+	return handshake;
+}
+
+
+
+static void wd_handshakes_finish_handshake(wd_handshake_t *handshake) {
+	wd_handshake_source_t	*source;
+	
+	wi_condition_lock_lock(wd_handshakes_lock);
+	
+	source = handshake->source;
+	source->active--;
+	
+	if(source->count == 0 && source->active == 0) {
+		wi_mutable_dictionary_remove_data_for_key(wd_handshakes_sources, source->ip);
+		
+		wi_release(source->ip);
+		wi_free(source);
+	}
+	
+	wi_condition_lock_unlock_with_condition(wd_handshakes_lock, wd_handshakes_head ? 1 : 0);
+	
+	wi_release(handshake->socket);
+	wi_free(handshake);
+}
+
+
+
+static void wd_handshakes_schedule_source(wd_handshake_source_t *source) {
+	source->next = NULL;
+	
+	if(wd_handshakes_tail)
+		wd_handshakes_tail->next = source;
+	else
+		wd_handshakes_head = source;
+	
+	wd_handshakes_tail = source;
+}
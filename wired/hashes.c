@@ -0,0 +1,612 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <wired/wired.h>
+
+#include "hashes.h"
+
+#define WD_HASHES_META_PATH				".wired"
+#define WD_HASHES_META_HASHES_PATH		".wired/hashes"
+
+#define WD_HASHES_MAGIC					"WDH1"
+#define WD_HASHES_HEADER_SIZE			24
+#define WD_HASHES_READ_SIZE				262144
+
+#define WD_HASHES_PRIME1				11400714785074694791ULL
+#define WD_HASHES_PRIME2				14029467366897019727ULL
+#define WD_HASHES_PRIME3				1609587929392839161ULL
+#define WD_HASHES_PRIME4				9650029242287828579ULL
+#define WD_HASHES_PRIME5				2870177450012600261ULL
+
+#define WD_HASHES_ROTATE(x, r)			(((x) << (r)) | ((x) >> (64 - (r))))
+
+
+struct _wd_hash_state {
+	uint64_t							v[4];
+	uint64_t							length;
+	unsigned char						memory[32];
+	uint32_t							size;
+};
+typedef struct _wd_hash_state			wd_hash_state_t;
+
+
+struct _wd_hashlist {
+	wi_runtime_base_t					base;
+	
+	uint64_t							*hashes;
+	wi_uinteger_t						count, capacity;
+	wi_file_offset_t					length;
+	
+	wd_hash_state_t						state;
+	uint64_t							tail;
+	wi_boolean_t						stored;
+};
+
+
+static void								wd_hashlist_dealloc(wi_runtime_instance_t *);
+
+static void								wd_hashlist_append(wd_hashlist_t *, uint64_t);
+static uint64_t							wd_hashlist_tail(wd_hashlist_t *);
+
+static wi_string_t *					wd_hashes_path_for_path(wi_string_t *);
+static wi_boolean_t						wd_hashes_create_directory(wi_string_t *);
+
+static void								wd_hash_reset(wd_hash_state_t *);
+static void								wd_hash_update(wd_hash_state_t *, const unsigned char *, size_t);
+static uint64_t							wd_hash_digest(const wd_hash_state_t *);
+static uint64_t							wd_hash_round(uint64_t, uint64_t);
+static uint64_t							wd_hash_merge(uint64_t, uint64_t);
+static uint64_t							wd_hash_read64(const unsigned char *);
+static uint32_t							wd_hash_read32(const unsigned char *);
+static void								wd_hash_write_be64(unsigned char *, uint64_t);
+static uint64_t							wd_hash_read_be64(const unsigned char *);
+
+
+static wi_runtime_id_t					wd_hashlist_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_hashlist_runtime_class = {
+	"wd_hashlist_t",
+	wd_hashlist_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+
+
+void wd_hashes_initialize(void) {
+	wd_hashlist_runtime_id = wi_runtime_register_class(&wd_hashlist_runtime_class);
+}
+
+
+
+#pragma mark -
+
+void wd_hashes_move_path(wi_string_t *frompath, wi_string_t *topath) {
+	wi_string_t		*hashesfrompath, *hashestopath;
+	wi_fs_stat_t	sb;
+	
+	hashesfrompath = wd_hashes_path_for_path(frompath);
+	
+	if(!wi_fs_stat_path(hashesfrompath, &sb))
+		return;
+	
+	hashestopath = wd_hashes_path_for_path(topath);
+
+	if(!wd_hashes_create_directory(topath) || !wi_fs_rename_path(hashesfrompath, hashestopath))
+		wi_fs_delete_path(hashesfrompath);
+}
+
+
+
+void wd_hashes_remove_path(wi_string_t *path) {
+	wi_string_t		*hashespath;
+	wi_fs_stat_t	sb;
+	
+	hashespath = wd_hashes_path_for_path(path);
+	
+	if(wi_fs_stat_path(hashespath, &sb)) {
+		if(!wi_fs_delete_path(hashespath))
+			wi_log_error(WI_STR("Could not delete \"%@\": %m"), hashespath);
+	}
+}
+
+
+
+#pragma mark -
+
+static wi_string_t * wd_hashes_path_for_path(wi_string_t *path) {
+	wi_string_t		*dirpath;
+	
+	dirpath = wi_string_by_deleting_last_path_component(path);
+	dirpath = wi_string_by_appending_path_component(dirpath, WI_STR(WD_HASHES_META_HASHES_PATH));
+	
+	return wi_string_by_appending_path_component(dirpath, wi_string_last_path_component(path));
+}
+
+
+
+static wi_boolean_t wd_hashes_create_directory(wi_string_t *path) {
+	wi_string_t		*dirpath, *metapath, *hashespath;
+	
+	dirpath		= wi_string_by_deleting_last_path_component(path);
+	metapath	= wi_string_by_appending_path_component(dirpath, WI_STR(WD_HASHES_META_PATH));
+	hashespath	= wi_string_by_appending_path_component(dirpath, WI_STR(WD_HASHES_META_HASHES_PATH));
+	
+	if(!wi_fs_create_directory(metapath, 0777) && wi_error_code() != EEXIST)
+		return false;
+	
+	if(!wi_fs_create_directory(hashespath, 0777) && wi_error_code() != EEXIST)
+		return false;
+	
+	return true;
+}
+
+
+
+#pragma mark -
+
+wd_hashlist_t * wd_hashlist_alloc(void) {
+	return wi_runtime_create_instance(wd_hashlist_runtime_id, sizeof(wd_hashlist_t));
+}
+
+
+
+wd_hashlist_t * wd_hashlist_init(wd_hashlist_t *hashlist) {
+	wd_hash_reset(&hashlist->state);
+	
+	return hashlist;
+}
+
+
+
+wd_hashlist_t * wd_hashlist_init_with_path(wd_hashlist_t *hashlist, wi_string_t *path, wi_file_offset_t length) {
+	wi_data_t				*data;
+	const unsigned char		*bytes;
+	wi_fs_stat_t			sb;
+	wi_file_offset_t		storedlength;
+	uint64_t				mtime;
+	wi_uinteger_t			i, count, blocks;
+	
+	hashlist = wd_hashlist_init(hashlist);
+	data = wi_data_with_contents_of_file(wd_hashes_path_for_path(path));
+	
+	if(!data || wi_data_length(data) < WD_HASHES_HEADER_SIZE)
+		return hashlist;
+	
+	bytes = wi_data_bytes(data);
+	
+	if(memcmp(bytes, WD_HASHES_MAGIC, 4) != 0 || wd_hash_read32(bytes + 4) != WD_HASHES_BLOCK_SIZE)
+		return hashlist;
+	
+	storedlength	= wd_hash_read_be64(bytes + 8);
+	mtime			= wd_hash_read_be64(bytes + 16);
+	count			= (wi_data_length(data) - WD_HASHES_HEADER_SIZE) / 8;
+	
+	if(mtime != 0) {
+		/* Hashes of a completed file are only good for as long as the file is unchanged */
+		if(!wi_fs_stat_path(path, &sb) || sb.size != storedlength || (uint64_t) sb.mtime != mtime)
+			return hashlist;
+		
+		blocks = storedlength / WD_HASHES_BLOCK_SIZE;
+		
+		if(count != blocks + ((storedlength % WD_HASHES_BLOCK_SIZE) ? 1 : 0))
+			return hashlist;
+		
+		if(length < storedlength) {
+			blocks = length / WD_HASHES_BLOCK_SIZE;
+		} else {
+			hashlist->stored = (storedlength % WD_HASHES_BLOCK_SIZE) != 0;
+			
+			if(hashlist->stored)
+				hashlist->tail = wd_hash_read_be64(bytes + WD_HASHES_HEADER_SIZE + (blocks * 8));
+		}
+	} else {
+		blocks = WI_MIN(count, WI_MIN(storedlength, length) / WD_HASHES_BLOCK_SIZE);
+	}
+	
+	for(i = 0; i < blocks; i++)
+		wd_hashlist_append(hashlist, wd_hash_read_be64(bytes + WD_HASHES_HEADER_SIZE + (i * 8)));
+	
+	hashlist->length = hashlist->stored ? storedlength : (wi_file_offset_t) blocks * WD_HASHES_BLOCK_SIZE;
+	
+	return hashlist;
+}
+
+
+
+static void wd_hashlist_dealloc(wi_runtime_instance_t *instance) {
+	wd_hashlist_t		*hashlist = instance;
+	
+	wi_free(hashlist->hashes);
+}
+
+
+
+#pragma mark -
+
+void wd_hashlist_update(wd_hashlist_t *hashlist, const void *buffer, size_t length) {
+	const unsigned char		*bytes = buffer;
+	size_t					size;
+	
+	while(length > 0) {
+		size = WI_MIN(length, WD_HASHES_BLOCK_SIZE - (hashlist->length % WD_HASHES_BLOCK_SIZE));
+		
+		wd_hash_update(&hashlist->state, bytes, size);
+		
+		hashlist->length	+= size;
+		bytes				+= size;
+		length				-= size;
+		
+		if(hashlist->length % WD_HASHES_BLOCK_SIZE == 0) {
+			wd_hashlist_append(hashlist, wd_hash_digest(&hashlist->state));
+			wd_hash_reset(&hashlist->state);
+		}
+	}
+}
+
+
+
+wi_boolean_t wd_hashlist_update_with_file(wd_hashlist_t *hashlist, int fd, wi_file_offset_t length) {
+	char		*buffer;
+	ssize_t		bytes;
+	
+	if(hashlist->stored)
+		return (hashlist->length >= length);
+	
+	buffer = wi_malloc(WD_HASHES_READ_SIZE);
+	
+	while(hashlist->length < length) {
+		bytes = pread(fd, buffer, WI_MIN(WD_HASHES_READ_SIZE, length - hashlist->length), hashlist->length);
+		
+		if(bytes <= 0) {
+			if(bytes < 0 && errno == EINTR)
+				continue;
+			
+			break;
+		}
+		
+		wd_hashlist_update(hashlist, buffer, bytes);
+	}
+	
+	wi_free(buffer);
+	
+	return (hashlist->length == length);
+}
+
+
+
+void wd_hashlist_truncate(wd_hashlist_t *hashlist, wi_file_offset_t length) {
+	if(length >= hashlist->length)
+		return;
+	
+	hashlist->count		= length / WD_HASHES_BLOCK_SIZE;
+	hashlist->length	= (wi_file_offset_t) hashlist->count * WD_HASHES_BLOCK_SIZE;
+	hashlist->stored	= false;
+	
+	wd_hash_reset(&hashlist->state);
+}
+
+
+
+wi_file_offset_t wd_hashlist_matching_length(wd_hashlist_t *hashlist, wi_data_t *data) {
+	const unsigned char		*bytes;
+	wi_uinteger_t			i, count;
+	
+	bytes	= wi_data_bytes(data);
+	count	= WI_MIN(hashlist->count, wi_data_length(data) / 8);
+	
+	for(i = 0; i < count; i++) {
+		if(wd_hash_read_be64(bytes + (i * 8)) != hashlist->hashes[i])
+			break;
+	}
+	
+	return (wi_file_offset_t) i * WD_HASHES_BLOCK_SIZE;
+}
+
+
+
+wi_boolean_t wd_hashlist_is_equal(wd_hashlist_t *hashlist, wd_hashlist_t *otherhashlist) {
+	if(hashlist->length != otherhashlist->length || hashlist->count != otherhashlist->count)
+		return false;
+	
+	if(memcmp(hashlist->hashes, otherhashlist->hashes, hashlist->count * sizeof(uint64_t)) != 0)
+		return false;
+	
+	if(hashlist->length % WD_HASHES_BLOCK_SIZE != 0)
+		return (wd_hashlist_tail(hashlist) == wd_hashlist_tail(otherhashlist));
+	
+	return true;
+}
+
+
+
+wi_boolean_t wd_hashlist_write_to_path(wd_hashlist_t *hashlist, wi_string_t *path, wi_boolean_t complete) {
+	wi_data_t			*data;
+	unsigned char		*bytes;
+	wi_fs_stat_t		sb;
+	wi_file_offset_t	length;
+	wi_uinteger_t		i, count;
+	
+	if(complete) {
+		if(!wi_fs_stat_path(path, &sb) || sb.size != hashlist->length)
+			return false;
+		
+		length	= hashlist->length;
+		count	= hashlist->count + ((length % WD_HASHES_BLOCK_SIZE) ? 1 : 0);
+	} else {
+		sb.mtime	= 0;
+		count		= hashlist->count;
+		length		= (wi_file_offset_t) count * WD_HASHES_BLOCK_SIZE;
+	}
+	
+	if(!wd_hashes_create_directory(path))
+		return false;
+	
+	bytes = wi_malloc(WD_HASHES_HEADER_SIZE + (count * 8));
+	
+	memcpy(bytes, WD_HASHES_MAGIC, 4);
+	bytes[4] = WD_HASHES_BLOCK_SIZE & 0xFF;
+	bytes[5] = (WD_HASHES_BLOCK_SIZE >> 8) & 0xFF;
+	bytes[6] = (WD_HASHES_BLOCK_SIZE >> 16) & 0xFF;
+	bytes[7] = (WD_HASHES_BLOCK_SIZE >> 24) & 0xFF;
+	wd_hash_write_be64(bytes + 8, length);
+	wd_hash_write_be64(bytes + 16, (uint64_t) sb.mtime);
+	
+	for(i = 0; i < hashlist->count && i < count; i++)
+		wd_hash_write_be64(bytes + WD_HASHES_HEADER_SIZE + (i * 8), hashlist->hashes[i]);
+	
+	if(count > hashlist->count)
+		wd_hash_write_be64(bytes + WD_HASHES_HEADER_SIZE + (hashlist->count * 8), wd_hashlist_tail(hashlist));
+	
+	data = wi_data_with_bytes(bytes, WD_HASHES_HEADER_SIZE + (count * 8));
+	
+	wi_free(bytes);
+	
+	return wi_data_write_to_file(data, wd_hashes_path_for_path(path));
+}
+
+
+
+#pragma mark -
+
+wi_file_offset_t wd_hashlist_length(wd_hashlist_t *hashlist) {
+	return hashlist->length;
+}
+
+
+
+wi_data_t * wd_hashlist_data(wd_hashlist_t *hashlist) {
+	wi_data_t			*data;
+	unsigned char		*bytes;
+	wi_uinteger_t		i;
+	
+	if(hashlist->count == 0)
+		return wi_data();
+	
+	bytes = wi_malloc(hashlist->count * 8);
+	
+	for(i = 0; i < hashlist->count; i++)
+		wd_hash_write_be64(bytes + (i * 8), hashlist->hashes[i]);
+	
+	data = wi_data_with_bytes(bytes, hashlist->count * 8);
+	
+	wi_free(bytes);
+	
+	return data;
+}
+
+
+
+#pragma mark -
+
+static void wd_hashlist_append(wd_hashlist_t *hashlist, uint64_t hash) {
+	if(hashlist->count == hashlist->capacity) {
+		hashlist->capacity	= WI_MAX(64, hashlist->capacity * 2);
+		hashlist->hashes	= wi_realloc(hashlist->hashes, hashlist->capacity * sizeof(uint64_t));
+	}
+	
+	hashlist->hashes[hashlist->count++] = hash;
+}
+
+
+
+static uint64_t wd_hashlist_tail(wd_hashlist_t *hashlist) {
+	if(hashlist->stored)
+		return hashlist->tail;
+	
+	return wd_hash_digest(&hashlist->state);
+}
+
+
+
+#pragma mark -
+
+static void wd_hash_reset(wd_hash_state_t *state) {
+	memset(state, 0, sizeof(*state));
+	
+	state->v[0] = WD_HASHES_PRIME1 + WD_HASHES_PRIME2;
+	state->v[1] = WD_HASHES_PRIME2;
+	state->v[2] = 0;
+	state->v[3] = 0 - WD_HASHES_PRIME1;
+}
+
+
+
+static void wd_hash_update(wd_hash_state_t *state, const unsigned char *bytes, size_t length) {
+	const unsigned char		*end;
+	size_t					size;
+	
+	end = bytes + length;
+	state->length += length;
+	
+	if(state->size + length < 32) {
+		memcpy(state->memory + state->size, bytes, length);
+		state->size += length;
+		
+		return;
+	}
+	
+	if(state->size > 0) {
+		size = 32 - state->size;
+		
+		memcpy(state->memory + state->size, bytes, size);
+		
+		state->v[0] = wd_hash_round(state->v[0], wd_hash_read64(state->memory));
+		state->v[1] = wd_hash_round(state->v[1], wd_hash_read64(state->memory + 8));
+		state->v[2] = wd_hash_round(state->v[2], wd_hash_read64(state->memory + 16));
+		state->v[3] = wd_hash_round(state->v[3], wd_hash_read64(state->memory + 24));
+		
+		bytes		+= size;
+		state->size	= 0;
+	}
+	
+	while(bytes + 32 <= end) {
+		state->v[0] = wd_hash_round(state->v[0], wd_hash_read64(bytes));
+		state->v[1] = wd_hash_round(state->v[1], wd_hash_read64(bytes + 8));
+		state->v[2] = wd_hash_round(state->v[2], wd_hash_read64(bytes + 16));
+		state->v[3] = wd_hash_round(state->v[3], wd_hash_read64(bytes + 24));
+		
+		bytes += 32;
+	}
+	
+	if(bytes < end) {
+		memcpy(state->memory, bytes, end - bytes);
+		state->size = end - bytes;
+	}
+}
+
+
+
+static uint64_t wd_hash_digest(const wd_hash_state_t *state) {
+	const unsigned char		*bytes, *end;
+	uint64_t				hash;
+	
+	if(state->length >= 32) {
+		hash = WD_HASHES_ROTATE(state->v[0], 1) + WD_HASHES_ROTATE(state->v[1], 7) +
+			   WD_HASHES_ROTATE(state->v[2], 12) + WD_HASHES_ROTATE(state->v[3], 18);
+		hash = wd_hash_merge(hash, state->v[0]);
+		hash = wd_hash_merge(hash, state->v[1]);
+		hash = wd_hash_merge(hash, state->v[2]);
+		hash = wd_hash_merge(hash, state->v[3]);
+	} else {
+		hash = state->v[2] + WD_HASHES_PRIME5;
+	}
+	
+	hash	+= state->length;
+	bytes	= state->memory;
+	end		= state->memory + state->size;
+	
+	while(bytes + 8 <= end) {
+		hash ^= wd_hash_round(0, wd_hash_read64(bytes));
+		hash = (WD_HASHES_ROTATE(hash, 27) * WD_HASHES_PRIME1) + WD_HASHES_PRIME4;
+		bytes += 8;
+	}
+	
+	if(bytes + 4 <= end) {
+		hash ^= (uint64_t) wd_hash_read32(bytes) * WD_HASHES_PRIME1;
+		hash = (WD_HASHES_ROTATE(hash, 23) * WD_HASHES_PRIME2) + WD_HASHES_PRIME3;
+		bytes += 4;
+	}
+	
+	while(bytes < end) {
+		hash ^= (*bytes) * WD_HASHES_PRIME5;
+		hash = WD_HASHES_ROTATE(hash, 11) * WD_HASHES_PRIME1;
+		bytes++;
+	}
+	
+	hash ^= hash >> 33;
+	hash *= WD_HASHES_PRIME2;
+	hash ^= hash >> 29;
+	hash *= WD_HASHES_PRIME3;
+	hash ^= hash >> 32;
+	
+	return hash;
+}
+
+
+
+static uint64_t wd_hash_round(uint64_t accumulator, uint64_t input) {
+	accumulator += input * WD_HASHES_PRIME2;
+	accumulator = WD_HASHES_ROTATE(accumulator, 31);
+	accumulator *= WD_HASHES_PRIME1;
+	
+	return accumulator;
+}
+
+
+
+static uint64_t wd_hash_merge(uint64_t accumulator, uint64_t value) {
+	accumulator ^= wd_hash_round(0, value);
+	accumulator = (accumulator * WD_HASHES_PRIME1) + WD_HASHES_PRIME4;
+	
+	return accumulator;
+}
+
+
+
+static uint64_t wd_hash_read64(const unsigned char *bytes) {
+	return ((uint64_t) bytes[0])		| ((uint64_t) bytes[1] << 8)  |
+		   ((uint64_t) bytes[2] << 16)	| ((uint64_t) bytes[3] << 24) |
+		   ((uint64_t) bytes[4] << 32)	| ((uint64_t) bytes[5] << 40) |
+		   ((uint64_t) bytes[6] << 48)	| ((uint64_t) bytes[7] << 56);
+}
+
+
+
+static uint32_t wd_hash_read32(const unsigned char *bytes) {
+	return ((uint32_t) bytes[0])		| ((uint32_t) bytes[1] << 8) |
+		   ((uint32_t) bytes[2] << 16)	| ((uint32_t) bytes[3] << 24);
+}
+
+
+
+static void wd_hash_write_be64(unsigned char *bytes, uint64_t value) {
+	wi_uinteger_t		i;
+	
+	for(i = 0; i < 8; i++)
+		bytes[i] = (value >> (56 - (i * 8))) & 0xFF;
+}
+
+
+
+static uint64_t wd_hash_read_be64(const unsigned char *bytes) {
+	uint64_t			value;
+	wi_uinteger_t		i;
+	
+	for(value = 0, i = 0; i < 8; i++)
+		value = (value << 8) | bytes[i];
+	
+	return value;
+}
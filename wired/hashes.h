@@ -0,0 +1,59 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WD_HASHES_H
+#define WD_HASHES_H 1
+
+#include <wired/wired.h>
+
+#define WD_HASHES_BLOCK_SIZE			1048576
+
+
+typedef struct _wd_hashlist				wd_hashlist_t;
+
+
+void									wd_hashes_initialize(void);
+
+void									wd_hashes_move_path(wi_string_t *, wi_string_t *);
+void									wd_hashes_remove_path(wi_string_t *);
+
+wd_hashlist_t *							wd_hashlist_alloc(void);
+wd_hashlist_t *							wd_hashlist_init(wd_hashlist_t *);
+wd_hashlist_t *							wd_hashlist_init_with_path(wd_hashlist_t *, wi_string_t *, wi_file_offset_t);
+
+void									wd_hashlist_update(wd_hashlist_t *, const void *, size_t);
+wi_boolean_t							wd_hashlist_update_with_file(wd_hashlist_t *, int, wi_file_offset_t);
+void									wd_hashlist_truncate(wd_hashlist_t *, wi_file_offset_t);
+wi_file_offset_t						wd_hashlist_matching_length(wd_hashlist_t *, wi_data_t *);
+wi_boolean_t							wd_hashlist_is_equal(wd_hashlist_t *, wd_hashlist_t *);
+wi_boolean_t							wd_hashlist_write_to_path(wd_hashlist_t *, wi_string_t *, wi_boolean_t);
+
+wi_file_offset_t						wd_hashlist_length(wd_hashlist_t *);
+wi_data_t *								wd_hashlist_data(wd_hashlist_t *);
+
+#endif /* WD_HASHES_H */
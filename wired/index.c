@@ -46,6 +46,7 @@ static void										wd_index_create_tables(void);
 static void										wd_index_update_index(wi_timer_t *);
 static void										wd_index_thread(wi_runtime_instance_t *);
 static void										wd_index_index_path(wi_string_t *, wi_string_t *);
+static void										wd_index_insert_file(wi_string_t *);
 
 
 static wi_time_interval_t						wd_index_time;
@@ -395,28 +396,31 @@ static void wd_index_index_path(wi_string_t *path, wi_string_t *pathprefix) {
 #pragma mark -
 
 void wd_index_add_file(wi_string_t *path) {
-	wi_string_t			*virtualpath;
-	wi_uinteger_t		pathlength;
+	if(wi_lock_trylock(wd_index_lock)) {
+		wd_index_insert_file(path);
+		
+		wi_lock_unlock(wd_index_lock);
+	}
+}
+
+
+
+void wd_index_add_files(wi_array_t *paths) {
+	wi_enumerator_t		*enumerator;
+	wi_string_t			*path;
+	
+	if(wi_array_count(paths) == 0)
+		return;
 	
 	if(wi_lock_trylock(wd_index_lock)) {
-		pathlength = wi_string_length(wd_files);
+		wi_sqlite3_begin_immediate_transaction(wd_database);
 		
-		if(pathlength == 1)
-			pathlength--;
+		enumerator = wi_array_data_enumerator(paths);
 		
-		virtualpath	= wi_string_substring_from_index(path, pathlength);
-
-		if(!wi_sqlite3_execute_statement(wd_database, WI_STR("INSERT INTO `index` "
-															 "(name, virtual_path, real_path, alias) "
-															 "VALUES "
-															 "(?, ?, ?, ?)"),
-										 wi_string_last_path_component(virtualpath),
-										 virtualpath,
-										 path,
-										 wi_number_with_bool(false),
-										 NULL)) {
-			wi_log_error(WI_STR("Could not execute database statement: %m"));
-		}
+		while((path = wi_enumerator_next_data(enumerator)))
+			wd_index_insert_file(path);
+		
+		wi_sqlite3_commit_transaction(wd_database);
 		
 		wi_lock_unlock(wd_index_lock);
 	}
@@ -424,6 +428,32 @@ void wd_index_add_file(wi_string_t *path) {
 
 
 
+static void wd_index_insert_file(wi_string_t *path) {
+	wi_string_t			*virtualpath;
+	wi_uinteger_t		pathlength;
+	
+	pathlength = wi_string_length(wd_files);
+	
+	if(pathlength == 1)
+		pathlength--;
+	
+	virtualpath	= wi_string_substring_from_index(path, pathlength);
+
+	if(!wi_sqlite3_execute_statement(wd_database, WI_STR("INSERT INTO `index` "
+														 "(name, virtual_path, real_path, alias) "
+														 "VALUES "
+														 "(?, ?, ?, ?)"),
+									 wi_string_last_path_component(virtualpath),
+									 virtualpath,
+									 path,
+									 wi_number_with_bool(false),
+									 NULL)) {
+		wi_log_error(WI_STR("Could not execute database statement: %m"));
+	}
+}
+
+
+
 void wd_index_delete_file(wi_string_t *path) {
 	if(wi_lock_trylock(wd_index_lock)) {
 		wi_log_info(WI_STR("DELETE FROM index WHERE real_path = %@"), path);
@@ -32,6 +32,7 @@ void								wd_index_schedule(void);
 void								wd_index_index_files(wi_boolean_t);
 
 void								wd_index_add_file(wi_string_t *);
+void								wd_index_add_files(wi_array_t *);
 void								wd_index_delete_file(wi_string_t *);
 
 wi_boolean_t						wd_index_search(wi_string_t *, wd_user_t *, wi_p7_message_t *);
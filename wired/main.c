@@ -41,17 +41,28 @@
 #include "accounts.h"
 #include "banlist.h"
 #include "boards.h"
+#include "caches.h"
+#include "channels.h"
 #include "events.h"
 #include "files.h"
+#include "handshakes.h"
+#include "hashes.h"
 #include "index.h"
 #include "main.h"
 #include "messages.h"
+#include "metrics.h"
+#include "pipelines.h"
 #include "portmap.h"
+#include "reactor.h"
 #include "server.h"
+#include "shapers.h"
 #include "servers.h"
 #include "settings.h"
+#include "stats.h"
+#include "timeouts.h"
 #include "trackers.h"
 #include "transfers.h"
+#include "workers.h"
 
 static void						wd_cleanup(void);
 static void						wd_usage(void);
@@ -59,7 +70,6 @@ static void						wd_version(void);
 
 static void						wd_write_pid(void);
 static void						wd_delete_pid(void);
-static void						wd_delete_status(void);
 
 static void						wd_database_open(void);
 static void						wd_database_close(void);
@@ -82,16 +92,7 @@ wi_string_t						*wd_config_path;
 
 wi_sqlite3_database_t			*wd_database;
 
-wi_lock_t						*wd_status_lock;
 wi_date_t						*wd_start_date;
-wi_uinteger_t					wd_current_users, wd_total_users;
-wi_uinteger_t					wd_current_downloads, wd_total_downloads;
-wi_uinteger_t					wd_current_uploads, wd_total_uploads;
-wi_file_offset_t				wd_downloads_traffic, wd_uploads_traffic;
-wi_uinteger_t					wd_tracker_current_servers;
-wi_uinteger_t					wd_tracker_current_users;
-wi_file_offset_t				wd_tracker_current_files;
-wi_file_offset_t				wd_tracker_current_size;
 
 
 
@@ -112,7 +113,6 @@ int main(int argc, const char **argv) {
 	//wi_p7_socket_debug		= true;
 	wi_log_syslog			= true;
 	wi_log_syslog_facility	= LOG_DAEMON;
-	wd_status_lock			= wi_lock_init(wi_lock_alloc());
 	wd_start_date			= wi_date_init(wi_date_alloc());
 	test_config				= false;
 	daemonize				= true;
@@ -242,21 +242,32 @@ int main(int argc, const char **argv) {
 	wd_database_open();
 	
 	wd_server_initialize();
+	wd_timeouts_initialize();
 
 	wd_accounts_initialize();
 	wd_boards_initialize();
+	wd_caches_initialize();
+	wd_channels_initialize();
 	wd_chats_initialize();
 	wd_users_initialize();
 	wd_events_initialize();
 	wd_files_initialize();
+	wd_handshakes_initialize();
+	wd_hashes_initialize();
 	wd_index_initialize();
 	wd_messages_initialize();
+	wd_metrics_initialize();
+	wd_pipelines_initialize();
 	wd_portmap_initialize();
+	wd_reactor_initialize();
 	wd_banlist_initialize();
 	wd_servers_initialize();
 	wd_settings_initialize();
+	wd_shapers_initialize();
+	wd_stats_initialize();
 	wd_trackers_initialize();
 	wd_transfers_initialize();
+	wd_workers_initialize();
 
 	if(!wd_settings_read_config())
 		exit(1);
@@ -296,7 +307,6 @@ int main(int argc, const char **argv) {
 	wd_schedule();
 	wd_server_listen();
 	wd_write_pid();
-	wd_write_status(true);
 	
 	wd_index_index_files(true);
 	
@@ -318,7 +328,8 @@ static void wd_cleanup(void) {
 	wd_database_close();
 	wd_server_cleanup();
 	wd_delete_pid();
-	wd_delete_status();
+	wd_metrics_cleanup();
+	wd_stats_cleanup();
 }
 
 
@@ -382,57 +393,6 @@ static void wd_delete_pid(void) {
 
 
 
-void wd_write_status(wi_boolean_t force) {
-	static wi_time_interval_t	update;
-	wi_string_t					*path, *string;
-	wi_time_interval_t			interval;
-
-	interval = wi_time_interval();
-
-	if(!force && interval - update < 1.0)
-		return;
-
-	update = interval;
-	
-	wi_process_set_name(wi_process(), wi_string_with_format(WI_STR("%u %@"),
-		wd_current_users,
-		wd_current_users == 1
-			? WI_STR("user")
-			: WI_STR("users")));
-
-	path = WI_STR("wired.status");
-	string = wi_string_with_format(WI_STR("%.0f %u %u %u %u %u %u %llu %llu %u %u %llu %llu\n"),
-								   wi_date_time_interval(wd_start_date),
-								   wd_current_users,
-								   wd_total_users,
-								   wd_current_downloads,
-								   wd_total_downloads,
-								   wd_current_uploads,
-								   wd_total_uploads,
-								   wd_downloads_traffic,
-								   wd_uploads_traffic,
-								   wd_tracker_current_servers,
-								   wd_tracker_current_users,
-								   wd_tracker_current_files,
-								   wd_tracker_current_size);
-	
-	if(!wi_string_write_to_file(string, path))
-		wi_log_error(WI_STR("Could not write to \"%@\": %m"), path);
-}
-
-
-
-static void wd_delete_status(void) {
-	wi_string_t		*path;
-	
-	path = WI_STR("wired.status");
-
-	if(!wi_fs_delete_path(path))
-		wi_log_error(WI_STR("Could not delete \"%@\": %m"), path);
-}
-
-
-
 #pragma mark -
 
 static void wd_database_open(void) {
@@ -597,9 +557,12 @@ static void wd_signal_pipe(int sigraised) {
 
 static void wd_schedule(void) {
 	wd_files_schedule();
-	wd_server_schedule();
+	wd_handshakes_schedule();
+	wd_metrics_schedule();
 	wd_servers_schedule();
+	wd_stats_schedule();
+	wd_timeouts_schedule();
 	wd_trackers_schedule();
 	wd_transfers_schedule();
-	wd_users_schedule();
+	wd_workers_schedule();
 }
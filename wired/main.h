@@ -35,8 +35,6 @@ typedef struct _wd_user				wd_user_t;
 typedef struct _wd_chat				wd_chat_t;
 
 
-void								wd_write_status(wi_boolean_t);
-
 void								wd_database_set_version_for_table(wi_uinteger_t, wi_string_t *);
 wi_uinteger_t						wd_database_version_for_table(wi_string_t *);
 
@@ -50,15 +48,6 @@ extern wi_string_t					*wd_config_path;
 
 extern wi_sqlite3_database_t		*wd_database;
 
-extern wi_lock_t					*wd_status_lock;
 extern wi_date_t					*wd_start_date;
-extern wi_uinteger_t				wd_current_users, wd_total_users;
-extern wi_uinteger_t				wd_current_downloads, wd_total_downloads;
-extern wi_uinteger_t				wd_current_uploads, wd_total_uploads;
-extern wi_file_offset_t				wd_downloads_traffic, wd_uploads_traffic;
-extern wi_uinteger_t				wd_tracker_current_servers;
-extern wi_uinteger_t				wd_tracker_current_users;
-extern wi_file_offset_t				wd_tracker_current_files;
-extern wi_file_offset_t				wd_tracker_current_size;
 
 #endif /* WD_MAIN_H */
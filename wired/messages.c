@@ -32,6 +32,7 @@
 
 #include "banlist.h"
 #include "boards.h"
+#include "channels.h"
 #include "chats.h"
 #include "events.h"
 #include "files.h"
@@ -41,10 +42,48 @@
 #include "server.h"
 #include "servers.h"
 #include "settings.h"
+#include "stats.h"
 #include "transfers.h"
 #include "users.h"
 
+#define WD_MESSAGE_STATE(state) \
+	(1 << (state))
+
+#define WD_MESSAGE_HANDLER(name, func, states, privilege, flags) \
+	{ (name), (func), (states), (privilege), (flags) }
+
+#define WD_MESSAGE_HANDLERS_COUNT \
+	(sizeof(wd_message_handlers) / sizeof(*wd_message_handlers))
+
+
+enum _wd_message_states {
+	WD_MESSAGE_AFTER_LOGIN				= WD_MESSAGE_STATE(WD_USER_SAID_HELLO) |
+										  WD_MESSAGE_STATE(WD_USER_GAVE_USER) |
+										  WD_MESSAGE_STATE(WD_USER_LOGGED_IN) |
+										  WD_MESSAGE_STATE(WD_USER_DISCONNECTED),
+	WD_MESSAGE_BEFORE_LOGIN				= WD_MESSAGE_STATE(WD_USER_GAVE_CLIENT_INFO),
+	WD_MESSAGE_AFTER_CLIENT_INFO		= WD_MESSAGE_STATE(WD_USER_GAVE_CLIENT_INFO) | WD_MESSAGE_AFTER_LOGIN,
+	WD_MESSAGE_AFTER_CONNECT			= WD_MESSAGE_STATE(WD_USER_CONNECTED) | WD_MESSAGE_AFTER_LOGIN
+};
+
+enum _wd_message_flags {
+	WD_MESSAGE_RESETS_IDLE				= (1 << 0),
+	WD_MESSAGE_HOLDS_SOCKET				= (1 << 1),
+	WD_MESSAGE_ON_CHANNEL				= (1 << 2)
+};
+
+
 typedef void						wd_message_func_t(wd_user_t *, wi_p7_message_t *);
+typedef wi_boolean_t				wd_message_privilege_func_t(wd_account_t *);
+
+struct _wd_message_handler {
+	const char						*name;
+	wd_message_func_t				*func;
+	uint32_t						states;
+	wd_message_privilege_func_t		*privilege;
+	uint32_t						flags;
+};
+typedef struct _wd_message_handler	wd_message_handler_t;
 
 
 static void							wd_message_client_info(wd_user_t *, wi_p7_message_t *);
@@ -116,8 +155,12 @@ static void							wd_message_account_delete_group(wd_user_t *, wi_p7_message_t *
 static void							wd_message_account_subscribe_accounts(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_account_unsubscribe_accounts(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_transfer_download_file(wd_user_t *, wi_p7_message_t *);
+static void							wd_message_transfer_download_directory(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_transfer_upload_file(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_transfer_upload_directory(wd_user_t *, wi_p7_message_t *);
+static void							wd_message_transfer_upload_batch(wd_user_t *, wi_p7_message_t *);
+static void							wd_message_transfer_get_channel(wd_user_t *, wi_p7_message_t *);
+static void							wd_message_transfer_join_channel(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_log_get_log(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_log_subscribe(wd_user_t *, wi_p7_message_t *);
 static void							wd_message_log_unsubscribe(wd_user_t *, wi_p7_message_t *);
@@ -136,177 +179,168 @@ static void							wd_message_tracker_send_register(wd_user_t *, wi_p7_message_t
 static void							wd_message_tracker_send_update(wd_user_t *, wi_p7_message_t *);
 
 
-static wi_mutable_dictionary_t		*wd_message_handlers;
+static wd_message_handler_t			wd_message_handlers[] = {
+	WD_MESSAGE_HANDLER("wired.client_info", wd_message_client_info, WD_MESSAGE_AFTER_CONNECT, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.send_ping", wd_message_send_ping, WD_MESSAGE_AFTER_CLIENT_INFO, NULL, WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.ping", wd_message_ping, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.send_login", wd_message_send_login, WD_MESSAGE_AFTER_CLIENT_INFO, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.set_icon", wd_message_user_set_icon, WD_MESSAGE_AFTER_CLIENT_INFO, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.set_nick", wd_message_user_set_nick, WD_MESSAGE_AFTER_CLIENT_INFO, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.set_status", wd_message_user_set_status, WD_MESSAGE_AFTER_CLIENT_INFO, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.set_idle", wd_message_user_set_idle, WD_MESSAGE_AFTER_LOGIN, NULL, 0),
+	WD_MESSAGE_HANDLER("wired.user.get_info", wd_message_user_get_info, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.disconnect_user", wd_message_user_disconnect_user, WD_MESSAGE_AFTER_LOGIN, wd_account_user_disconnect_users, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.ban_user", wd_message_user_ban_user, WD_MESSAGE_AFTER_LOGIN, wd_account_user_ban_users, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.user.get_users", wd_message_user_get_users, WD_MESSAGE_AFTER_LOGIN, wd_account_user_get_users, 0),
+	WD_MESSAGE_HANDLER("wired.chat.join_chat", wd_message_chat_join_chat, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.leave_chat", wd_message_chat_leave_chat, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.set_topic", wd_message_chat_set_topic, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.send_me", wd_message_chat_send_say_or_me, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.send_say", wd_message_chat_send_say_or_me, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.create_chat", wd_message_chat_create_chat, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.invite_user", wd_message_chat_invite_user, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.decline_invitation", wd_message_chat_decline_invitation, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.chat.kick_user", wd_message_chat_kick_user, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.message.send_message", wd_message_message_send_message, WD_MESSAGE_AFTER_LOGIN, wd_account_message_send_messages, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.message.send_broadcast", wd_message_message_send_broadcast, WD_MESSAGE_AFTER_LOGIN, wd_account_message_broadcast, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.get_boards", wd_message_board_get_boards, WD_MESSAGE_AFTER_LOGIN, wd_account_board_read_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.get_threads", wd_message_board_get_threads, WD_MESSAGE_AFTER_LOGIN, wd_account_board_read_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.get_thread", wd_message_board_get_thread, WD_MESSAGE_AFTER_LOGIN, wd_account_board_read_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.add_board", wd_message_board_add_board, WD_MESSAGE_AFTER_LOGIN, wd_account_board_add_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.rename_board", wd_message_board_rename_board, WD_MESSAGE_AFTER_LOGIN, wd_account_board_rename_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.move_board", wd_message_board_move_board, WD_MESSAGE_AFTER_LOGIN, wd_account_board_move_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.delete_board", wd_message_board_delete_board, WD_MESSAGE_AFTER_LOGIN, wd_account_board_delete_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.get_board_info", wd_message_board_get_board_info, WD_MESSAGE_AFTER_LOGIN, wd_account_board_get_board_info, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.set_board_info", wd_message_board_set_board_info, WD_MESSAGE_AFTER_LOGIN, wd_account_board_set_board_info, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.add_thread", wd_message_board_add_thread, WD_MESSAGE_AFTER_LOGIN, wd_account_board_add_threads, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.edit_thread", wd_message_board_edit_thread, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.move_thread", wd_message_board_move_thread, WD_MESSAGE_AFTER_LOGIN, wd_account_board_move_threads, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.delete_thread", wd_message_board_delete_thread, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.add_post", wd_message_board_add_post, WD_MESSAGE_AFTER_LOGIN, wd_account_board_add_posts, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.edit_post", wd_message_board_edit_post, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.delete_post", wd_message_board_delete_post, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.subscribe_boards", wd_message_board_subscribe_boards, WD_MESSAGE_AFTER_LOGIN, wd_account_board_read_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.board.unsubscribe_boards", wd_message_board_unsubscribe_boards, WD_MESSAGE_AFTER_LOGIN, wd_account_board_read_boards, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.list_directory", wd_message_file_list_directory, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.get_info", wd_message_file_get_info, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.move", wd_message_file_move, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.link", wd_message_file_link, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.set_type", wd_message_file_set_type, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.set_comment", wd_message_file_set_comment, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.set_executable", wd_message_file_set_executable, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.set_permissions", wd_message_file_set_permissions, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.set_label", wd_message_file_set_label, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.delete", wd_message_file_delete, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.create_directory", wd_message_file_create_directory, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.search", wd_message_file_search, WD_MESSAGE_AFTER_LOGIN, wd_account_file_search_files, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.preview_file", wd_message_file_preview_file, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.subscribe_directory", wd_message_file_subscribe_directory, WD_MESSAGE_AFTER_LOGIN, wd_account_file_list_files, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.file.unsubscribe_directory", wd_message_file_unsubscribe_directory, WD_MESSAGE_AFTER_LOGIN, wd_account_file_list_files, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.change_password", wd_message_account_change_password, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.list_users", wd_message_account_list_users, WD_MESSAGE_AFTER_LOGIN, wd_account_account_list_accounts, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.list_groups", wd_message_account_list_groups, WD_MESSAGE_AFTER_LOGIN, wd_account_account_list_accounts, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.read_user", wd_message_account_read_user, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.read_group", wd_message_account_read_group, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.create_user", wd_message_account_create_user, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.create_group", wd_message_account_create_group, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.edit_user", wd_message_account_edit_user, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.edit_group", wd_message_account_edit_group, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.delete_user", wd_message_account_delete_user, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.delete_group", wd_message_account_delete_group, WD_MESSAGE_AFTER_LOGIN, wd_account_account_delete_groups, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.subscribe_accounts", wd_message_account_subscribe_accounts, WD_MESSAGE_AFTER_LOGIN, wd_account_account_list_accounts, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.account.unsubscribe_accounts", wd_message_account_unsubscribe_accounts, WD_MESSAGE_AFTER_LOGIN, wd_account_account_list_accounts, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.transfer.download_file", wd_message_transfer_download_file, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE | WD_MESSAGE_HOLDS_SOCKET | WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.transfer.download_directory", wd_message_transfer_download_directory, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE | WD_MESSAGE_HOLDS_SOCKET | WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.transfer.upload_file", wd_message_transfer_upload_file, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE | WD_MESSAGE_HOLDS_SOCKET | WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.transfer.upload_directory", wd_message_transfer_upload_directory, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.transfer.upload_batch", wd_message_transfer_upload_batch, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE | WD_MESSAGE_HOLDS_SOCKET | WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.transfer.get_channel", wd_message_transfer_get_channel, WD_MESSAGE_AFTER_LOGIN, NULL, 0),
+	WD_MESSAGE_HANDLER("wired.transfer.join_channel", wd_message_transfer_join_channel, WD_MESSAGE_BEFORE_LOGIN, NULL, WD_MESSAGE_ON_CHANNEL),
+	WD_MESSAGE_HANDLER("wired.log.get_log", wd_message_log_get_log, WD_MESSAGE_AFTER_LOGIN, wd_account_log_view_log, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.log.subscribe", wd_message_log_subscribe, WD_MESSAGE_AFTER_LOGIN, wd_account_log_view_log, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.log.unsubscribe", wd_message_log_unsubscribe, WD_MESSAGE_AFTER_LOGIN, wd_account_log_view_log, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.event.get_first_time", wd_message_event_get_first_time, WD_MESSAGE_AFTER_LOGIN, wd_account_events_view_events, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.event.get_events", wd_message_event_get_events, WD_MESSAGE_AFTER_LOGIN, wd_account_events_view_events, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.event.subscribe", wd_message_event_subscribe, WD_MESSAGE_AFTER_LOGIN, wd_account_events_view_events, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.event.unsubscribe", wd_message_event_unsubscribe, WD_MESSAGE_AFTER_LOGIN, wd_account_events_view_events, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.settings.get_settings", wd_message_settings_get_settings, WD_MESSAGE_AFTER_LOGIN, wd_account_settings_get_settings, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.settings.set_settings", wd_message_settings_set_settings, WD_MESSAGE_AFTER_LOGIN, wd_account_settings_set_settings, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.banlist.get_bans", wd_message_banlist_get_bans, WD_MESSAGE_AFTER_LOGIN, wd_account_banlist_get_bans, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.banlist.add_ban", wd_message_banlist_add_ban, WD_MESSAGE_AFTER_LOGIN, wd_account_banlist_add_bans, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.banlist.delete_ban", wd_message_banlist_delete_ban, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.tracker.get_categories", wd_message_tracker_get_categories, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.tracker.get_servers", wd_message_tracker_get_servers, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.tracker.send_register", wd_message_tracker_send_register, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE),
+	WD_MESSAGE_HANDLER("wired.tracker.send_update", wd_message_tracker_send_update, WD_MESSAGE_AFTER_LOGIN, NULL, WD_MESSAGE_RESETS_IDLE)
+};
+
+/* libwired does not expose the wired.xml message id on wi_p7_message_t, so entries are found by name */
+static wi_mutable_dictionary_t		*wd_message_handlers_by_name;
 
 
 
-#define WD_MESSAGE_HANDLER(message, handler) \
-	wi_mutable_dictionary_set_data_for_key(wd_message_handlers, (handler), (message))
-	
 void wd_messages_initialize(void) {
-	wd_message_handlers = wi_dictionary_init_with_capacity_and_callbacks(wi_mutable_dictionary_alloc(),
-		0, wi_dictionary_default_key_callbacks, wi_dictionary_null_value_callbacks);
-	
-	WD_MESSAGE_HANDLER(WI_STR("wired.client_info"), wd_message_client_info);
-	WD_MESSAGE_HANDLER(WI_STR("wired.send_ping"), wd_message_send_ping);
-	WD_MESSAGE_HANDLER(WI_STR("wired.ping"), wd_message_ping);
-	WD_MESSAGE_HANDLER(WI_STR("wired.send_login"), wd_message_send_login);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.set_icon"), wd_message_user_set_icon);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.set_nick"), wd_message_user_set_nick);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.set_status"), wd_message_user_set_status);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.set_idle"), wd_message_user_set_idle);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.get_info"), wd_message_user_get_info);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.disconnect_user"), wd_message_user_disconnect_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.ban_user"), wd_message_user_ban_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.user.get_users"), wd_message_user_get_users);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.join_chat"), wd_message_chat_join_chat);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.leave_chat"), wd_message_chat_leave_chat);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.set_topic"), wd_message_chat_set_topic);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.send_me"), wd_message_chat_send_say_or_me);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.send_say"), wd_message_chat_send_say_or_me);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.create_chat"), wd_message_chat_create_chat);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.invite_user"), wd_message_chat_invite_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.decline_invitation"), wd_message_chat_decline_invitation);
-	WD_MESSAGE_HANDLER(WI_STR("wired.chat.kick_user"), wd_message_chat_kick_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.message.send_message"), wd_message_message_send_message);
-	WD_MESSAGE_HANDLER(WI_STR("wired.message.send_broadcast"), wd_message_message_send_broadcast);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.get_boards"), wd_message_board_get_boards);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.get_threads"), wd_message_board_get_threads);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.get_thread"), wd_message_board_get_thread);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.add_board"), wd_message_board_add_board);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.rename_board"), wd_message_board_rename_board);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.move_board"), wd_message_board_move_board);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.delete_board"), wd_message_board_delete_board);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.get_board_info"), wd_message_board_get_board_info);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.set_board_info"), wd_message_board_set_board_info);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.add_thread"), wd_message_board_add_thread);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.edit_thread"), wd_message_board_edit_thread);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.move_thread"), wd_message_board_move_thread);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.delete_thread"), wd_message_board_delete_thread);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.add_post"), wd_message_board_add_post);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.edit_post"), wd_message_board_edit_post);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.delete_post"), wd_message_board_delete_post);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.subscribe_boards"), wd_message_board_subscribe_boards);
-	WD_MESSAGE_HANDLER(WI_STR("wired.board.unsubscribe_boards"), wd_message_board_unsubscribe_boards);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.list_directory"), wd_message_file_list_directory);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.get_info"), wd_message_file_get_info);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.move"), wd_message_file_move);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.link"), wd_message_file_link);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.set_type"), wd_message_file_set_type);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.set_comment"), wd_message_file_set_comment);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.set_executable"), wd_message_file_set_executable);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.set_permissions"), wd_message_file_set_permissions);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.set_label"), wd_message_file_set_label);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.delete"), wd_message_file_delete);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.create_directory"), wd_message_file_create_directory);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.search"), wd_message_file_search);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.preview_file"), wd_message_file_preview_file);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.subscribe_directory"), wd_message_file_subscribe_directory);
-	WD_MESSAGE_HANDLER(WI_STR("wired.file.unsubscribe_directory"), wd_message_file_unsubscribe_directory);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.change_password"), wd_message_account_change_password);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.list_users"), wd_message_account_list_users);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.list_groups"), wd_message_account_list_groups);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.read_user"), wd_message_account_read_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.read_group"), wd_message_account_read_group);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.create_user"), wd_message_account_create_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.create_group"), wd_message_account_create_group);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.edit_user"), wd_message_account_edit_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.edit_group"), wd_message_account_edit_group);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.delete_user"), wd_message_account_delete_user);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.delete_group"), wd_message_account_delete_group);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.subscribe_accounts"), wd_message_account_subscribe_accounts);
-	WD_MESSAGE_HANDLER(WI_STR("wired.account.unsubscribe_accounts"), wd_message_account_unsubscribe_accounts);
-	WD_MESSAGE_HANDLER(WI_STR("wired.transfer.download_file"), wd_message_transfer_download_file);
-	WD_MESSAGE_HANDLER(WI_STR("wired.transfer.upload_file"), wd_message_transfer_upload_file);
-	WD_MESSAGE_HANDLER(WI_STR("wired.transfer.upload_directory"), wd_message_transfer_upload_directory);
-	WD_MESSAGE_HANDLER(WI_STR("wired.log.get_log"), wd_message_log_get_log);
-	WD_MESSAGE_HANDLER(WI_STR("wired.log.subscribe"), wd_message_log_subscribe);
-	WD_MESSAGE_HANDLER(WI_STR("wired.log.unsubscribe"), wd_message_log_unsubscribe);
-	WD_MESSAGE_HANDLER(WI_STR("wired.event.get_first_time"), wd_message_event_get_first_time);
-	WD_MESSAGE_HANDLER(WI_STR("wired.event.get_events"), wd_message_event_get_events);
-	WD_MESSAGE_HANDLER(WI_STR("wired.event.subscribe"), wd_message_event_subscribe);
-	WD_MESSAGE_HANDLER(WI_STR("wired.event.unsubscribe"), wd_message_event_unsubscribe);
-	WD_MESSAGE_HANDLER(WI_STR("wired.settings.get_settings"), wd_message_settings_get_settings);
-	WD_MESSAGE_HANDLER(WI_STR("wired.settings.set_settings"), wd_message_settings_set_settings);
-	WD_MESSAGE_HANDLER(WI_STR("wired.banlist.get_bans"), wd_message_banlist_get_bans);
-	WD_MESSAGE_HANDLER(WI_STR("wired.banlist.add_ban"), wd_message_banlist_add_ban);
-	WD_MESSAGE_HANDLER(WI_STR("wired.banlist.delete_ban"), wd_message_banlist_delete_ban);
-	WD_MESSAGE_HANDLER(WI_STR("wired.tracker.get_categories"), wd_message_tracker_get_categories);
-	WD_MESSAGE_HANDLER(WI_STR("wired.tracker.get_servers"), wd_message_tracker_get_servers);
-	WD_MESSAGE_HANDLER(WI_STR("wired.tracker.send_register"), wd_message_tracker_send_register);
-	WD_MESSAGE_HANDLER(WI_STR("wired.tracker.send_update"), wd_message_tracker_send_update);
-}
-
-
-
-void wd_messages_loop_for_user(wd_user_t *user) {
-	wi_pool_t				*pool;
-	wi_socket_t				*socket;
-	wi_p7_socket_t			*p7_socket;
-	wi_p7_message_t			*message;
-	wi_socket_state_t		state;
-	wd_user_state_t			user_state;
-	wi_time_interval_t		timeout;
+	wi_uinteger_t		i;
 	
-	pool = wi_pool_init(wi_pool_alloc());
+	wd_message_handlers_by_name = wi_dictionary_init_with_capacity_and_callbacks(wi_mutable_dictionary_alloc(),
+		WD_MESSAGE_HANDLERS_COUNT, wi_dictionary_default_key_callbacks, wi_dictionary_null_value_callbacks);
 	
-	socket = wd_user_socket(user);
-	p7_socket = wd_user_p7_socket(user);
+	for(i = 0; i < WD_MESSAGE_HANDLERS_COUNT; i++) {
+		wi_mutable_dictionary_set_data_for_key(wd_message_handlers_by_name,
+			&wd_message_handlers[i], wi_string_with_cstring(wd_message_handlers[i].name));
+	}
+}
 
-	while(true) {
-		timeout = wi_time_interval();
-		
-		do {
-			state		= wi_socket_wait(socket, 0.1);
-			user_state	= wd_user_state(user);
-			
-			if(state == WI_SOCKET_TIMEOUT) {
-				if(wi_time_interval() - timeout >= 120.0)
-					break;
-			}
-		} while(state == WI_SOCKET_TIMEOUT && user_state <= WD_USER_LOGGED_IN);
-		
-		if(user_state == WD_USER_DISCONNECTED)
-			break;
-		
-		if(state == WI_SOCKET_ERROR || wi_time_interval() - timeout >= 120.0) {
-			wi_log_warn(WI_STR("Could not wait for message from %@: %@"),
-				wd_user_identifier(user),
-				(state == WI_SOCKET_ERROR) ? wi_error_string() : WI_STR("Timed out"));
 
-			break;
-		}
-		
-		message = wd_user_read_message(user, 120.0);
-		
-		if(!message) {
-			if(wi_error_domain() != WI_ERROR_DOMAIN_LIBWIRED && wi_error_code() != WI_ERROR_SOCKET_EOF) {
-				wi_log_warn(WI_STR("Could not read message from %@: %m"),
-					wd_user_identifier(user));
-			}
-			
-			break;
-		}
 
-		if(!wi_p7_socket_verify_message(p7_socket, message)) {
-			wi_log_error(WI_STR("Could not verify message from %@: %m"),
+wi_p7_message_t * wd_messages_read_message_for_user(wd_user_t *user, wi_time_interval_t timeout) {
+	wi_p7_message_t			*message;
+	
+	message = wd_user_read_message(user, timeout);
+	
+	if(!message) {
+		if(wi_error_domain() != WI_ERROR_DOMAIN_LIBWIRED && wi_error_code() != WI_ERROR_SOCKET_EOF) {
+			wi_log_warn(WI_STR("Could not read message from %@: %m"),
 				wd_user_identifier(user));
-			wd_user_reply_error(user, WI_STR("wired.error.invalid_message"), message);
-			
-			continue;
 		}
 		
+		return NULL;
+	}
+	
+	wd_user_set_read_time(user, wi_time_interval());
+	
+	return message;
+}
+
+
+
+void wd_messages_process_message_for_user(wd_user_t *user, wi_p7_message_t *message) {
+	if(wi_p7_socket_verify_message(wd_user_p7_socket(user), message)) {
 		wd_messages_handle_message(message, user);
-		
-		wi_pool_set_context(pool, wi_p7_message_name(message));
-		wi_pool_drain(pool);
+	} else {
+		wi_log_error(WI_STR("Could not verify message from %@: %m"),
+			wd_user_identifier(user));
+		wd_user_reply_error(user, WI_STR("wired.error.invalid_message"), message);
 	}
 	
-	if(wd_user_state(user) >= WD_USER_LOGGED_IN) {
-		wi_lock_lock(wd_status_lock);
-		wd_current_users--;
-		wd_write_status(true);
-		wi_lock_unlock(wd_status_lock);
+	wd_user_set_read_time(user, wi_time_interval());
+}
+
+
+
+wi_boolean_t wd_messages_message_holds_socket(wi_p7_message_t *message) {
+	wd_message_handler_t	*handler;
+	
+	handler = wi_dictionary_data_for_key(wd_message_handlers_by_name, wi_p7_message_name(message));
+	
+	return (handler && (handler->flags & WD_MESSAGE_HOLDS_SOCKET));
+}
+
+
+
+void wd_messages_disconnect_user(wd_user_t *user) {
+	if(wd_user_state(user) >= WD_USER_LOGGED_IN && wd_user_session_id(user) == 0) {
+		wd_stats_add(WD_STAT_CURRENT_USERS, -1);
 	}
 	
 	wd_user_set_state(user, WD_USER_DISCONNECTED);
@@ -319,23 +353,22 @@ void wd_messages_loop_for_user(wd_user_t *user) {
 	if(wd_user_has_joined_public_chat(user))
 		wd_events_add_event(WI_STR("wired.event.user.logged_out"), user, NULL);
 	
-	wi_p7_socket_close(p7_socket);
-	wi_socket_close(socket);
+	wd_user_flush_messages(user);
 	
-	wd_users_remove_user(user);
+	wi_p7_socket_close(wd_user_p7_socket(user));
+	wi_socket_close(wd_user_socket(user));
 	
-	wi_release(pool);
+	wd_users_remove_user(user);
 }
 
 
 
 void wd_messages_handle_message(wi_p7_message_t *message, wd_user_t *user) {
-	wd_message_func_t		*handler;
+	wd_message_handler_t	*handler;
 	wi_string_t				*name;
-	wd_user_state_t			user_state;
 	
 	name = wi_p7_message_name(message);
-	handler = wi_dictionary_data_for_key(wd_message_handlers, name);
+	handler = wi_dictionary_data_for_key(wd_message_handlers_by_name, name);
 	
 	if(!handler) {
 		wi_log_error(WI_STR("No handler for message \"%@\""), name);
@@ -344,35 +377,20 @@ void wd_messages_handle_message(wi_p7_message_t *message, wd_user_t *user) {
 		return;
 	}
 	
-	user_state = wd_user_state(user);
-
-	if(user_state == WD_USER_CONNECTED) {
-		if(handler != wd_message_client_info) {
-			wi_log_warn(WI_STR("Could not process message \"%@\": Out of sequence"), name);
-			wd_user_reply_error(user, WI_STR("wired.error.message_out_of_sequence"), message);
-			
-			return;
-		}
-	}
-	else if(user_state == WD_USER_GAVE_CLIENT_INFO) {
-		if(handler != wd_message_send_ping &&
-		   handler != wd_message_send_login &&
-		   handler != wd_message_user_set_nick &&
-		   handler != wd_message_user_set_status &&
-		   handler != wd_message_user_set_icon) {
-			wi_log_error(WI_STR("Could not process message \"%@\": Out of sequence"), name);
-			wd_user_reply_error(user, WI_STR("wired.error.message_out_of_sequence"), message);
-			
-			return;
-		}
+	if(!(handler->states & WD_MESSAGE_STATE(wd_user_state(user))) ||
+	   (!(handler->flags & WD_MESSAGE_ON_CHANNEL) && wd_user_session_id(user) != 0)) {
+		wi_log_warn(WI_STR("Could not process message \"%@\": Out of sequence"), name);
+		wd_user_reply_error(user, WI_STR("wired.error.message_out_of_sequence"), message);
+		
+		return;
 	}
 	
-	(*handler)(user, message);
+	if(handler->privilege && !(*handler->privilege)(wd_user_account(user)))
+		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
+	else
+		(*handler->func)(user, message);
 	
-	if(handler != wd_message_send_ping &&
-	   handler != wd_message_ping &&
-	   handler != wd_message_user_set_idle &&
-	   handler != wd_message_user_get_users) {
+	if(handler->flags & WD_MESSAGE_RESETS_IDLE) {
 		wd_user_set_idle_time(user, wi_date());
 		
 		if(wd_user_is_idle(user)) {
@@ -471,11 +489,8 @@ static void wd_message_send_login(wd_user_t *user, wi_p7_message_t *message) {
 	wd_user_set_color(user, wd_account_color(account));
 	wd_user_set_state(user, WD_USER_LOGGED_IN);
 	
-	wi_lock_lock(wd_status_lock);
-	wd_current_users++;
-	wd_total_users++;
-	wd_write_status(true);
-	wi_lock_unlock(wd_status_lock);
+	wd_stats_add(WD_STAT_CURRENT_USERS, 1);
+	wd_stats_add(WD_STAT_TOTAL_USERS, 1);
 	
 	reply = wi_p7_message_with_name(WI_STR("wired.login"), wd_p7_spec);
 	wi_p7_message_set_uint32_for_name(reply, wd_user_id(user), WI_STR("wired.user.id"));
@@ -601,12 +616,6 @@ static void wd_message_user_disconnect_user(wd_user_t *user, wi_p7_message_t *me
 	wd_chat_t			*chat;
 	wi_p7_uint32_t		uid;
 	
-	if(!wd_account_user_disconnect_users(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wi_p7_message_get_uint32_for_name(message, &uid, WI_STR("wired.user.id"));
 	
 	peer = wd_users_user_with_id(uid);
@@ -652,12 +661,6 @@ static void wd_message_user_ban_user(wd_user_t *user, wi_p7_message_t *message)
 	wd_chat_t			*chat;
 	wi_p7_uint32_t		uid;
 	
-	if(!wd_account_user_ban_users(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wi_p7_message_get_uint32_for_name(message, &uid, WI_STR("wired.user.id"));
 	
 	peer = wd_users_user_with_id(uid);
@@ -698,12 +701,6 @@ static void wd_message_user_ban_user(wd_user_t *user, wi_p7_message_t *message)
 
 
 static void wd_message_user_get_users(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_user_get_users(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wd_users_reply_users(user, message);
 
 	wd_events_add_event(WI_STR("wired.event.user.got_users"), user, NULL);
@@ -1054,12 +1051,6 @@ static void wd_message_message_send_message(wd_user_t *user, wi_p7_message_t *me
 	wd_user_t			*peer;
 	wi_p7_uint32_t		uid;
 	
-	if(!wd_account_message_send_messages(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wi_p7_message_get_uint32_for_name(message, &uid, WI_STR("wired.user.id"));
 	
 	peer = wd_users_user_with_id(uid);
@@ -1088,12 +1079,6 @@ static void wd_message_message_send_broadcast(wd_user_t *user, wi_p7_message_t *
 	wi_p7_message_t		*broadcast;
 	wi_string_t			*string;
 	
-	if(!wd_account_message_broadcast(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	string = wi_p7_message_string_for_name(message, WI_STR("wired.message.broadcast"));
 	broadcast = wi_p7_message_with_name(WI_STR("wired.message.broadcast"), wd_p7_spec);
 	wi_p7_message_set_uint32_for_name(broadcast, wd_user_id(user), WI_STR("wired.user.id"));
@@ -1108,12 +1093,6 @@ static void wd_message_message_send_broadcast(wd_user_t *user, wi_p7_message_t *
 
 
 static void wd_message_board_get_boards(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_board_read_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wd_boards_reply_boards(user, message);
 
 	wd_events_add_event(WI_STR("wired.event.board.got_boards"), user, NULL);
@@ -1124,12 +1103,6 @@ static void wd_message_board_get_boards(wd_user_t *user, wi_p7_message_t *messag
 static void wd_message_board_get_threads(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*board;
 	
-	if(!wd_account_board_read_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	board = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	
 	if(board && !wd_boards_has_board_with_name(board)) {
@@ -1149,12 +1122,6 @@ static void wd_message_board_get_thread(wd_user_t *user, wi_p7_message_t *messag
 	wi_string_t		*board, *subject;
 	wi_uuid_t		*thread;
 	
-	if(!wd_account_board_read_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	thread = wi_p7_message_uuid_for_name(message, WI_STR("wired.board.thread"));
 	
 	if(wd_boards_reply_thread(thread, user, message)) {
@@ -1171,12 +1138,6 @@ static void wd_message_board_get_thread(wd_user_t *user, wi_p7_message_t *messag
 static void wd_message_board_add_board(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*board;
 	
-	if(!wd_account_board_add_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	board = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	
 	if(wd_boards_has_board_with_name(board)) {
@@ -1198,12 +1159,6 @@ static void wd_message_board_add_board(wd_user_t *user, wi_p7_message_t *message
 static void wd_message_board_rename_board(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*oldboard, *newboard;
 	
-	if(!wd_account_board_rename_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	oldboard = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	newboard = wi_p7_message_string_for_name(message, WI_STR("wired.board.new_board"));
 	
@@ -1238,12 +1193,6 @@ static void wd_message_board_rename_board(wd_user_t *user, wi_p7_message_t *mess
 static void wd_message_board_move_board(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*oldboard, *newboard;
 	
-	if(!wd_account_board_move_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	oldboard = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	newboard = wi_p7_message_string_for_name(message, WI_STR("wired.board.new_board"));
 	
@@ -1272,12 +1221,6 @@ static void wd_message_board_move_board(wd_user_t *user, wi_p7_message_t *messag
 static void wd_message_board_delete_board(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*board;
 	
-	if(!wd_account_board_delete_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	board = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	
 	if(!wd_boards_has_board_with_name(board)) {
@@ -1299,12 +1242,6 @@ static void wd_message_board_delete_board(wd_user_t *user, wi_p7_message_t *mess
 static void wd_message_board_get_board_info(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*board;
 	
-	if(!wd_account_board_get_board_info(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	board = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	
 	if(!wd_boards_has_board_with_name(board)) {
@@ -1324,12 +1261,6 @@ static void wd_message_board_get_board_info(wd_user_t *user, wi_p7_message_t *me
 static void wd_message_board_set_board_info(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*board;
 	
-	if(!wd_account_board_set_board_info(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	board = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	
 	if(!wd_boards_has_board_with_name(board)) {
@@ -1351,12 +1282,6 @@ static void wd_message_board_set_board_info(wd_user_t *user, wi_p7_message_t *me
 static void wd_message_board_add_thread(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*board, *subject, *text;
 	
-	if(!wd_account_board_add_threads(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	board = wi_p7_message_string_for_name(message, WI_STR("wired.board.board"));
 	
 	if(!wd_boards_has_board_with_name(board)) {
@@ -1411,12 +1336,6 @@ static void wd_message_board_move_thread(wd_user_t *user, wi_p7_message_t *messa
 	wi_string_t		*newboard, *oldboard, *subject;
 	wi_uuid_t		*thread;
 	
-	if(!wd_account_board_move_threads(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	newboard = wi_p7_message_string_for_name(message, WI_STR("wired.board.new_board"));
 	
 	if(!wd_boards_has_board_with_name(newboard)) {
@@ -1472,12 +1391,6 @@ static void wd_message_board_add_post(wd_user_t *user, wi_p7_message_t *message)
 	wi_string_t		*subject, *text, *board;
 	wi_uuid_t		*thread;
 	
-	if(!wd_account_board_add_posts(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	thread		= wi_p7_message_uuid_for_name(message, WI_STR("wired.board.thread"));
 	text		= wi_p7_message_string_for_name(message, WI_STR("wired.board.text"));
 
@@ -1551,12 +1464,6 @@ static void wd_message_board_delete_post(wd_user_t *user, wi_p7_message_t *messa
 
 
 static void wd_message_board_subscribe_boards(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_board_read_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	if(wd_user_is_subscribed_boards(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.already_subscribed"), message);
 		
@@ -1571,12 +1478,6 @@ static void wd_message_board_subscribe_boards(wd_user_t *user, wi_p7_message_t *
 
 
 static void wd_message_board_unsubscribe_boards(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_board_read_boards(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	if(!wd_user_is_subscribed_boards(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.not_subscribed"), message);
 		
@@ -2130,12 +2031,6 @@ static void wd_message_file_create_directory(wd_user_t *user, wi_p7_message_t *m
 static void wd_message_file_search(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*query;
 	
-	if(!wd_account_file_search_files(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	query = wi_p7_message_string_for_name(message, WI_STR("wired.file.query"));
 	
 	if(wd_index_search(query, user, message)) {
@@ -2188,12 +2083,6 @@ static void wd_message_file_preview_file(wd_user_t *user, wi_p7_message_t *messa
 static void wd_message_file_subscribe_directory(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*path, *realpath;
 	
-	if(!wd_account_file_list_files(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	path		= wi_p7_message_string_for_name(message, WI_STR("wired.file.path"));
 	realpath	= wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
 	
@@ -2212,12 +2101,6 @@ static void wd_message_file_subscribe_directory(wd_user_t *user, wi_p7_message_t
 static void wd_message_file_unsubscribe_directory(wd_user_t *user, wi_p7_message_t *message) {
 	wi_string_t		*path, *realpath;
 	
-	if(!wd_account_file_list_files(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	path		= wi_p7_message_string_for_name(message, WI_STR("wired.file.path"));
 	realpath	= wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
 	
@@ -2263,12 +2146,6 @@ static void wd_message_account_change_password(wd_user_t *user, wi_p7_message_t
 
 
 static void wd_message_account_list_users(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_account_list_accounts(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	if(wd_accounts_reply_user_list(user, message))
 		wd_events_add_event(WI_STR("wired.event.account.listed_users"), user, NULL);
 }
@@ -2276,12 +2153,6 @@ static void wd_message_account_list_users(wd_user_t *user, wi_p7_message_t *mess
 
 
 static void wd_message_account_list_groups(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_account_list_accounts(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	if(wd_accounts_reply_group_list(user, message))
 		wd_events_add_event(WI_STR("wired.event.account.listed_groups"), user, NULL);
 }
@@ -2569,12 +2440,6 @@ static void wd_message_account_delete_user(wd_user_t *user, wi_p7_message_t *mes
 static void wd_message_account_delete_group(wd_user_t *user, wi_p7_message_t *message) {
 	wd_account_t		*account;
 	
-	if(!wd_account_account_delete_groups(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	account = wd_accounts_read_group(wi_p7_message_string_for_name(message, WI_STR("wired.account.name")));
 	
 	if(!account) {
@@ -2594,12 +2459,6 @@ static void wd_message_account_delete_group(wd_user_t *user, wi_p7_message_t *me
 
 
 static void wd_message_account_subscribe_accounts(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_account_list_accounts(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	if(wd_user_is_subscribed_accounts(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.already_subscribed"), message);
 		
@@ -2614,12 +2473,6 @@ static void wd_message_account_subscribe_accounts(wd_user_t *user, wi_p7_message
 
 
 static void wd_message_account_unsubscribe_accounts(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_account_list_accounts(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	if(!wd_user_is_subscribed_accounts(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.not_subscribed"), message);
 		
@@ -2638,7 +2491,7 @@ static void wd_message_transfer_download_file(wd_user_t *user, wi_p7_message_t *
 	wd_account_t			*account;
 	wd_files_privileges_t	*privileges;
 	wd_transfer_t			*transfer;
-	wi_p7_uint64_t			dataoffset, rsrcoffset;
+	wi_p7_uint64_t			dataoffset, rsrcoffset, datalength;
 	
 	account = wd_user_account(user);
 	
@@ -2668,7 +2521,95 @@ static void wd_message_transfer_download_file(wd_user_t *user, wi_p7_message_t *
 	wi_p7_message_get_uint64_for_name(message, &dataoffset, WI_STR("wired.transfer.data_offset"));
 	wi_p7_message_get_uint64_for_name(message, &rsrcoffset, WI_STR("wired.transfer.rsrc_offset"));
 	
-	transfer = wd_transfer_download_transfer(path, dataoffset, rsrcoffset, user, message);
+	if(!wi_p7_message_get_uint64_for_name(message, &datalength, WI_STR("wired.transfer.data_length")))
+		datalength = 0;
+	
+	transfer = wd_transfer_download_transfer(path, dataoffset, rsrcoffset, datalength, user, message);
+	
+	if(transfer) {
+		path = wd_files_virtual_path(path, user);
+		
+		wd_user_set_transfer(user, transfer);
+		
+		wd_events_add_event(WI_STR("wired.event.transfer.started_file_download"), user,
+			path, NULL);
+		
+		if(wd_transfers_run_transfer(transfer, user, message)) {
+			wd_events_add_event(WI_STR("wired.event.transfer.completed_file_download"), user,
+				path,
+				wi_string_with_format(WI_STR("%llu"), transfer->actualtransferred),
+				NULL);
+		} else {
+			wd_events_add_event(WI_STR("wired.event.transfer.stopped_file_download"), user,
+				path,
+				wi_string_with_format(WI_STR("%llu"), transfer->actualtransferred),
+				NULL);
+			
+			wd_user_set_state(user, WD_USER_DISCONNECTED);
+		}
+		
+		wd_user_set_transfer(user, NULL);
+	}
+}
+
+
+
+static void wd_message_transfer_download_directory(wd_user_t *user, wi_p7_message_t *message) {
+	wi_string_t				*path, *realpath, *resumepath;
+	wd_account_t			*account;
+	wd_files_privileges_t	*privileges;
+	wd_transfer_t			*transfer;
+	wi_p7_uint64_t			dataoffset, rsrcoffset;
+	wi_boolean_t			directory;
+	
+	account = wd_user_account(user);
+	
+	if(!wd_account_transfer_download_files(account)) {
+		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
+		
+		return;
+	}
+	
+	path = wi_p7_message_string_for_name(message, WI_STR("wired.file.path"));
+
+	if(!wd_files_path_is_valid(path)) {
+		wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+
+		return;
+	}
+	
+	path		= wi_string_by_normalizing_path(path);
+	privileges	= wd_files_privileges(path, user);
+	
+	if(privileges && !wd_files_privileges_is_readable_by_account(privileges, account)) {
+		wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+
+		return;
+	}
+	
+	realpath = wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
+	
+	if(!wi_fs_path_exists(realpath, &directory) || !directory) {
+		wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+
+		return;
+	}
+	
+	resumepath = wi_p7_message_string_for_name(message, WI_STR("wired.transfer.resume_path"));
+	
+	if(resumepath && !wd_files_path_is_valid(resumepath)) {
+		wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+
+		return;
+	}
+	
+	if(!wi_p7_message_get_uint64_for_name(message, &dataoffset, WI_STR("wired.transfer.data_offset")))
+		dataoffset = 0;
+	
+	if(!wi_p7_message_get_uint64_for_name(message, &rsrcoffset, WI_STR("wired.transfer.rsrc_offset")))
+		rsrcoffset = 0;
+	
+	transfer = wd_transfer_download_directory_transfer(path, resumepath, dataoffset, rsrcoffset, user, message);
 	
 	if(transfer) {
 		path = wd_files_virtual_path(path, user);
@@ -2835,27 +2776,152 @@ static void wd_message_transfer_upload_directory(wd_user_t *user, wi_p7_message_
 
 
 
-static void wd_message_log_get_log(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_log_view_log(wd_user_account(user))) {
+static void wd_message_transfer_upload_batch(wd_user_t *user, wi_p7_message_t *message) {
+	wi_string_t				*path, *realpath;
+	wi_array_t				*directories;
+	wd_account_t			*account;
+	wd_files_privileges_t	*privileges;
+	wd_transfer_t			*transfer;
+	wi_file_offset_t		datasize, rsrcsize;
+	wi_p7_uint32_t			filecount;
+	wi_boolean_t			directory;
+	
+	path = wi_p7_message_string_for_name(message, WI_STR("wired.file.path"));
+
+	if(!wd_files_path_is_valid(path)) {
+		wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+
+		return;
+	}
+	
+	account		= wd_user_account(user);
+	path		= wi_string_by_normalizing_path(path);
+	privileges	= wd_files_privileges(path, user);
+	
+	if(privileges && !wd_files_privileges_is_writable_by_account(privileges, account)) {
 		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
 		
 		return;
 	}
+	
+	realpath = wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
+	
+	if(!wi_fs_path_exists(realpath, &directory) || !directory) {
+		wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
 
-	wd_server_log_reply_log(user, message);
+		return;
+	}
 
-	wd_events_add_event(WI_STR("wired.event.log.got_log"), user, NULL);
-}
+	switch(wd_files_type(realpath)) {
+		case WD_FILE_TYPE_UPLOADS:
+		case WD_FILE_TYPE_DROPBOX:
+			if(!wd_account_transfer_upload_files(account)) {
+				wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
 
+				return;
+			}
+			break;
 
+		default:
+			if(!wd_account_transfer_upload_anywhere(account)) {
+				wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
 
-static void wd_message_log_subscribe(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_log_view_log(wd_user_account(user))) {
+				return;
+			}
+			break;
+	}
+	
+	directories = wi_p7_message_list_for_name(message, WI_STR("wired.transfer.directories"));
+	
+	if(!directories)
+		directories = wi_array();
+	
+	if(wi_array_count(directories) > 0 && !wd_account_transfer_upload_directories(account)) {
 		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
+
+		return;
+	}
+	
+	wi_p7_message_get_uint32_for_name(message, &filecount, WI_STR("wired.transfer.file_count"));
+	wi_p7_message_get_uint64_for_name(message, &datasize, WI_STR("wired.transfer.data_size"));
+	
+	if(!wi_p7_message_get_uint64_for_name(message, &rsrcsize, WI_STR("wired.transfer.rsrc_size")))
+		rsrcsize = 0;
+
+	transfer = wd_transfer_upload_batch_transfer(path, directories, filecount, datasize, rsrcsize, user, message);
+	
+	if(transfer) {
+		path = wd_files_virtual_path(path, user);
+		
+		wd_user_set_transfer(user, transfer);
+		
+		wd_events_add_event(WI_STR("wired.event.transfer.started_file_upload"), user,
+			path, NULL);
+		
+		if(wd_transfers_run_transfer(transfer, user, message)) {
+			wd_events_add_event(WI_STR("wired.event.transfer.completed_file_upload"), user,
+				path,
+				wi_string_with_format(WI_STR("%llu"), transfer->actualtransferred),
+				NULL);
+		} else {
+			wd_events_add_event(WI_STR("wired.event.transfer.stopped_file_upload"), user,
+				path,
+				wi_string_with_format(WI_STR("%llu"), transfer->actualtransferred),
+				NULL);
+			
+			wd_user_set_state(user, WD_USER_DISCONNECTED);
+		}
+
+		wd_user_set_transfer(user, NULL);
+	}
+}
+
+
+
+static void wd_message_transfer_get_channel(wd_user_t *user, wi_p7_message_t *message) {
+	wi_p7_message_t		*reply;
+	
+	reply = wi_p7_message_with_name(WI_STR("wired.transfer.channel"), wd_p7_spec);
+	wi_p7_message_set_uuid_for_name(reply, wd_channels_create_token(user), WI_STR("wired.transfer.channel"));
+	wd_user_reply_message(user, reply, message);
+}
+
+
+
+static void wd_message_transfer_join_channel(wd_user_t *user, wi_p7_message_t *message) {
+	wi_p7_message_t		*reply;
+	wd_user_t			*session;
+	
+	session = wd_channels_join_session(user, wi_p7_message_uuid_for_name(message, WI_STR("wired.transfer.channel")));
+	
+	if(!session) {
+		wd_user_reply_error(user, WI_STR("wired.error.login_failed"), message);
+		
+		wi_log_info(WI_STR("Channel from %@ failed: Invalid token"),
+			wd_user_identifier(user));
 		
 		return;
 	}
+	
+	wi_log_info(WI_STR("Channel from %@ joined session of %@"),
+		wd_user_identifier(user), wd_user_identifier(session));
+	
+	reply = wi_p7_message_with_name(WI_STR("wired.login"), wd_p7_spec);
+	wi_p7_message_set_uint32_for_name(reply, wd_user_id(user), WI_STR("wired.user.id"));
+	wd_user_reply_message(user, reply, message);
+}
+
+
 
+static void wd_message_log_get_log(wd_user_t *user, wi_p7_message_t *message) {
+	wd_server_log_reply_log(user, message);
+
+	wd_events_add_event(WI_STR("wired.event.log.got_log"), user, NULL);
+}
+
+
+
+static void wd_message_log_subscribe(wd_user_t *user, wi_p7_message_t *message) {
 	if(wd_user_is_subscribed_log(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.already_subscribed"), message);
 		
@@ -2870,12 +2936,6 @@ static void wd_message_log_subscribe(wd_user_t *user, wi_p7_message_t *message)
 
 
 static void wd_message_log_unsubscribe(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_log_view_log(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	if(!wd_user_is_subscribed_log(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.not_subscribed"), message);
 		
@@ -2890,12 +2950,6 @@ static void wd_message_log_unsubscribe(wd_user_t *user, wi_p7_message_t *message
 
 
 static void wd_message_event_get_first_time(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_events_view_events(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wd_events_reply_first_time(user, message);
 }
 
@@ -2905,12 +2959,6 @@ static void wd_message_event_get_events(wd_user_t *user, wi_p7_message_t *messag
 	wi_date_t		*fromtime;
 	wi_p7_uint32_t	numberofdays, lasteventcount;
 	
-	if(!wd_account_events_view_events(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	fromtime = wi_p7_message_date_for_name(message, WI_STR("wired.event.from_time"));
 	
 	if(!wi_p7_message_get_uint32_for_name(message, &numberofdays, WI_STR("wired.event.number_of_days")))
@@ -2927,12 +2975,6 @@ static void wd_message_event_get_events(wd_user_t *user, wi_p7_message_t *messag
 
 
 static void wd_message_event_subscribe(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_events_view_events(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	if(wd_user_is_subscribed_events(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.already_subscribed"), message);
 		
@@ -2947,12 +2989,6 @@ static void wd_message_event_subscribe(wd_user_t *user, wi_p7_message_t *message
 
 
 static void wd_message_event_unsubscribe(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_events_view_events(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	if(!wd_user_is_subscribed_events(user)) {
 		wd_user_reply_error(user, WI_STR("wired.error.not_subscribed"), message);
 		
@@ -2967,12 +3003,6 @@ static void wd_message_event_unsubscribe(wd_user_t *user, wi_p7_message_t *messa
 
 
 static void wd_message_settings_get_settings(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_settings_get_settings(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	wd_settings_reply_settings(user, message);
 
 	wd_events_add_event(WI_STR("wired.event.settings.got_settings"), user, NULL);
@@ -2981,12 +3011,6 @@ static void wd_message_settings_get_settings(wd_user_t *user, wi_p7_message_t *m
 
 
 static void wd_message_settings_set_settings(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_settings_set_settings(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-
 	if(wd_settings_set_settings(user, message)) {
 		wd_user_reply_okay(user, message);
 
@@ -2997,12 +3021,6 @@ static void wd_message_settings_set_settings(wd_user_t *user, wi_p7_message_t *m
 
 
 static void wd_message_banlist_get_bans(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_account_banlist_get_bans(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	wd_banlist_reply_bans(user, message);
 
 	wd_events_add_event(WI_STR("wired.event.banlist.got_bans"), user, NULL);
@@ -3014,12 +3032,6 @@ static void wd_message_banlist_add_ban(wd_user_t *user, wi_p7_message_t *message
 	wi_string_t		*ip;
 	wi_date_t		*expiration_date;
 	
-	if(!wd_account_banlist_add_bans(wd_user_account(user))) {
-		wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
-		
-		return;
-	}
-	
 	ip					= wi_p7_message_string_for_name(message, WI_STR("wired.banlist.ip"));
 	expiration_date		= wi_p7_message_date_for_name(message, WI_STR("wired.banlist.expiration_date"));
 	
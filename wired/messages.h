@@ -35,7 +35,10 @@
 
 void							wd_messages_initialize(void);
 
-void							wd_messages_loop_for_user(wd_user_t *);
+wi_p7_message_t *				wd_messages_read_message_for_user(wd_user_t *, wi_time_interval_t);
+void							wd_messages_process_message_for_user(wd_user_t *, wi_p7_message_t *);
+wi_boolean_t					wd_messages_message_holds_socket(wi_p7_message_t *);
+void							wd_messages_disconnect_user(wd_user_t *);
 void							wd_messages_handle_message(wi_p7_message_t *, wd_user_t *);
 
 #endif /* WD_P7_COMMANDS_H */
@@ -0,0 +1,189 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <wired/wired.h>
+
+#include "main.h"
+#include "metrics.h"
+
+#define WD_METRICS_INTERVAL				10.0
+
+
+static void								wd_metrics_update(wi_timer_t *);
+
+
+static const char						*wd_metrics_names[] = {
+	"handler.threads",
+	"handler.queued",
+	"handler.jobs",
+	"handler.queue_wait_usec",
+	"handler.queue_wait_max_usec",
+	"send.queued",
+	"send.queue_max",
+	"send.dropped",
+	"send.coalesced",
+	"send.disconnected",
+	"connections.accepted",
+	"connections.queued",
+	"connections.rejected",
+	"connections.expired",
+	"connections.handshaking",
+	"timeouts.pending",
+	"timeouts.expired",
+	"tracker.received",
+	"tracker.sent",
+	"tracker.dropped",
+	"tracker.received_per_second",
+	"cache.hits",
+	"cache.misses",
+	"cache.evictions",
+	"cache.invalidations",
+	"cache.files",
+	"cache.bytes",
+	"transfers.download_slots",
+	"transfers.upload_slots",
+	"transfers.download_bytes_per_second",
+	"transfers.upload_bytes_per_second",
+	"transfers.download_disk_wait_percent",
+	"transfers.upload_disk_wait_percent",
+	"transfers.download_socket_wait_percent",
+	"transfers.upload_socket_wait_percent",
+	"transfers.slots_added",
+	"transfers.slots_removed",
+};
+
+static uint64_t							wd_metrics_values[WD_METRIC_LAST];
+static wi_lock_t						*wd_metrics_lock;
+static wi_timer_t						*wd_metrics_timer;
+
+
+
+void wd_metrics_initialize(void) {
+	wd_metrics_lock = wi_lock_init(wi_lock_alloc());
+
+	wd_metrics_timer = wi_timer_init_with_function(wi_timer_alloc(),
+												   wd_metrics_update,
+												   WD_METRICS_INTERVAL,
+												   true);
+}
+
+
+
+void wd_metrics_schedule(void) {
+	wd_metrics_write();
+	
+	wi_timer_schedule(wd_metrics_timer);
+}
+
+
+
+void wd_metrics_cleanup(void) {
+	wi_string_t		*path;
+	
+	path = WI_STR("wired.metrics");
+	
+	if(!wi_fs_delete_path(path))
+		wi_log_error(WI_STR("Could not delete \"%@\": %m"), path);
+}
+
+
+
+#pragma mark -
+
+static void wd_metrics_update(wi_timer_t *timer) {
+	wd_metrics_write();
+}
+
+
+
+#pragma mark -
+
+void wd_metrics_add(wd_metric_t metric, int64_t value) {
+	wi_lock_lock(wd_metrics_lock);
+	wd_metrics_values[metric] += value;
+	wi_lock_unlock(wd_metrics_lock);
+}
+
+
+
+void wd_metrics_set(wd_metric_t metric, uint64_t value) {
+	wi_lock_lock(wd_metrics_lock);
+	wd_metrics_values[metric] = value;
+	wi_lock_unlock(wd_metrics_lock);
+}
+
+
+
+void wd_metrics_set_max(wd_metric_t metric, uint64_t value) {
+	wi_lock_lock(wd_metrics_lock);
+	
+	if(value > wd_metrics_values[metric])
+		wd_metrics_values[metric] = value;
+
+	wi_lock_unlock(wd_metrics_lock);
+}
+
+
+
+uint64_t wd_metrics_value(wd_metric_t metric) {
+	uint64_t		value;
+	
+	wi_lock_lock(wd_metrics_lock);
+	value = wd_metrics_values[metric];
+	wi_lock_unlock(wd_metrics_lock);
+	
+	return value;
+}
+
+
+
+#pragma mark -
+
+void wd_metrics_write(void) {
+	wi_mutable_string_t		*string;
+	wi_string_t				*path;
+	uint64_t				values[WD_METRIC_LAST];
+	wi_uinteger_t			i;
+	
+	wi_lock_lock(wd_metrics_lock);
+	memcpy(values, wd_metrics_values, sizeof(values));
+	wi_lock_unlock(wd_metrics_lock);
+	
+	string = wi_mutable_string();
+	
+	for(i = 0; i < WD_METRIC_LAST; i++)
+		wi_mutable_string_append_format(string, WI_STR("%s %llu\n"), wd_metrics_names[i], values[i]);
+	
+	path = WI_STR("wired.metrics");
+
+	if(!wi_string_write_to_file(string, path))
+		wi_log_error(WI_STR("Could not write to \"%@\": %m"), path);
+}
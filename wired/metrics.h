@@ -0,0 +1,89 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WD_METRICS_H
+#define WD_METRICS_H 1
+
+#include <wired/wired.h>
+
+enum _wd_metric {
+	WD_METRIC_HANDLER_THREADS			= 0,
+	WD_METRIC_HANDLER_QUEUED,
+	WD_METRIC_HANDLER_JOBS,
+	WD_METRIC_HANDLER_QUEUE_WAIT,
+	WD_METRIC_HANDLER_QUEUE_WAIT_MAX,
+	WD_METRIC_SEND_QUEUED,
+	WD_METRIC_SEND_QUEUE_MAX,
+	WD_METRIC_SEND_DROPPED,
+	WD_METRIC_SEND_COALESCED,
+	WD_METRIC_SEND_DISCONNECTED,
+	WD_METRIC_CONNECTIONS_ACCEPTED,
+	WD_METRIC_CONNECTIONS_QUEUED,
+	WD_METRIC_CONNECTIONS_REJECTED,
+	WD_METRIC_CONNECTIONS_EXPIRED,
+	WD_METRIC_CONNECTIONS_HANDSHAKING,
+	WD_METRIC_TIMEOUTS_PENDING,
+	WD_METRIC_TIMEOUTS_EXPIRED,
+	WD_METRIC_TRACKER_RECEIVED,
+	WD_METRIC_TRACKER_SENT,
+	WD_METRIC_TRACKER_DROPPED,
+	WD_METRIC_TRACKER_RECEIVE_RATE,
+	WD_METRIC_CACHE_HITS,
+	WD_METRIC_CACHE_MISSES,
+	WD_METRIC_CACHE_EVICTIONS,
+	WD_METRIC_CACHE_INVALIDATIONS,
+	WD_METRIC_CACHE_FILES,
+	WD_METRIC_CACHE_BYTES,
+	WD_METRIC_TRANSFER_DOWNLOAD_SLOTS,
+	WD_METRIC_TRANSFER_UPLOAD_SLOTS,
+	WD_METRIC_TRANSFER_DOWNLOAD_RATE,
+	WD_METRIC_TRANSFER_UPLOAD_RATE,
+	WD_METRIC_TRANSFER_DOWNLOAD_DISK_WAIT,
+	WD_METRIC_TRANSFER_UPLOAD_DISK_WAIT,
+	WD_METRIC_TRANSFER_DOWNLOAD_SOCKET_WAIT,
+	WD_METRIC_TRANSFER_UPLOAD_SOCKET_WAIT,
+	WD_METRIC_TRANSFER_SLOTS_ADDED,
+	WD_METRIC_TRANSFER_SLOTS_REMOVED,
+	
+	WD_METRIC_LAST
+};
+typedef enum _wd_metric					wd_metric_t;
+
+
+void									wd_metrics_initialize(void);
+void									wd_metrics_schedule(void);
+void									wd_metrics_cleanup(void);
+
+void									wd_metrics_add(wd_metric_t, int64_t);
+void									wd_metrics_set(wd_metric_t, uint64_t);
+void									wd_metrics_set_max(wd_metric_t, uint64_t);
+uint64_t								wd_metrics_value(wd_metric_t);
+
+void									wd_metrics_write(void);
+
+#endif /* WD_METRICS_H */
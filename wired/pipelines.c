@@ -0,0 +1,745 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#if defined(HAVE_FALLOCATE) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <wired/wired.h>
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#include "pipelines.h"
+#include "settings.h"
+
+#define WD_PIPELINE_BUFFERS				4
+#define WD_PIPELINE_MIN_BUFFER_SIZE		65536
+
+#define WD_PIPELINE_IOPRIO_WHO_PROCESS	1
+#define WD_PIPELINE_IOPRIO_CLASS_SHIFT	13
+#define WD_PIPELINE_IOPRIO_CLASS_BE		2
+#define WD_PIPELINE_IOPRIO_CLASS_IDLE	3
+#define WD_PIPELINE_IOPRIO(class, data)	(((class) << WD_PIPELINE_IOPRIO_CLASS_SHIFT) | (data))
+
+
+enum _wd_pipeline_direction {
+	WD_PIPELINE_READ					= 0,
+	WD_PIPELINE_WRITE
+};
+typedef enum _wd_pipeline_direction		wd_pipeline_direction_t;
+
+
+struct _wd_pipelines_volume {
+	wi_runtime_base_t					base;
+	
+	wi_condition_lock_t					*lock;
+	wi_uinteger_t						readers;
+};
+typedef struct _wd_pipelines_volume		wd_pipelines_volume_t;
+
+
+struct _wd_pipeline {
+	wi_runtime_base_t					base;
+	
+	wd_pipeline_direction_t				direction;
+	int									fd;
+	wi_file_offset_t					remaining;
+	wd_pipelines_volume_t				*volume;
+	
+	char								*buffers;
+	ssize_t								lengths[WD_PIPELINE_BUFFERS];
+	size_t								size;
+	
+	wi_uinteger_t						producer, consumer;
+	wi_uinteger_t						free, filled;
+	wi_boolean_t						holding;
+	size_t								offset;
+	
+	wi_condition_lock_t					*free_lock;
+	wi_condition_lock_t					*filled_lock;
+	wi_condition_lock_t					*finished_lock;
+	
+	wi_time_interval_t					synctime;
+	wi_boolean_t						unsynced;
+	
+	wi_boolean_t						threaded;
+	wi_boolean_t						cancelled;
+	wi_boolean_t						closed;
+	int									error;
+};
+
+
+static wd_pipelines_volume_t *			wd_pipelines_volume_for_fd(int);
+static void								wd_pipelines_volume_dealloc(wi_runtime_instance_t *);
+static void								wd_pipelines_volume_lock_read(wd_pipelines_volume_t *);
+static void								wd_pipelines_volume_unlock_read(wd_pipelines_volume_t *);
+
+static wd_pipeline_t *					wd_pipeline_init(wd_pipeline_t *, wd_pipeline_direction_t, int);
+static void								wd_pipeline_dealloc(wi_runtime_instance_t *);
+
+static void								wd_pipeline_read_thread(wi_runtime_instance_t *);
+static void								wd_pipeline_write_thread(wi_runtime_instance_t *);
+static ssize_t							wd_pipeline_fill(wd_pipeline_t *, char *);
+static wi_boolean_t						wd_pipeline_drain(wd_pipeline_t *, const char *, size_t);
+static wi_boolean_t						wd_pipeline_sync(wd_pipeline_t *);
+
+static wi_boolean_t						wd_pipeline_wait_free(wd_pipeline_t *);
+static void								wd_pipeline_post_free(wd_pipeline_t *);
+static void								wd_pipeline_wait_filled(wd_pipeline_t *);
+static void								wd_pipeline_post_filled(wd_pipeline_t *, ssize_t);
+static void								wd_pipeline_finish(wd_pipeline_t *);
+static void								wd_pipeline_commit(wd_pipeline_t *);
+static void								wd_pipeline_set_error(wd_pipeline_t *, int);
+static int								wd_pipeline_error(wd_pipeline_t *);
+
+
+static size_t							wd_pipelines_buffer_size;
+static wi_time_interval_t				wd_pipelines_sync_interval;
+static int								wd_pipelines_io_priority;
+static wi_uinteger_t					wd_pipelines_volume_reads;
+
+static wi_lock_t						*wd_pipelines_volumes_lock;
+static wi_mutable_dictionary_t			*wd_pipelines_volumes;
+
+static wi_runtime_id_t					wd_pipelines_volume_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_pipelines_volume_runtime_class = {
+	"wd_pipelines_volume_t",
+	wd_pipelines_volume_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+static wi_runtime_id_t					wd_pipeline_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_pipeline_runtime_class = {
+	"wd_pipeline_t",
+	wd_pipeline_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+
+
+void wd_pipelines_initialize(void) {
+	wd_pipeline_runtime_id = wi_runtime_register_class(&wd_pipeline_runtime_class);
+	wd_pipelines_volume_runtime_id = wi_runtime_register_class(&wd_pipelines_volume_runtime_class);
+	
+	wd_pipelines_volumes_lock = wi_lock_init(wi_lock_alloc());
+	wd_pipelines_volumes = wi_dictionary_init(wi_mutable_dictionary_alloc());
+}
+
+
+
+void wd_pipelines_apply_settings(wi_set_t *changes) {
+	wi_string_t		*priority;
+	
+	wd_pipelines_buffer_size = WI_MAX(WD_PIPELINE_MIN_BUFFER_SIZE,
+		wi_config_integer_for_name(wd_config, WI_STR("transfer buffer size")));
+	wd_pipelines_sync_interval = wi_config_time_interval_for_name(wd_config, WI_STR("transfer sync interval"));
+	wd_pipelines_volume_reads = wi_config_integer_for_name(wd_config, WI_STR("transfer reads per volume"));
+	
+	priority = wi_config_string_for_name(wd_config, WI_STR("transfer io priority"));
+	
+	if(wi_is_equal(priority, WI_STR("idle"))) {
+		wd_pipelines_io_priority = WD_PIPELINE_IOPRIO(WD_PIPELINE_IOPRIO_CLASS_IDLE, 0);
+	}
+	else if(wi_is_equal(priority, WI_STR("normal"))) {
+		wd_pipelines_io_priority = 0;
+	}
+	else {
+		if(!wi_is_equal(priority, WI_STR("low")))
+			wi_log_warn(WI_STR("Unknown transfer io priority \"%@\", using \"low\""), priority);
+		
+		wd_pipelines_io_priority = WD_PIPELINE_IOPRIO(WD_PIPELINE_IOPRIO_CLASS_BE, 7);
+	}
+}
+
+
+
+#pragma mark -
+
+void wd_pipelines_set_transfer_io_priority(wi_boolean_t transfer) {
+#if defined(HAVE_SYS_SYSCALL_H) && defined(SYS_ioprio_set)
+	/* The priority applies to the calling thread only, and handler threads must get theirs back */
+	if(transfer && wd_pipelines_io_priority == 0)
+		return;
+	
+	(void) syscall(SYS_ioprio_set, WD_PIPELINE_IOPRIO_WHO_PROCESS, 0, transfer ? wd_pipelines_io_priority : 0);
+#endif
+}
+
+
+
+static wd_pipelines_volume_t * wd_pipelines_volume_for_fd(int fd) {
+	wd_pipelines_volume_t	*volume;
+	wi_number_t				*key;
+	struct stat				sb;
+	
+	if(fstat(fd, &sb) < 0)
+		return NULL;
+	
+	key = wi_number_with_int64(sb.st_dev);
+	
+	wi_lock_lock(wd_pipelines_volumes_lock);
+	
+	volume = wi_dictionary_data_for_key(wd_pipelines_volumes, key);
+	
+	if(!volume) {
+		volume			= wi_runtime_create_instance(wd_pipelines_volume_runtime_id, sizeof(wd_pipelines_volume_t));
+		volume->lock	= wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 1);
+		
+		wi_mutable_dictionary_set_data_for_key(wd_pipelines_volumes, volume, key);
+		wi_release(volume);
+	}
+	
+	wi_retain(volume);
+	
+	wi_lock_unlock(wd_pipelines_volumes_lock);
+	
+	return volume;
+}
+
+
+
+static void wd_pipelines_volume_dealloc(wi_runtime_instance_t *instance) {
+	wd_pipelines_volume_t		*volume = instance;
+	
+	wi_release(volume->lock);
+}
+
+
+
+static void wd_pipelines_volume_lock_read(wd_pipelines_volume_t *volume) {
+	wi_condition_lock_lock_when_condition(volume->lock, 1, 0.0);
+	volume->readers++;
+	wi_condition_lock_unlock_with_condition(volume->lock,
+		(wd_pipelines_volume_reads == 0 || volume->readers < wd_pipelines_volume_reads) ? 1 : 0);
+}
+
+
+
+static void wd_pipelines_volume_unlock_read(wd_pipelines_volume_t *volume) {
+	wi_condition_lock_lock(volume->lock);
+	volume->readers--;
+	wi_condition_lock_unlock_with_condition(volume->lock,
+		(wd_pipelines_volume_reads == 0 || volume->readers < wd_pipelines_volume_reads) ? 1 : 0);
+}
+
+
+
+#pragma mark -
+
+void wd_pipelines_prefetch(int fd, wi_file_offset_t offset) {
+#ifdef HAVE_POSIX_FADVISE
+	(void) posix_fadvise(fd, offset, wd_pipelines_buffer_size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+
+
+wi_boolean_t wd_pipelines_preallocate(int fd, wi_file_offset_t offset, wi_file_offset_t length) {
+	if(length == 0)
+		return true;
+	
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	if(fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length) < 0) {
+		if(errno == EOPNOTSUPP || errno == ENOSYS)
+			return true;
+		
+		return false;
+	}
+#endif
+	
+	return true;
+}
+
+
+
+void wd_pipelines_release(int fd) {
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	struct stat		sb;
+	
+	/* Truncating also bumps the modification time, so only do it when blocks are reserved past the end */
+	if(fstat(fd, &sb) == 0 && (off_t) sb.st_blocks * 512 > sb.st_size + sb.st_blksize)
+		(void) ftruncate(fd, sb.st_size);
+#endif
+}
+
+
+
+#pragma mark -
+
+wd_pipeline_t * wd_pipeline_alloc(void) {
+	return wi_runtime_create_instance(wd_pipeline_runtime_id, sizeof(wd_pipeline_t));
+}
+
+
+
+wd_pipeline_t * wd_pipeline_init_for_reading(wd_pipeline_t *pipeline, int fd, wi_file_offset_t size) {
+	pipeline = wd_pipeline_init(pipeline, WD_PIPELINE_READ, fd);
+	pipeline->remaining = size;
+	
+	if(wd_pipelines_volume_reads > 0)
+		pipeline->volume = wd_pipelines_volume_for_fd(fd);
+	
+#ifdef HAVE_POSIX_FADVISE
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+	(void) posix_fadvise(fd, lseek(fd, 0, SEEK_CUR), pipeline->size * WD_PIPELINE_BUFFERS, POSIX_FADV_WILLNEED);
+#endif
+	
+	wi_retain(pipeline);
+	
+	pipeline->threaded = wi_thread_create_thread(wd_pipeline_read_thread, pipeline);
+	
+	if(!pipeline->threaded)
+		wi_release(pipeline);
+	
+	return pipeline;
+}
+
+
+
+wd_pipeline_t * wd_pipeline_init_for_writing(wd_pipeline_t *pipeline, int fd) {
+	pipeline = wd_pipeline_init(pipeline, WD_PIPELINE_WRITE, fd);
+	pipeline->synctime = wi_time_interval();
+	
+	wi_retain(pipeline);
+	
+	pipeline->threaded = wi_thread_create_thread(wd_pipeline_write_thread, pipeline);
+	
+	if(!pipeline->threaded)
+		wi_release(pipeline);
+	
+	return pipeline;
+}
+
+
+
+static wd_pipeline_t * wd_pipeline_init(wd_pipeline_t *pipeline, wd_pipeline_direction_t direction, int fd) {
+	pipeline->direction		= direction;
+	pipeline->fd			= fd;
+	pipeline->size			= WI_MAX(WD_PIPELINE_MIN_BUFFER_SIZE, wd_pipelines_buffer_size);
+	pipeline->buffers		= wi_malloc(pipeline->size * WD_PIPELINE_BUFFERS);
+	pipeline->free			= WD_PIPELINE_BUFFERS;
+	
+	pipeline->free_lock		= wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 1);
+	pipeline->filled_lock	= wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
+	pipeline->finished_lock	= wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
+	
+	return pipeline;
+}
+
+
+
+static void wd_pipeline_dealloc(wi_runtime_instance_t *instance) {
+	wd_pipeline_t		*pipeline = instance;
+	
+	wi_free(pipeline->buffers);
+	
+	wi_release(pipeline->volume);
+	wi_release(pipeline->free_lock);
+	wi_release(pipeline->filled_lock);
+	wi_release(pipeline->finished_lock);
+}
+
+
+
+#pragma mark -
+
+ssize_t wd_pipeline_read(wd_pipeline_t *pipeline, const void **buffer) {
+	ssize_t		length;
+	
+	if(!pipeline->threaded) {
+		length = wd_pipeline_fill(pipeline, pipeline->buffers);
+		*buffer = pipeline->buffers;
+		
+		return length;
+	}
+	
+	if(pipeline->holding) {
+		pipeline->consumer = (pipeline->consumer + 1) % WD_PIPELINE_BUFFERS;
+		pipeline->holding = false;
+		
+		wd_pipeline_post_free(pipeline);
+	}
+	
+	wd_pipeline_wait_filled(pipeline);
+	
+	length = pipeline->lengths[pipeline->consumer];
+	*buffer = pipeline->buffers + (pipeline->consumer * pipeline->size);
+	pipeline->holding = true;
+	
+	if(length < 0)
+		errno = pipeline->error;
+	
+	return length;
+}
+
+
+
+wi_boolean_t wd_pipeline_write(wd_pipeline_t *pipeline, const void *buffer, size_t length) {
+	size_t		bytes;
+	int			error;
+	
+	if(!pipeline->threaded)
+		return wd_pipeline_drain(pipeline, buffer, length);
+	
+	while(length > 0) {
+		error = wd_pipeline_error(pipeline);
+		
+		if(error) {
+			errno = error;
+			
+			return false;
+		}
+		
+		if(!pipeline->holding) {
+			wd_pipeline_wait_free(pipeline);
+			
+			pipeline->holding	= true;
+			pipeline->offset	= 0;
+		}
+		
+		bytes = WI_MIN(length, pipeline->size - pipeline->offset);
+		
+		memcpy(pipeline->buffers + (pipeline->producer * pipeline->size) + pipeline->offset, buffer, bytes);
+		
+		pipeline->offset	+= bytes;
+		buffer				= (const char *) buffer + bytes;
+		length				-= bytes;
+		
+		if(pipeline->offset == pipeline->size)
+			wd_pipeline_commit(pipeline);
+	}
+	
+	return true;
+}
+
+
+
+wi_boolean_t wd_pipeline_close(wd_pipeline_t *pipeline) {
+	if(pipeline->closed)
+		return (pipeline->error == 0);
+	
+	if(!pipeline->threaded) {
+		pipeline->closed = true;
+		
+		if(pipeline->direction == WD_PIPELINE_WRITE && !pipeline->error)
+			return wd_pipeline_sync(pipeline);
+		
+		return (pipeline->error == 0);
+	}
+	
+	pipeline->closed = true;
+	
+	if(pipeline->direction == WD_PIPELINE_READ) {
+		wi_condition_lock_lock(pipeline->free_lock);
+		pipeline->cancelled = true;
+		wi_condition_lock_unlock_with_condition(pipeline->free_lock, 1);
+	} else {
+		if(pipeline->holding && pipeline->offset > 0)
+			wd_pipeline_commit(pipeline);
+		
+		if(!pipeline->holding)
+			wd_pipeline_wait_free(pipeline);
+		
+		pipeline->holding = false;
+		
+		wd_pipeline_post_filled(pipeline, 0);
+	}
+	
+	wi_condition_lock_lock_when_condition(pipeline->finished_lock, 1, 0.0);
+	wi_condition_lock_unlock(pipeline->finished_lock);
+	
+	if(pipeline->error) {
+		errno = pipeline->error;
+		
+		return false;
+	}
+	
+	return true;
+}
+
+
+
+#pragma mark -
+
+static void wd_pipeline_read_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t			*pool;
+	wd_pipeline_t		*pipeline = argument;
+	ssize_t				length;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	wd_pipelines_set_transfer_io_priority(true);
+	
+	do {
+		if(!wd_pipeline_wait_free(pipeline))
+			break;
+		
+		length = wd_pipeline_fill(pipeline, pipeline->buffers + (pipeline->producer * pipeline->size));
+		
+		wd_pipeline_post_filled(pipeline, length);
+	} while(length > 0);
+	
+	wd_pipeline_finish(pipeline);
+	
+	wi_release(pool);
+	wi_release(pipeline);
+}
+
+
+
+static void wd_pipeline_write_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t			*pool;
+	wd_pipeline_t		*pipeline = argument;
+	ssize_t				length;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	wd_pipelines_set_transfer_io_priority(true);
+	
+	do {
+		wd_pipeline_wait_filled(pipeline);
+		
+		length = pipeline->lengths[pipeline->consumer];
+		
+		if(length > 0 && !pipeline->error)
+			wd_pipeline_drain(pipeline, pipeline->buffers + (pipeline->consumer * pipeline->size), length);
+		
+		if(!pipeline->error && pipeline->unsynced) {
+			if(length == 0 || (wd_pipelines_sync_interval > 0.0 &&
+							   wi_time_interval() - pipeline->synctime >= wd_pipelines_sync_interval))
+				wd_pipeline_sync(pipeline);
+		}
+		
+		pipeline->consumer = (pipeline->consumer + 1) % WD_PIPELINE_BUFFERS;
+		
+		wd_pipeline_post_free(pipeline);
+	} while(length > 0);
+	
+	wd_pipeline_finish(pipeline);
+	
+	wi_release(pool);
+	wi_release(pipeline);
+}
+
+
+
+static ssize_t wd_pipeline_fill(wd_pipeline_t *pipeline, char *buffer) {
+	size_t		length, size;
+	ssize_t		bytes;
+	
+	size = WI_MIN(pipeline->size, pipeline->remaining);
+	
+	if(pipeline->volume)
+		wd_pipelines_volume_lock_read(pipeline->volume);
+	
+	for(length = 0; length < size; length += bytes) {
+		bytes = read(pipeline->fd, buffer + length, size - length);
+		
+		if(bytes < 0) {
+			if(errno == EINTR) {
+				bytes = 0;
+				
+				continue;
+			}
+			
+			wd_pipeline_set_error(pipeline, errno);
+			
+			break;
+		}
+		
+		if(bytes == 0)
+			break;
+	}
+	
+	if(pipeline->volume)
+		wd_pipelines_volume_unlock_read(pipeline->volume);
+	
+	if(pipeline->error)
+		return -1;
+	
+	pipeline->remaining -= length;
+	
+	return length;
+}
+
+
+
+static wi_boolean_t wd_pipeline_drain(wd_pipeline_t *pipeline, const char *buffer, size_t size) {
+	size_t		length;
+	ssize_t		bytes;
+	
+	for(length = 0; length < size; length += bytes) {
+		bytes = write(pipeline->fd, buffer + length, size - length);
+		
+		if(bytes <= 0) {
+			if(bytes < 0 && errno == EINTR) {
+				bytes = 0;
+				
+				continue;
+			}
+			
+			wd_pipeline_set_error(pipeline, (bytes < 0) ? errno : EIO);
+			errno = pipeline->error;
+			
+			return false;
+		}
+	}
+	
+	pipeline->unsynced = true;
+	
+	return true;
+}
+
+
+
+static wi_boolean_t wd_pipeline_sync(wd_pipeline_t *pipeline) {
+	int		result;
+	
+	if(!pipeline->unsynced)
+		return true;
+	
+#ifdef HAVE_FDATASYNC
+	result = fdatasync(pipeline->fd);
+#else
+	result = fsync(pipeline->fd);
+#endif
+	
+	pipeline->synctime	= wi_time_interval();
+	pipeline->unsynced	= false;
+	
+	if(result < 0 && errno != EINVAL) {
+		wd_pipeline_set_error(pipeline, errno);
+		
+		return false;
+	}
+	
+#ifdef HAVE_POSIX_FADVISE
+	/* Synced pages are clean, so drop them rather than let uploads push out pages others are using */
+	(void) posix_fadvise(pipeline->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	
+	return true;
+}
+
+
+
+#pragma mark -
+
+static wi_boolean_t wd_pipeline_wait_free(wd_pipeline_t *pipeline) {
+	wi_boolean_t		cancelled;
+	
+	wi_condition_lock_lock_when_condition(pipeline->free_lock, 1, 0.0);
+	
+	cancelled = pipeline->cancelled;
+	
+	if(!cancelled)
+		pipeline->free--;
+	
+	wi_condition_lock_unlock_with_condition(pipeline->free_lock, (pipeline->free > 0 || pipeline->cancelled) ? 1 : 0);
+	
+	return !cancelled;
+}
+
+
+
+static void wd_pipeline_post_free(wd_pipeline_t *pipeline) {
+	wi_condition_lock_lock(pipeline->free_lock);
+	pipeline->free++;
+	wi_condition_lock_unlock_with_condition(pipeline->free_lock, 1);
+}
+
+
+
+static void wd_pipeline_wait_filled(wd_pipeline_t *pipeline) {
+	wi_condition_lock_lock_when_condition(pipeline->filled_lock, 1, 0.0);
+	pipeline->filled--;
+	wi_condition_lock_unlock_with_condition(pipeline->filled_lock, (pipeline->filled > 0) ? 1 : 0);
+}
+
+
+
+static void wd_pipeline_post_filled(wd_pipeline_t *pipeline, ssize_t length) {
+	pipeline->lengths[pipeline->producer] = length;
+	pipeline->producer = (pipeline->producer + 1) % WD_PIPELINE_BUFFERS;
+	
+	wi_condition_lock_lock(pipeline->filled_lock);
+	pipeline->filled++;
+	wi_condition_lock_unlock_with_condition(pipeline->filled_lock, 1);
+}
+
+
+
+static void wd_pipeline_finish(wd_pipeline_t *pipeline) {
+	wi_condition_lock_lock(pipeline->finished_lock);
+	wi_condition_lock_unlock_with_condition(pipeline->finished_lock, 1);
+}
+
+
+
+static void wd_pipeline_commit(wd_pipeline_t *pipeline) {
+	pipeline->holding = false;
+	
+	wd_pipeline_post_filled(pipeline, pipeline->offset);
+}
+
+
+
+static void wd_pipeline_set_error(wd_pipeline_t *pipeline, int error) {
+	wi_condition_lock_lock(pipeline->free_lock);
+	pipeline->error = error;
+	wi_condition_lock_unlock(pipeline->free_lock);
+}
+
+
+
+static int wd_pipeline_error(wd_pipeline_t *pipeline) {
+	int		error;
+	
+	wi_condition_lock_lock(pipeline->free_lock);
+	error = pipeline->error;
+	wi_condition_lock_unlock(pipeline->free_lock);
+	
+	return error;
+}
@@ -0,0 +1,53 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WD_PIPELINES_H
+#define WD_PIPELINES_H 1
+
+#include <wired/wired.h>
+
+typedef struct _wd_pipeline				wd_pipeline_t;
+
+
+void									wd_pipelines_initialize(void);
+void									wd_pipelines_apply_settings(wi_set_t *);
+
+void									wd_pipelines_set_transfer_io_priority(wi_boolean_t);
+void									wd_pipelines_prefetch(int, wi_file_offset_t);
+wi_boolean_t							wd_pipelines_preallocate(int, wi_file_offset_t, wi_file_offset_t);
+void									wd_pipelines_release(int);
+
+wd_pipeline_t *							wd_pipeline_alloc(void);
+wd_pipeline_t *							wd_pipeline_init_for_reading(wd_pipeline_t *, int, wi_file_offset_t);
+wd_pipeline_t *							wd_pipeline_init_for_writing(wd_pipeline_t *, int);
+
+ssize_t									wd_pipeline_read(wd_pipeline_t *, const void **);
+wi_boolean_t							wd_pipeline_write(wd_pipeline_t *, const void *, size_t);
+wi_boolean_t							wd_pipeline_close(wd_pipeline_t *);
+
+#endif /* WD_PIPELINES_H */
@@ -0,0 +1,675 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wired/wired.h>
+
+#include "main.h"
+#include "messages.h"
+#include "reactor.h"
+#include "server.h"
+#include "users.h"
+#include "workers.h"
+
+#define WD_REACTOR_WAIT_INTERVAL		1.0
+#define WD_REACTOR_MAX_EVENTS			256
+#define WD_REACTOR_READ_TIMEOUT			10.0
+#define WD_REACTOR_MAX_FRAME_WAIT		1048576
+#define WD_REACTOR_MAX_TRAILER			64
+
+
+struct _wd_reactor_backend {
+	const char							*name;
+	
+	wi_boolean_t						(*initialize)(void);
+	wi_boolean_t						(*add)(wd_user_t *, int);
+	wi_boolean_t						(*arm)(wd_user_t *, int);
+	void								(*remove)(wd_user_t *, int);
+	void								(*wait)(wi_time_interval_t);
+};
+typedef struct _wd_reactor_backend		wd_reactor_backend_t;
+
+
+static void								wd_reactor_thread(wi_runtime_instance_t *);
+static void								wd_reactor_read_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+static void								wd_reactor_read_thread(wi_runtime_instance_t *);
+static void								wd_reactor_handle_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+static void								wd_reactor_handle_and_resume_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+static void								wd_reactor_transfer_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+static void								wd_reactor_transfer_thread(wi_runtime_instance_t *);
+static void								wd_reactor_disconnect_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+static void								wd_reactor_resume_user(wd_user_t *);
+static void								wd_reactor_dispatch_user(wd_uid_t);
+static void								wd_reactor_arm_user(wd_user_t *);
+static void								wd_reactor_remove_user(wd_user_t *);
+static void								wd_reactor_drain_wake(void);
+static wi_boolean_t						wd_reactor_peek_frame(int, wi_uinteger_t *, wi_uinteger_t *);
+static wi_boolean_t						wd_reactor_frame_is_ready(wd_user_t *, wi_boolean_t *);
+
+#ifdef HAVE_SYS_EPOLL_H
+static wi_boolean_t						wd_reactor_epoll_initialize(void);
+static wi_boolean_t						wd_reactor_epoll_add(wd_user_t *, int);
+static wi_boolean_t						wd_reactor_epoll_arm(wd_user_t *, int);
+static void								wd_reactor_epoll_remove(wd_user_t *, int);
+static void								wd_reactor_epoll_wait(wi_time_interval_t);
+#endif
+
+static wi_boolean_t						wd_reactor_poll_initialize(void);
+static wi_boolean_t						wd_reactor_poll_add(wd_user_t *, int);
+static wi_boolean_t						wd_reactor_poll_arm(wd_user_t *, int);
+static void								wd_reactor_poll_remove(wd_user_t *, int);
+static void								wd_reactor_poll_wait(wi_time_interval_t);
+
+
+static wd_reactor_backend_t				wd_reactor_backends[] = {
+#ifdef HAVE_SYS_EPOLL_H
+	{	"epoll",
+		wd_reactor_epoll_initialize,
+		wd_reactor_epoll_add,
+		wd_reactor_epoll_arm,
+		wd_reactor_epoll_remove,
+		wd_reactor_epoll_wait },
+#endif
+	{	"poll",
+		wd_reactor_poll_initialize,
+		wd_reactor_poll_add,
+		wd_reactor_poll_arm,
+		wd_reactor_poll_remove,
+		wd_reactor_poll_wait },
+};
+
+static wd_reactor_backend_t				*wd_reactor_backend;
+static wi_lock_t						*wd_reactor_lock;
+static wi_mutable_dictionary_t			*wd_reactor_users;
+static int								wd_reactor_wake_fds[2];
+
+#ifdef HAVE_SYS_EPOLL_H
+static int								wd_reactor_epoll_fd = -1;
+#endif
+
+
+
+void wd_reactor_initialize(void) {
+	wi_uinteger_t		i;
+	
+	wd_reactor_lock = wi_lock_init(wi_lock_alloc());
+	wd_reactor_users = wi_dictionary_init(wi_mutable_dictionary_alloc());
+	
+	if(pipe(wd_reactor_wake_fds) < 0)
+		wi_log_fatal(WI_STR("Could not create reactor pipe: %s"), strerror(errno));
+	
+	for(i = 0; i < 2; i++) {
+		fcntl(wd_reactor_wake_fds[i], F_SETFL, fcntl(wd_reactor_wake_fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(wd_reactor_wake_fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	
+	for(i = 0; i < sizeof(wd_reactor_backends) / sizeof(*wd_reactor_backends); i++) {
+		if((*wd_reactor_backends[i].initialize)()) {
+			wd_reactor_backend = &wd_reactor_backends[i];
+			
+			break;
+		}
+	}
+	
+	if(!wd_reactor_backend)
+		wi_log_fatal(WI_STR("Could not create a reactor: %s"), strerror(errno));
+}
+
+
+
+void wd_reactor_start(void) {
+	if(!wi_thread_create_thread(wd_reactor_thread, NULL))
+		wi_log_fatal(WI_STR("Could not create a reactor thread: %m"));
+}
+
+
+
+#pragma mark -
+
+void wd_reactor_add_user(wd_user_t *user) {
+	wd_user_set_read_time(user, wi_time_interval());
+
+	wi_lock_lock(wd_reactor_lock);
+	
+	wi_mutable_dictionary_set_data_for_key(wd_reactor_users, user, wi_number_with_int32(wd_user_id(user)));
+	
+	if(!(*wd_reactor_backend->add)(user, wi_socket_descriptor(wd_user_socket(user)))) {
+		wi_mutable_dictionary_remove_data_for_key(wd_reactor_users, wi_number_with_int32(wd_user_id(user)));
+		wi_lock_unlock(wd_reactor_lock);
+		
+		wi_log_error(WI_STR("Could not add %@ to reactor: %s"),
+			wd_user_identifier(user), strerror(errno));
+		
+		wd_messages_disconnect_user(user);
+		
+		return;
+	}
+	
+	wi_lock_unlock(wd_reactor_lock);
+}
+
+
+
+wi_boolean_t wd_reactor_expire_user(wd_user_t *user, wi_boolean_t timed_out) {
+	wi_boolean_t		removed;
+	
+	wi_lock_lock(wd_reactor_lock);
+	
+	removed = (wi_dictionary_data_for_key(wd_reactor_users, wi_number_with_int32(wd_user_id(user))) == user);
+	
+	if(removed) {
+		wi_mutable_dictionary_remove_data_for_key(wd_reactor_users, wi_number_with_int32(wd_user_id(user)));
+
+		(*wd_reactor_backend->remove)(user, wi_socket_descriptor(wd_user_socket(user)));
+	}
+	
+	wi_lock_unlock(wd_reactor_lock);
+	
+	if(!removed)
+		return false;
+	
+	if(timed_out) {
+		wi_log_warn(WI_STR("Could not wait for message from %@: %@"),
+			wd_user_identifier(user), WI_STR("Timed out"));
+	}
+	
+	wd_workers_submit(wd_user_queue(user), wd_reactor_disconnect_job, user, NULL);
+	
+	return true;
+}
+
+
+
+void wd_reactor_wake(void) {
+	char		c = 0;
+	
+	(void) write(wd_reactor_wake_fds[1], &c, 1);
+}
+
+
+
+#pragma mark -
+
+static void wd_reactor_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t				*pool;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	while(wd_running) {
+		(*wd_reactor_backend->wait)(WD_REACTOR_WAIT_INTERVAL);
+
+		wi_pool_drain(pool);
+	}
+	
+	wi_release(pool);
+}
+
+
+
+static void wd_reactor_read_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wi_p7_message_t		*message;
+	wd_user_t			*user = argument1;
+	wd_worker_func_t	*func;
+	wi_uinteger_t		before, after, size, trailer;
+	wi_boolean_t		suspend, peeked;
+	int					sd;
+	
+	sd			= wi_socket_descriptor(wd_user_socket(user));
+	peeked		= wd_reactor_peek_frame(sd, &before, &size);
+	message		= wd_messages_read_message_for_user(user, WD_REACTOR_READ_TIMEOUT);
+	
+	/* Whatever was consumed past the frame is the checksum, which the next frames wait for too */
+	if(message && peeked && wd_reactor_peek_frame(sd, &after, NULL) &&
+	   before > after && before - after > sizeof(uint32_t) + size) {
+		trailer = before - after - sizeof(uint32_t) - size;
+		
+		if(trailer > wd_user_read_trailer(user) && trailer <= WD_REACTOR_MAX_TRAILER)
+			wd_user_set_read_trailer(user, trailer);
+	}
+	
+	if(message && !wd_user_read_trailer_known(user))
+		wd_user_set_read_trailer_known(user, true);
+	
+	if(!message) {
+		wd_reactor_remove_user(user);
+		wd_workers_submit(wd_user_queue(user), wd_reactor_disconnect_job, user, NULL);
+		
+		return;
+	}
+	
+	if(wd_messages_message_holds_socket(message)) {
+		wd_workers_submit(wd_user_queue(user), wd_reactor_transfer_job, user, message);
+		
+		return;
+	}
+	
+	suspend = (wd_worker_queue_count(wd_user_queue(user)) + 1 >= wd_workers_queue_depth());
+	func = suspend ? wd_reactor_handle_and_resume_job : wd_reactor_handle_job;
+	
+	wd_workers_submit(wd_user_queue(user), func, user, message);
+	
+	if(!suspend)
+		wd_reactor_arm_user(user);
+}
+
+
+
+static void wd_reactor_read_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t		*pool;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	wd_reactor_read_job(argument, NULL);
+	
+	wi_release(pool);
+}
+
+
+
+static void wd_reactor_handle_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wd_messages_process_message_for_user(argument1, argument2);
+}
+
+
+
+static void wd_reactor_handle_and_resume_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wd_messages_process_message_for_user(argument1, argument2);
+	
+	wd_reactor_resume_user(argument1);
+}
+
+
+
+static void wd_reactor_transfer_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wi_array_t		*array;
+	
+	array = wi_array_with_data(argument1, argument2, NULL);
+	
+	if(!wi_thread_create_thread(wd_reactor_transfer_thread, array)) {
+		wi_log_error(WI_STR("Could not create a transfer thread for %@: %m"),
+			wd_user_identifier(argument1));
+		
+		wd_reactor_handle_and_resume_job(argument1, argument2);
+	}
+}
+
+
+
+static void wd_reactor_transfer_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t		*pool;
+	wi_array_t		*array = argument;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	wd_reactor_handle_and_resume_job(WI_ARRAY(array, 0), WI_ARRAY(array, 1));
+	
+	wi_release(pool);
+}
+
+
+
+static void wd_reactor_disconnect_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wd_messages_disconnect_user(argument1);
+}
+
+
+
+static void wd_reactor_resume_user(wd_user_t *user) {
+	if(wd_user_state(user) == WD_USER_DISCONNECTED) {
+		wd_reactor_remove_user(user);
+		wd_messages_disconnect_user(user);
+	} else {
+		wd_reactor_arm_user(user);
+	}
+}
+
+
+
+static void wd_reactor_dispatch_user(wd_uid_t id) {
+	wd_user_t		*user;
+	wi_boolean_t	blocking;
+	
+	/* Events carry the user id, so a user removed after the wait returned is simply not found */
+	wi_lock_lock(wd_reactor_lock);
+
+	user = wi_retain(wi_dictionary_data_for_key(wd_reactor_users, wi_number_with_int32(id)));
+	
+	if(user)
+		wi_mutable_dictionary_remove_data_for_key(wd_reactor_users, wi_number_with_int32(id));
+	
+	wi_lock_unlock(wd_reactor_lock);
+	
+	if(!user)
+		return;
+	
+	if(!wd_reactor_frame_is_ready(user, &blocking))
+		wd_reactor_arm_user(user);
+	else if(!blocking || !wi_thread_create_thread(wd_reactor_read_thread, user))
+		wd_workers_submit(NULL, wd_reactor_read_job, user, NULL);
+	
+	wi_release(user);
+}
+
+
+
+static void wd_reactor_arm_user(wd_user_t *user) {
+	wi_lock_lock(wd_reactor_lock);
+
+	wi_mutable_dictionary_set_data_for_key(wd_reactor_users, user, wi_number_with_int32(wd_user_id(user)));
+	
+	if(!(*wd_reactor_backend->arm)(user, wi_socket_descriptor(wd_user_socket(user)))) {
+		wi_log_error(WI_STR("Could not rearm %@ in reactor: %s"),
+			wd_user_identifier(user), strerror(errno));
+
+		wd_user_set_state(user, WD_USER_DISCONNECTED);
+	}
+
+	wi_lock_unlock(wd_reactor_lock);
+}
+
+
+
+static void wd_reactor_remove_user(wd_user_t *user) {
+	wi_lock_lock(wd_reactor_lock);
+	
+	wi_mutable_dictionary_remove_data_for_key(wd_reactor_users, wi_number_with_int32(wd_user_id(user)));
+
+	(*wd_reactor_backend->remove)(user, wi_socket_descriptor(wd_user_socket(user)));
+
+	wi_lock_unlock(wd_reactor_lock);
+}
+
+
+
+static void wd_reactor_drain_wake(void) {
+	char		buffer[64];
+	
+	while(read(wd_reactor_wake_fds[0], buffer, sizeof(buffer)) > 0)
+		;
+}
+
+
+
+#pragma mark -
+
+static wi_boolean_t wd_reactor_peek_frame(int sd, wi_uinteger_t *available, wi_uinteger_t *size) {
+	uint32_t	length;
+	int			count;
+	
+	if(ioctl(sd, FIONREAD, &count) < 0)
+		return false;
+	
+	*available = count;
+	
+	if(!size)
+		return true;
+	
+	if(*available < sizeof(length)) {
+		*size = 0;
+		
+		return true;
+	}
+	
+	if(recv(sd, &length, sizeof(length), MSG_PEEK) != sizeof(length))
+		return false;
+	
+	*size = ntohl(length);
+	
+	return true;
+}
+
+
+
+/*
+ * Binary P7 frames start with a 32-bit length. Until a whole frame has
+ * arrived, the user stays in the reactor with the socket's low water mark
+ * raised to the frame size, so the partial frame waits in the kernel and
+ * the read job that finally runs never blocks a worker. Waking up with
+ * less than the low water mark means end of file or an error, which are
+ * dispatched right away, as are frames too large to wait for. Those, and
+ * the first frame, whose checksum length is not known yet, may still
+ * block in the read, so they are flagged to be read on their own thread.
+ */
+
+static wi_boolean_t wd_reactor_frame_is_ready(wd_user_t *user, wi_boolean_t *blocking) {
+	wi_uinteger_t	available, size, needed, lowat;
+	wi_boolean_t	ready;
+	int				sd, value;
+	
+	sd = wi_socket_descriptor(wd_user_socket(user));
+	
+	*blocking = false;
+	
+	if(!wd_reactor_peek_frame(sd, &available, &size) || available == 0 || available < wd_user_read_lowat(user))
+		return true;
+	
+	if(available < sizeof(uint32_t))
+		needed = sizeof(uint32_t);
+	else
+		needed = sizeof(uint32_t) + size + wd_user_read_trailer(user);
+	
+	ready = (available >= needed || needed > WD_REACTOR_MAX_FRAME_WAIT);
+	lowat = ready ? 1 : needed;
+	
+	if(ready)
+		*blocking = (needed > WD_REACTOR_MAX_FRAME_WAIT || !wd_user_read_trailer_known(user));
+	
+	if(lowat != wd_user_read_lowat(user)) {
+		value = lowat;
+		
+		if(setsockopt(sd, SOL_SOCKET, SO_RCVLOWAT, &value, sizeof(value)) < 0) {
+			*blocking = true;
+			
+			return true;
+		}
+		
+		wd_user_set_read_lowat(user, lowat);
+	}
+	
+	return ready;
+}
+
+
+
+#pragma mark -
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static wi_boolean_t wd_reactor_epoll_initialize(void) {
+	struct epoll_event		event;
+	
+	wd_reactor_epoll_fd = epoll_create(WD_REACTOR_MAX_EVENTS);
+	
+	if(wd_reactor_epoll_fd < 0)
+		return false;
+	
+	fcntl(wd_reactor_epoll_fd, F_SETFD, FD_CLOEXEC);
+	
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = 0;
+	
+	if(epoll_ctl(wd_reactor_epoll_fd, EPOLL_CTL_ADD, wd_reactor_wake_fds[0], &event) < 0) {
+		close(wd_reactor_epoll_fd);
+		wd_reactor_epoll_fd = -1;
+		
+		return false;
+	}
+	
+	return true;
+}
+
+
+
+static wi_boolean_t wd_reactor_epoll_add(wd_user_t *user, int sd) {
+	struct epoll_event		event;
+	
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.u64 = wd_user_id(user);
+	
+	return (epoll_ctl(wd_reactor_epoll_fd, EPOLL_CTL_ADD, sd, &event) == 0);
+}
+
+
+
+static wi_boolean_t wd_reactor_epoll_arm(wd_user_t *user, int sd) {
+	struct epoll_event		event;
+	
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.u64 = wd_user_id(user);
+	
+	return (epoll_ctl(wd_reactor_epoll_fd, EPOLL_CTL_MOD, sd, &event) == 0);
+}
+
+
+
+static void wd_reactor_epoll_remove(wd_user_t *user, int sd) {
+	struct epoll_event		event;
+	
+	memset(&event, 0, sizeof(event));
+	
+	epoll_ctl(wd_reactor_epoll_fd, EPOLL_CTL_DEL, sd, &event);
+}
+
+
+
+static void wd_reactor_epoll_wait(wi_time_interval_t timeout) {
+	struct epoll_event		events[WD_REACTOR_MAX_EVENTS];
+	int						i, count;
+	
+	count = epoll_wait(wd_reactor_epoll_fd, events, WD_REACTOR_MAX_EVENTS, timeout * 1000.0);
+	
+	if(count < 0) {
+		if(errno != EINTR)
+			wi_log_error(WI_STR("Could not wait for reactor events: %s"), strerror(errno));
+		
+		return;
+	}
+	
+	for(i = 0; i < count; i++) {
+		if(events[i].data.u64 != 0)
+			wd_reactor_dispatch_user(events[i].data.u64);
+		else
+			wd_reactor_drain_wake();
+	}
+}
+
+#endif
+
+
+
+#pragma mark -
+
+static wi_boolean_t wd_reactor_poll_initialize(void) {
+	return true;
+}
+
+
+
+static wi_boolean_t wd_reactor_poll_add(wd_user_t *user, int sd) {
+	wd_reactor_wake();
+	
+	return true;
+}
+
+
+
+static wi_boolean_t wd_reactor_poll_arm(wd_user_t *user, int sd) {
+	wd_reactor_wake();
+	
+	return true;
+}
+
+
+
+static void wd_reactor_poll_remove(wd_user_t *user, int sd) {
+}
+
+
+
+static void wd_reactor_poll_wait(wi_time_interval_t timeout) {
+	wi_enumerator_t		*enumerator;
+	wi_mutable_array_t	*users;
+	wd_user_t			*user;
+	struct pollfd		*fds;
+	wi_uinteger_t		i, count;
+	
+	users = wi_mutable_array();
+	
+	wi_lock_lock(wd_reactor_lock);
+	
+	enumerator = wi_dictionary_data_enumerator(wd_reactor_users);
+	
+	while((user = wi_enumerator_next_data(enumerator)))
+		wi_mutable_array_add_data(users, user);
+	
+	wi_lock_unlock(wd_reactor_lock);
+	
+	count = wi_array_count(users);
+	fds = wi_malloc((count + 1) * sizeof(struct pollfd));
+	
+	fds[0].fd = wd_reactor_wake_fds[0];
+	fds[0].events = POLLIN;
+	
+	for(i = 0; i < count; i++) {
+		fds[i + 1].fd = wi_socket_descriptor(wd_user_socket(WI_ARRAY(users, i)));
+		fds[i + 1].events = POLLIN;
+	}
+	
+	if(poll(fds, count + 1, timeout * 1000.0) < 0) {
+		if(errno != EINTR)
+			wi_log_error(WI_STR("Could not wait for reactor events: %s"), strerror(errno));
+	} else {
+		if(fds[0].revents)
+			wd_reactor_drain_wake();
+		
+		for(i = 0; i < count; i++) {
+			if(fds[i + 1].revents)
+				wd_reactor_dispatch_user(wd_user_id(WI_ARRAY(users, i)));
+		}
+	}
+	
+	wi_free(fds);
+}
@@ -28,6 +28,10 @@
 
 #include "config.h"
 
+#if (defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
 #ifdef HAVE_CORESERVICES_CORESERVICES_H
 #include <CoreFoundation/CoreFoundation.h>
 #endif
@@ -37,25 +41,51 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
 #include <wired/wired.h>
 
 #include "accounts.h"
 #include "banlist.h"
 #include "events.h"
 #include "files.h"
+#include "handshakes.h"
 #include "index.h"
 #include "main.h"
 #include "messages.h"
+#include "metrics.h"
 #include "portmap.h"
+#include "reactor.h"
 #include "server.h"
 #include "servers.h"
 #include "settings.h"
 #include "trackers.h"
 #include "transfers.h"
+#include "users.h"
+#include "workers.h"
+
+#define WD_SERVER_DATAGRAM_BATCH_SIZE		32
+#define WD_SERVER_DATAGRAM_RECEIVE_BUFFER	1048576
+
+#define WD_SERVER_WRITE_TIMEOUT				5.0
+#define WD_SERVER_SEND_TIMEOUT				30.0
+
+
+struct _wd_server_datagrams {
+	char								buffers[WD_SERVER_DATAGRAM_BATCH_SIZE][WI_SOCKET_BUFFER_SIZE];
+	size_t								lengths[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	struct sockaddr_storage				addresses[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	socklen_t							address_lengths[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	wi_uinteger_t						count;
+};
+typedef struct _wd_server_datagrams		wd_server_datagrams_t;
 
-#define WD_SERVER_PING_INTERVAL		60.0
 
 #ifdef HAVE_CORESERVICES_CORESERVICES_H
 static void							wd_server_cf_thread(wi_runtime_instance_t *);
@@ -75,10 +105,21 @@ static void							wd_server_portmap_thread(wi_runtime_instance_t *);
 static void							wd_server_portmap_timer(wi_timer_t *timer);
 
 static void							wd_server_listen_thread(wi_runtime_instance_t *);
-static void							wd_server_accept_thread(wi_runtime_instance_t *);
 static void							wd_server_receive_thread(wi_runtime_instance_t *);
+static void							wd_server_receive_datagrams(int, wd_server_datagrams_t *);
+static void							wd_server_send_datagrams(int, wd_server_datagrams_t *);
+static void							wd_server_add_datagram(wd_server_datagrams_t *, wi_data_t *, struct sockaddr_storage *, socklen_t);
+static wi_string_t *				wd_server_datagram_address_string(wd_server_datagrams_t *, wi_uinteger_t);
+static wi_data_t *					wd_server_handle_datagram(wd_server_datagrams_t *, wi_uinteger_t);
+static wi_rsa_t *						wd_server_rsa(void);
+static wi_boolean_t					wd_server_write_key(wi_data_t *, wi_string_t *);
 static void							wd_server_log_callback(wi_log_level_t, wi_string_t *);
-static void							wd_server_ping_users(wi_timer_t *);
+static void							wd_server_flush_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+static void							wd_server_write_messages(wd_user_t *, wi_time_interval_t);
+static wi_boolean_t					wd_server_socket_is_writable(wi_socket_t *);
+static void							wd_server_drop_messages(wd_user_t *);
+
+static void							wd_user_queue_or_flush_message(wd_user_t *, wi_p7_message_t *, wi_boolean_t);
 
 
 #ifdef HAVE_CORESERVICES_CORESERVICES_H
@@ -95,8 +136,6 @@ static CFRunLoopSourceRef			wd_dnssd_register_source;
 #endif
 #endif
 
-static wi_timer_t					*wd_ping_timer;
-static wi_p7_message_t				*wd_ping_message;
 static wi_mutable_array_t			*wd_tcp_sockets, *wd_udp_sockets;
 static wi_rsa_t						*wd_rsa;
 static wi_mutable_array_t			*wd_log_entries;
@@ -111,16 +150,6 @@ wi_p7_spec_t						*wd_p7_spec;
 void wd_server_initialize(void) {
 	wi_string_t		*path;
 	
-	wd_ping_timer = wi_timer_init_with_function(wi_timer_alloc(),
-												wd_server_ping_users,
-												WD_SERVER_PING_INTERVAL,
-												true);
-
-	wd_rsa = wi_rsa_init_with_bits(wi_rsa_alloc(), 1024);
-	
-	if(!wd_rsa)
-		wi_log_fatal(WI_STR("Could not create RSA key: %m"));
-	
 	wi_p7_socket_password_provider = wd_accounts_password_for_user;
 	
 	path = WI_STR("wired.xml");
@@ -133,8 +162,6 @@ void wd_server_initialize(void) {
 		wi_p7_spec_name(wd_p7_spec),
 		wi_p7_spec_version(wd_p7_spec));
 	
-	wd_ping_message = wi_retain(wi_p7_message_with_name(WI_STR("wired.send_ping"), wd_p7_spec));
-	
 	wi_log_callback = wd_server_log_callback;
 	
 	wd_max_log_entries = (wi_log_limit > 0) ? wi_log_limit : 500;
@@ -148,12 +175,6 @@ void wd_server_initialize(void) {
 
 
 
-void wd_server_schedule(void) {
-	wi_timer_schedule(wd_ping_timer);
-}
-
-
-
 void wd_server_listen(void) {
 	wi_enumerator_t			*enumerator;
 	wi_mutable_array_t		*addresses;
@@ -163,7 +184,9 @@ void wd_server_listen(void) {
 	wi_socket_t				*tcp_socket, *udp_socket;
 	wi_string_t				*ip, *string;
 	wi_address_family_t		family;
+	int						size;
 	
+	wd_rsa				= wd_server_rsa();
 	wd_tcp_sockets		= wi_array_init(wi_mutable_array_alloc());
 	wd_udp_sockets		= wi_array_init(wi_mutable_array_alloc());
 	addresses			= wi_mutable_array();
@@ -225,6 +248,11 @@ void wd_server_listen(void) {
 		}
 		
 		wi_socket_set_interactive(tcp_socket, true);
+		
+		size = WD_SERVER_DATAGRAM_RECEIVE_BUFFER;
+		
+		if(setsockopt(wi_socket_descriptor(udp_socket), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+			wi_log_warn(WI_STR("Could not set receive buffer size for %@: %s"), ip, strerror(errno));
 
 		wi_mutable_array_add_data(wd_tcp_sockets, tcp_socket);
 		wi_mutable_array_add_data(wd_udp_sockets, udp_socket);
@@ -254,6 +282,8 @@ void wd_server_listen(void) {
 		wi_release(timer);
 	}
 	
+	wd_reactor_start();
+	
 	if(!wi_thread_create_thread(wd_server_listen_thread, NULL) ||
 	   !wi_thread_create_thread(wd_server_receive_thread, NULL))
 		wi_log_fatal(WI_STR("Could not create a listen thread: %m"));
@@ -591,8 +621,13 @@ static void wd_server_listen_thread(wi_runtime_instance_t *argument) {
 			continue;
 		}
 		
-		if(!wi_thread_create_thread(wd_server_accept_thread, socket))
-			wi_log_error(WI_STR("Could not create a client thread for %@: %m"), ip);
+		wd_metrics_add(WD_METRIC_CONNECTIONS_ACCEPTED, 1);
+		
+		if(!wd_handshakes_add_socket(socket)) {
+			wi_log_info(WI_STR("Rejected connection from %@: Too many pending handshakes"), ip);
+			
+			wi_socket_close(socket);
+		}
 	}
 	
 	wi_release(pool);
@@ -600,15 +635,13 @@ static void wd_server_listen_thread(wi_runtime_instance_t *argument) {
 
 
 
-static void wd_server_accept_thread(wi_runtime_instance_t *argument) {
-	wi_pool_t			*pool;
+#pragma mark -
+
+void wd_server_accept_socket(wi_socket_t *socket) {
 	wi_p7_socket_t		*p7_socket;
-	wi_socket_t			*socket = argument;
 	wi_string_t			*ip;
 	wd_user_t			*user;
 	
-	pool = wi_pool_init(wi_pool_alloc());
-	
 	ip = wi_address_string(wi_socket_address(socket));
 	
 	wi_log_info(WI_STR("Connect from %@"), ip);
@@ -623,7 +656,7 @@ static void wd_server_accept_thread(wi_runtime_instance_t *argument) {
 	
 	if(wi_p7_socket_accept(p7_socket, 30.0, WI_P7_ALL)) {
 		wd_users_add_user(user);
-		wd_messages_loop_for_user(user);
+		wd_reactor_add_user(user);
 	} else {
 		wd_user_set_login(user, wi_p7_socket_user_name(p7_socket));
 		
@@ -632,138 +665,332 @@ static void wd_server_accept_thread(wi_runtime_instance_t *argument) {
 		if(wi_error_domain() == WI_ERROR_DOMAIN_LIBWIRED && wi_error_code() == WI_ERROR_P7_AUTHENTICATIONFAILED)
 			wd_events_add_event(WI_STR("wired.event.user.login_failed"), user, NULL);
 	}
-	
-	wi_release(pool);
 }
 
 
 
 static void wd_server_receive_thread(wi_runtime_instance_t *argument) {
-	wi_pool_t			*pool;
-	wi_socket_t			*socket;
-	wi_p7_message_t		*message, *reply;
-	wi_address_t		*address;
-	wi_string_t			*ip, *name;
-	wi_data_t			*data;
-	wi_cipher_t			*cipher;
-	wd_server_t			*server;
-	char				buffer[WI_SOCKET_BUFFER_SIZE];
-	wi_integer_t		bytes;
+	wi_pool_t					*pool;
+	wd_server_datagrams_t		*received, *replies;
+	struct pollfd				*fds;
+	wi_data_t					*data;
+	wi_time_interval_t			interval, rate_time;
+	wi_uinteger_t				i, j, count, packets;
 	
 	pool = wi_pool_init(wi_pool_alloc());
+	
+	count		= wi_array_count(wd_udp_sockets);
+	fds			= wi_malloc(count * sizeof(*fds));
+	received	= wi_malloc(sizeof(*received));
+	replies		= wi_malloc(sizeof(*replies));
+	
+	for(i = 0; i < count; i++) {
+		fds[i].fd		= wi_socket_descriptor(WI_ARRAY(wd_udp_sockets, i));
+		fds[i].events	= POLLIN;
+	}
+	
+	packets		= 0;
+	rate_time	= wi_time_interval();
 
 	while(wd_running) {
 		wi_pool_drain(pool);
-
-		bytes = wi_socket_recvfrom_multiple(wd_udp_sockets, buffer, sizeof(buffer), &address);
-		
-		if(!address) {
-			wi_log_error(WI_STR("Could not receive data: %m"));
-
-			continue;
-		}
-		
-		ip = wi_address_string(address);
-
-		if(bytes < 0) {
-			wi_log_error(WI_STR("Could not receive data from %@: %m"), ip);
-
-			continue;
-		}
-		
-		server = wd_servers_server_for_ip(ip);
 		
-		if(!server) {
-			wi_log_error(WI_STR("Could not receive data from %@: No server found"), ip);
+		if(poll(fds, count, 1000) < 0) {
+			if(errno != EINTR)
+				wi_log_error(WI_STR("Could not wait for data: %s"), strerror(errno));
 			
 			continue;
 		}
 		
-		data		= wi_data_with_bytes(buffer, bytes);
-		cipher		= wd_server_cipher(server);
-		
-		if(cipher) {
-			data = wi_cipher_decrypt(cipher, data);
-			
-			if(!data) {
-				wi_log_error(WI_STR("Could not decrypt data from %@: %m"), ip);
-
+		for(i = 0; i < count; i++) {
+			if(!(fds[i].revents & POLLIN))
 				continue;
+			
+			wd_server_receive_datagrams(fds[i].fd, received);
+			
+			replies->count = 0;
+			
+			for(j = 0; j < received->count; j++) {
+				data = wd_server_handle_datagram(received, j);
+				
+				if(data)
+					wd_server_add_datagram(replies, data, &received->addresses[j], received->address_lengths[j]);
 			}
+			
+			if(replies->count > 0)
+				wd_server_send_datagrams(fds[i].fd, replies);
+			
+			packets += received->count;
 		}
 		
-		message = wi_p7_message_with_data(data, WI_P7_BINARY, wd_p7_spec);
+		interval = wi_time_interval();
 		
-		if(!message) {
-			wi_log_error(WI_STR("Could not create message from received data from %@: %m"), ip);
+		if(interval - rate_time >= 1.0) {
+			wd_metrics_set(WD_METRIC_TRACKER_RECEIVE_RATE, (uint64_t) (packets / (interval - rate_time)));
 			
-			continue;
+			packets		= 0;
+			rate_time	= interval;
 		}
+	}
+	
+	wi_free(replies);
+	wi_free(received);
+	wi_free(fds);
+	wi_release(pool);
+}
+
+
+
+static void wd_server_receive_datagrams(int sd, wd_server_datagrams_t *datagrams) {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr		messages[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	struct iovec		iov[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	int					i, count;
+	
+	memset(messages, 0, sizeof(messages));
+	
+	for(i = 0; i < WD_SERVER_DATAGRAM_BATCH_SIZE; i++) {
+		iov[i].iov_base							= datagrams->buffers[i];
+		iov[i].iov_len							= sizeof(datagrams->buffers[i]);
+		messages[i].msg_hdr.msg_iov				= &iov[i];
+		messages[i].msg_hdr.msg_iovlen			= 1;
+		messages[i].msg_hdr.msg_name			= &datagrams->addresses[i];
+		messages[i].msg_hdr.msg_namelen			= sizeof(datagrams->addresses[i]);
+	}
+	
+	count = recvmmsg(sd, messages, WD_SERVER_DATAGRAM_BATCH_SIZE, MSG_DONTWAIT, NULL);
+	
+	if(count < 0) {
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			wi_log_error(WI_STR("Could not receive data: %s"), strerror(errno));
 		
-		if(!wi_p7_spec_verify_message(wd_p7_spec, message)) {
-			wi_log_error(WI_STR("Could not verify message from received data from %@: %m"), ip);
-			
-			continue;
-		}
+		count = 0;
+	}
+	
+	for(i = 0; i < count; i++) {
+		datagrams->lengths[i]			= (messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : messages[i].msg_len;
+		datagrams->address_lengths[i]	= messages[i].msg_hdr.msg_namelen;
+	}
+	
+	datagrams->count = count;
+#else
+	ssize_t				bytes;
+	
+	for(datagrams->count = 0; datagrams->count < WD_SERVER_DATAGRAM_BATCH_SIZE; datagrams->count++) {
+		datagrams->address_lengths[datagrams->count] = sizeof(datagrams->addresses[datagrams->count]);
 		
-		reply		= NULL;
-		name		= wi_p7_message_name(message);
+		bytes = recvfrom(sd, datagrams->buffers[datagrams->count], sizeof(datagrams->buffers[datagrams->count]), MSG_DONTWAIT,
+			(struct sockaddr *) &datagrams->addresses[datagrams->count], &datagrams->address_lengths[datagrams->count]);
 		
-		if(wi_is_equal(name, WI_STR("wired.tracker.send_update"))) {
-			if(wi_config_bool_for_name(wd_config, WI_STR("enable tracker"))) {
-				if(!wd_servers_update_server(ip, NULL, message)) {
-					reply = wi_p7_message_with_name(WI_STR("wired.error"), wd_p7_spec);
-					wi_p7_message_set_enum_name_for_name(reply, WI_STR("wired.error.not_registered"), WI_STR("wired.error"));
-				}
-			} else {
-				reply = wi_p7_message_with_name(WI_STR("wired.error"), wd_p7_spec);
-				wi_p7_message_set_enum_name_for_name(reply, WI_STR("wired.error.tracker_not_enabled"), WI_STR("wired.error"));
-			}
-		}
-		else if(wi_is_equal(name, WI_STR("wired.error"))) {
-			wd_trackers_register();
+		if(bytes < 0) {
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				wi_log_error(WI_STR("Could not receive data: %s"), strerror(errno));
+			
+			break;
 		}
 		
-		if(reply) {
-			wi_address_set_port(address, wd_server_port(server));
-			
-			socket = wi_autorelease(wi_socket_init_with_address(wi_socket_alloc(), address, WI_SOCKET_UDP));
-			
-			if(!socket) {
-				wi_log_error(WI_STR("Could not create a socket for %@: %m"), ip);
+		datagrams->lengths[datagrams->count] = bytes;
+	}
+#endif
+	
+	wd_metrics_add(WD_METRIC_TRACKER_RECEIVED, datagrams->count);
+}
+
+
+
+static void wd_server_send_datagrams(int sd, wd_server_datagrams_t *datagrams) {
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr		messages[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	struct iovec		iov[WD_SERVER_DATAGRAM_BATCH_SIZE];
+	wi_uinteger_t		i, offset;
+	int					count;
+	
+	memset(messages, 0, sizeof(messages));
+	
+	for(i = 0; i < datagrams->count; i++) {
+		iov[i].iov_base							= datagrams->buffers[i];
+		iov[i].iov_len							= datagrams->lengths[i];
+		messages[i].msg_hdr.msg_iov				= &iov[i];
+		messages[i].msg_hdr.msg_iovlen			= 1;
+		messages[i].msg_hdr.msg_name			= &datagrams->addresses[i];
+		messages[i].msg_hdr.msg_namelen			= datagrams->address_lengths[i];
+	}
+	
+	for(offset = 0; offset < datagrams->count; offset += count) {
+		count = sendmmsg(sd, messages + offset, datagrams->count - offset, 0);
+		
+		if(count < 0) {
+			if(errno == EINTR) {
+				count = 0;
 				
 				continue;
 			}
 			
-			data = wi_p7_message_data_with_serialization(reply, WI_P7_BINARY);
-			
-			if(cipher) {
-				data = wi_cipher_encrypt(cipher, data);
+			wi_log_error(WI_STR("Could not send message to \"%@\": %s"),
+				wd_server_datagram_address_string(datagrams, offset), strerror(errno));
 			
-				if(!data) {
-					wi_log_error(WI_STR("Could not encrypt message for %@: %m"), ip);
-					
-					continue;
-				}
-			}
+			wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
 			
-			bytes = wi_socket_sendto_data(socket, data);
+			count = 1;
+		} else {
+			wd_metrics_add(WD_METRIC_TRACKER_SENT, count);
+		}
+	}
+#else
+	wi_uinteger_t		i;
+	
+	for(i = 0; i < datagrams->count; i++) {
+		if(sendto(sd, datagrams->buffers[i], datagrams->lengths[i], 0,
+				  (struct sockaddr *) &datagrams->addresses[i], datagrams->address_lengths[i]) < 0) {
+			wi_log_error(WI_STR("Could not send message to \"%@\": %s"),
+				wd_server_datagram_address_string(datagrams, i), strerror(errno));
 			
-			if(bytes < 0) {
-				wi_log_error(WI_STR("Could not send message to \"%@\": %m"), ip);
-				
-				continue;
-			}
+			wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+		} else {
+			wd_metrics_add(WD_METRIC_TRACKER_SENT, 1);
 		}
 	}
+#endif
+}
+
+
+
+static void wd_server_add_datagram(wd_server_datagrams_t *datagrams, wi_data_t *data, struct sockaddr_storage *address, socklen_t address_length) {
+	wi_uinteger_t		length;
 	
-	wi_release(pool);
+	length = wi_data_length(data);
+	
+	if(length > sizeof(datagrams->buffers[datagrams->count])) {
+		wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+		
+		return;
+	}
+	
+	memcpy(datagrams->buffers[datagrams->count], wi_data_bytes(data), length);
+	memcpy(&datagrams->addresses[datagrams->count], address, address_length);
+
+	datagrams->lengths[datagrams->count]			= length;
+	datagrams->address_lengths[datagrams->count]	= address_length;
+	datagrams->count++;
 }
 
 
 
-static void wd_server_ping_users(wi_timer_t *timer) {
-	wd_broadcast_message(wd_ping_message);
+static wi_string_t * wd_server_datagram_address_string(wd_server_datagrams_t *datagrams, wi_uinteger_t index) {
+	wi_address_t		*address;
+	
+	address = wi_autorelease(wi_address_init_with_sa(wi_address_alloc(), (struct sockaddr *) &datagrams->addresses[index]));
+	
+	return address ? wi_address_string(address) : NULL;
+}
+
+
+
+static wi_data_t * wd_server_handle_datagram(wd_server_datagrams_t *datagrams, wi_uinteger_t index) {
+	wi_p7_message_t		*message, *reply;
+	wi_address_t		*address;
+	wi_string_t			*ip, *name;
+	wi_data_t			*data;
+	wi_cipher_t			*cipher;
+	wd_server_t			*server;
+	
+	address = wi_autorelease(wi_address_init_with_sa(wi_address_alloc(), (struct sockaddr *) &datagrams->addresses[index]));
+	
+	if(!address) {
+		wi_log_error(WI_STR("Could not receive data: %m"));
+		wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+
+		return NULL;
+	}
+	
+	ip = wi_address_string(address);
+	
+	if(datagrams->lengths[index] == 0) {
+		wi_log_error(WI_STR("Could not receive data from %@: %s"), ip, "Message too large");
+		wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+
+		return NULL;
+	}
+	
+	server = wd_servers_server_for_ip(ip);
+	
+	if(!server) {
+		wi_log_error(WI_STR("Could not receive data from %@: No server found"), ip);
+		wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+		
+		return NULL;
+	}
+	
+	data		= wi_data_with_bytes(datagrams->buffers[index], datagrams->lengths[index]);
+	cipher		= wd_server_cipher(server);
+	
+	if(cipher) {
+		data = wi_cipher_decrypt(cipher, data);
+		
+		if(!data) {
+			wi_log_error(WI_STR("Could not decrypt data from %@: %m"), ip);
+			wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+
+			return NULL;
+		}
+	}
+	
+	message = wi_p7_message_with_data(data, WI_P7_BINARY, wd_p7_spec);
+	
+	if(!message) {
+		wi_log_error(WI_STR("Could not create message from received data from %@: %m"), ip);
+		wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+		
+		return NULL;
+	}
+	
+	if(!wi_p7_spec_verify_message(wd_p7_spec, message)) {
+		wi_log_error(WI_STR("Could not verify message from received data from %@: %m"), ip);
+		wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+		
+		return NULL;
+	}
+	
+	reply		= NULL;
+	name		= wi_p7_message_name(message);
+	
+	if(wi_is_equal(name, WI_STR("wired.tracker.send_update"))) {
+		if(wi_config_bool_for_name(wd_config, WI_STR("enable tracker"))) {
+			if(!wd_servers_update_server(ip, NULL, message)) {
+				reply = wi_p7_message_with_name(WI_STR("wired.error"), wd_p7_spec);
+				wi_p7_message_set_enum_name_for_name(reply, WI_STR("wired.error.not_registered"), WI_STR("wired.error"));
+			}
+		} else {
+			reply = wi_p7_message_with_name(WI_STR("wired.error"), wd_p7_spec);
+			wi_p7_message_set_enum_name_for_name(reply, WI_STR("wired.error.tracker_not_enabled"), WI_STR("wired.error"));
+		}
+	}
+	else if(wi_is_equal(name, WI_STR("wired.error"))) {
+		wd_trackers_register();
+	}
+	
+	if(!reply)
+		return NULL;
+	
+	wi_address_set_port(address, wd_server_port(server));
+	
+	memcpy(&datagrams->addresses[index], wi_address_sa(address), wi_address_sa_length(address));
+	datagrams->address_lengths[index] = wi_address_sa_length(address);
+	
+	data = wi_p7_message_data_with_serialization(reply, WI_P7_BINARY);
+	
+	if(cipher) {
+		data = wi_cipher_encrypt(cipher, data);
+	
+		if(!data) {
+			wi_log_error(WI_STR("Could not encrypt message for %@: %m"), ip);
+			wd_metrics_add(WD_METRIC_TRACKER_DROPPED, 1);
+			
+			return NULL;
+		}
+	}
+	
+	return data;
 }
 
 
@@ -798,6 +1025,95 @@ void wd_server_log_reply_log(wd_user_t *user, wi_p7_message_t *message) {
 
 
 
+static wi_rsa_t * wd_server_rsa(void) {
+	wi_rsa_t		*rsa;
+	wi_data_t		*data;
+	wi_string_t		*path;
+	
+	path = WI_STR("wired.key");
+	
+	if(wi_fs_path_exists(path, NULL)) {
+		data = wi_data_with_contents_of_file(path);
+		
+		if(data) {
+			rsa = wi_rsa_init_with_private_key(wi_rsa_alloc(), data);
+			
+			if(rsa)
+				return rsa;
+		}
+		
+		/* Never replace a key that clients may already trust */
+		wi_log_fatal(WI_STR("Could not load RSA key from \"%@\": %m"), path);
+	}
+	
+	rsa = wi_rsa_init_with_bits(wi_rsa_alloc(), 1024);
+	
+	if(!rsa)
+		wi_log_fatal(WI_STR("Could not create RSA key: %m"));
+	
+	if(!wd_server_write_key(wi_rsa_private_key(rsa), path))
+		wi_log_error(WI_STR("Could not save RSA key to \"%@\": %s"), path, strerror(errno));
+	
+	return rsa;
+}
+
+
+
+static wi_boolean_t wd_server_write_key(wi_data_t *data, wi_string_t *path) {
+	wi_string_t		*temppath;
+	const char		*bytes;
+	ssize_t			bytesleft, bytescount;
+	wi_boolean_t	result;
+	int				fd, error;
+	
+	/* Create the file private from the start, and only move it into place once it is complete */
+	temppath = wi_string_by_appending_path_extension(path, WI_STR("tmp"));
+	
+	(void) unlink(wi_string_cstring(temppath));
+	
+	fd = open(wi_string_cstring(temppath), O_WRONLY | O_CREAT | O_EXCL, 0600);
+	
+	if(fd < 0)
+		return false;
+	
+	bytes		= wi_data_bytes(data);
+	bytesleft	= wi_data_length(data);
+	
+	while(bytesleft > 0) {
+		bytescount = write(fd, bytes, bytesleft);
+		
+		if(bytescount < 0) {
+			if(errno == EINTR)
+				continue;
+			
+			break;
+		}
+		
+		bytes		+= bytescount;
+		bytesleft	-= bytescount;
+	}
+	
+	result = (bytesleft == 0 && fsync(fd) == 0);
+	
+	if(close(fd) < 0)
+		result = false;
+	
+	if(result && rename(wi_string_cstring(temppath), wi_string_cstring(path)) < 0)
+		result = false;
+	
+	if(!result) {
+		error = errno;
+		
+		(void) unlink(wi_string_cstring(temppath));
+		
+		errno = error;
+	}
+	
+	return result;
+}
+
+
+
 static void wd_server_log_callback(wi_log_level_t level, wi_string_t *string) {
 	wi_enumerator_t		*enumerator;
 	wi_dictionary_t		*entry;
@@ -806,6 +1122,7 @@ static void wd_server_log_callback(wi_log_level_t level, wi_string_t *string) {
 	wd_user_t			*user;
 	wi_uinteger_t		count;
 	
+	message	= NULL;
 	date	= wi_date();
 	entry	= wi_dictionary_with_data_and_keys(
 		date,					WI_STR("wired.log.time"),
@@ -826,11 +1143,14 @@ static void wd_server_log_callback(wi_log_level_t level, wi_string_t *string) {
 			enumerator = wi_dictionary_data_enumerator(wd_users);
 			
 			while((user = wi_enumerator_next_data(enumerator))) {
-				if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_is_subscribed_log(user)) {
-					message = wi_p7_message_with_name(WI_STR("wired.log.message"), wd_p7_spec);
-					wi_p7_message_set_date_for_name(message, date, WI_STR("wired.log.time"));
-					wi_p7_message_set_enum_for_name(message, 4 - level, WI_STR("wired.log.level"));
-					wi_p7_message_set_string_for_name(message, string, WI_STR("wired.log.message"));
+				if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_session_id(user) == 0 && wd_user_is_subscribed_log(user)) {
+					if(!message) {
+						message = wi_p7_message_with_name(WI_STR("wired.log.message"), wd_p7_spec);
+						wi_p7_message_set_date_for_name(message, date, WI_STR("wired.log.time"));
+						wi_p7_message_set_enum_for_name(message, 4 - level, WI_STR("wired.log.level"));
+						wi_p7_message_set_string_for_name(message, string, WI_STR("wired.log.message"));
+					}
+					
 					wd_user_send_message(user, message);
 				}
 			}
@@ -863,6 +1183,8 @@ wi_boolean_t wd_user_write_message(wd_user_t *user, wi_time_interval_t timeout,
 	
 	wd_user_lock_socket(user);
 	
+	wd_server_write_messages(user, timeout);
+	
 	result = wi_p7_socket_write_message(wd_user_p7_socket(user), timeout, message);
 	
 	wd_user_unlock_socket(user);
@@ -872,17 +1194,132 @@ wi_boolean_t wd_user_write_message(wd_user_t *user, wi_time_interval_t timeout,
 
 
 
-#pragma mark -
+/*
+ * Queued messages are only written while the socket has room for them, so
+ * a slow client never holds a worker. Whatever is left stays queued and is
+ * retried shortly; a client that takes no message for the send timeout is
+ * disconnected.
+ */
 
-void wd_user_send_message(wd_user_t *user, wi_p7_message_t *message) {
-	if(!wd_user_transfer(user)) {
-		if(!wd_user_write_message(user, 0.0, message)) {
+void wd_user_flush_messages(wd_user_t *user) {
+	wd_server_write_messages(user, 0.0);
+}
+
+
+
+static void wd_server_write_messages(wd_user_t *user, wi_time_interval_t timeout) {
+	wi_p7_message_t		*message;
+	wi_boolean_t		blocked = false;
+	
+	wd_user_lock_socket(user);
+	
+	while(true) {
+		/* Callers that are about to write anyway pass a timeout and wait their turn */
+		if(timeout == 0.0 && !wd_server_socket_is_writable(wd_user_socket(user))) {
+			blocked = true;
+			
+			break;
+		}
+		
+		message = wd_user_dequeue_message(user);
+		
+		if(!message)
+			break;
+		
+		if(!wi_p7_socket_write_message(wd_user_p7_socket(user), (timeout > 0.0) ? timeout : WD_SERVER_WRITE_TIMEOUT, message)) {
 			wd_user_set_state(user, WD_USER_DISCONNECTED);
 			
 			wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
 				wi_p7_message_name(message), wd_user_identifier(user));
+			
+			wd_server_drop_messages(user);
+			
+			break;
+		}
+	}
+	
+	wd_user_unlock_socket(user);
+	
+	if(!blocked)
+		return;
+	
+	if(wd_user_state(user) == WD_USER_DISCONNECTED) {
+		wd_server_drop_messages(user);
+	}
+	else if(wi_time_interval() - wd_user_send_time(user) > WD_SERVER_SEND_TIMEOUT) {
+		wi_log_warn(WI_STR("Could not write message to %@: %@"),
+			wd_user_identifier(user), WI_STR("Timed out"));
+		
+		wd_user_set_state(user, WD_USER_DISCONNECTED);
+		
+		wd_server_drop_messages(user);
+	}
+	else {
+		wd_user_retry_messages(user);
+	}
+}
+
+
+
+static void wd_server_flush_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wd_user_t		*user = argument1;
+	
+	/* A running transfer owns the socket and flushes the queue before its own writes */
+	if(wd_user_transfer(user))
+		wd_user_unschedule_messages(user);
+	else
+		wd_user_flush_messages(user);
+}
+
+
+
+static wi_boolean_t wd_server_socket_is_writable(wi_socket_t *socket) {
+	struct pollfd	fd;
+	
+	fd.fd		= wi_socket_descriptor(socket);
+	fd.events	= POLLOUT;
+	fd.revents	= 0;
+	
+	if(poll(&fd, 1, 0) < 0)
+		return false;
+	
+	/* Errors and hangups are left for the write to report */
+	return (fd.revents != 0);
+}
+
+
+
+static void wd_server_drop_messages(wd_user_t *user) {
+	while(wd_user_dequeue_message(user))
+		;
+}
+
+
+
+#pragma mark -
+
+static void wd_user_queue_or_flush_message(wd_user_t *user, wi_p7_message_t *message, wi_boolean_t reply) {
+	/* Only the thread running a transfer replies while it holds the socket, so its replies go straight out */
+	if(wd_user_transfer(user)) {
+		if(reply && !wd_user_write_message(user, 30.0, message)) {
+			wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+				wi_p7_message_name(message), wd_user_identifier(user));
 		}
+		
+		return;
 	}
+	
+	if(wd_user_queue_message(user, message, reply))
+		wd_workers_submit(NULL, wd_server_flush_job, user, NULL);
+	
+	if(reply && wd_user_queue_is_full(user))
+		wd_user_flush_messages(user);
+}
+
+
+
+void wd_user_send_message(wd_user_t *user, wi_p7_message_t *message) {
+	wd_user_queue_or_flush_message(user, message, false);
 }
 
 
@@ -895,7 +1332,7 @@ void wd_user_reply_message(wd_user_t *user, wi_p7_message_t *reply, wi_p7_messag
 			wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
 	}
 	
-	wd_user_send_message(user, reply);
+	wd_user_queue_or_flush_message(user, reply, true);
 }
 
 
@@ -959,7 +1396,7 @@ void wd_broadcast_message(wi_p7_message_t *message) {
 	enumerator = wi_dictionary_data_enumerator(wd_users);
 	
 	while((user = wi_enumerator_next_data(enumerator))) {
-		if(wd_user_state(user) == WD_USER_LOGGED_IN)
+		if(wd_user_state(user) == WD_USER_LOGGED_IN && wd_user_session_id(user) == 0)
 			wd_user_send_message(user, message);
 	}
 	
@@ -38,11 +38,12 @@
 
 
 void								wd_server_initialize(void);
-void								wd_server_schedule(void);
 void								wd_server_listen(void);
 void								wd_server_apply_settings(wi_set_t *);
 void								wd_server_cleanup(void);
 
+void								wd_server_accept_socket(wi_socket_t *);
+
 wi_p7_message_t *					wd_client_info_message(void);
 wi_p7_message_t *					wd_server_info_message(void);
 
@@ -50,6 +51,7 @@ void								wd_server_log_reply_log(wd_user_t *, wi_p7_message_t *);
 
 wi_p7_message_t *					wd_user_read_message(wd_user_t *, wi_time_interval_t);
 wi_boolean_t						wd_user_write_message(wd_user_t *, wi_time_interval_t, wi_p7_message_t *);
+void								wd_user_flush_messages(wd_user_t *);
 
 void								wd_user_send_message(wd_user_t *, wi_p7_message_t *);
 void								wd_user_reply_message(wd_user_t *, wi_p7_message_t *, wi_p7_message_t *);
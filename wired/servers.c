@@ -36,6 +36,7 @@
 #include "server.h"
 #include "servers.h"
 #include "settings.h"
+#include "stats.h"
 #include "users.h"
 
 #define WD_SERVERS_UPDATE_INTERVAL		60.0
@@ -176,7 +177,6 @@ static void wd_servers_update_servers(wi_timer_t *timer) {
 	wi_enumerator_t		*enumerator;
 	wd_server_t			*server;
 	wi_time_interval_t	interval, update;
-	wi_boolean_t		changed = false;
 
 	wi_dictionary_rdlock(wd_servers);
 		
@@ -200,20 +200,13 @@ static void wd_servers_update_servers(wi_timer_t *timer) {
 
 					wd_servers_remove_stats_for_server(server);
 					
-					server->active	= false;
-					changed			= true;
+					server->active = false;
 				}
 			}
 		}
 	}
 
 	wi_dictionary_unlock(wd_servers);
-
-	if(changed) {
-		wi_lock_lock(wd_status_lock);
-		wd_write_status(true);
-		wi_lock_unlock(wd_status_lock);
-	}
 }
 
 
@@ -237,24 +230,19 @@ static void wd_servers_remove_server(wd_server_t *server) {
 
 
 static void wd_servers_add_stats_for_server(wd_server_t *server) {
-	wi_lock_lock(wd_status_lock);
-	wd_tracker_current_servers++;
-	wd_tracker_current_users += server->users;
-	wd_tracker_current_files += server->files_count;
-	wd_tracker_current_size += server->files_size;
-	wd_write_status(false);
-	wi_lock_unlock(wd_status_lock);
+	wd_stats_add(WD_STAT_TRACKER_SERVERS, 1);
+	wd_stats_add(WD_STAT_TRACKER_USERS, server->users);
+	wd_stats_add(WD_STAT_TRACKER_FILES, server->files_count);
+	wd_stats_add(WD_STAT_TRACKER_SIZE, server->files_size);
 }
 
 
 
 static void wd_servers_remove_stats_for_server(wd_server_t *server) {
-	wi_lock_lock(wd_status_lock);
-	wd_tracker_current_servers--;
-	wd_tracker_current_users -= server->users;
-	wd_tracker_current_files -= server->files_count;
-	wd_tracker_current_size -= server->files_size;
-	wi_lock_unlock(wd_status_lock);
+	wd_stats_add(WD_STAT_TRACKER_SERVERS, -1);
+	wd_stats_add(WD_STAT_TRACKER_USERS, -(int64_t) server->users);
+	wd_stats_add(WD_STAT_TRACKER_FILES, -(int64_t) server->files_count);
+	wd_stats_add(WD_STAT_TRACKER_SIZE, -(int64_t) server->files_size);
 }
 
 
@@ -336,10 +324,6 @@ void wd_servers_register_server(wd_user_t *user, wi_p7_message_t *message) {
 	
 	if(!results)
 		wi_log_error(WI_STR("Could not execute database statement: %m"));
-
-	wi_lock_lock(wd_status_lock);
-	wd_write_status(true);
-	wi_lock_unlock(wd_status_lock);
 }
 
 
@@ -365,10 +349,6 @@ wi_boolean_t wd_servers_update_server(wi_string_t *ip, wd_user_t *user, wi_p7_me
 	wi_p7_message_get_uint64_for_name(message, &server->files_size, WI_STR("wired.info.files.size"));
 
 	wd_servers_add_stats_for_server(server);
-
-	wi_lock_lock(wd_status_lock);
-	wd_write_status(true);
-	wi_lock_unlock(wd_status_lock);
 	
 	return true;
 }
@@ -30,12 +30,18 @@
 
 #include <wired/wired.h>
 
+#include "caches.h"
 #include "files.h"
+#include "handshakes.h"
 #include "main.h"
+#include "pipelines.h"
 #include "server.h"
+#include "shapers.h"
 #include "settings.h"
 #include "trackers.h"
 #include "transfers.h"
+#include "users.h"
+#include "workers.h"
 
 wi_config_t						*wd_config;
 
@@ -52,17 +58,34 @@ void wd_settings_initialize(void) {
 		WI_INT32(WI_CONFIG_BOOL),				WI_STR("enable tracker"),
 		WI_INT32(WI_CONFIG_PATH),				WI_STR("files"),
 		WI_INT32(WI_CONFIG_GROUP),				WI_STR("group"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("handler queue depth"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("handler threads"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("handshake queue depth"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("handshake queue depth per address"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("handshake threads"),
 		WI_INT32(WI_CONFIG_TIME_INTERVAL),		WI_STR("index time"),
 		WI_INT32(WI_CONFIG_STRING),				WI_STR("ip"),
 		WI_INT32(WI_CONFIG_BOOL),				WI_STR("map port"),
 		WI_INT32(WI_CONFIG_STRING),				WI_STR("name"),
 		WI_INT32(WI_CONFIG_PORT),				WI_STR("port"),
 		WI_INT32(WI_CONFIG_BOOL),				WI_STR("register"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("send queue depth"),
+		WI_INT32(WI_CONFIG_STRING),				WI_STR("send queue overflow"),
 		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("total download speed"),
 		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("total downloads"),
 		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("total upload speed"),
 		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("total uploads"),
 		WI_INT32(WI_CONFIG_STRINGLIST),			WI_STR("tracker"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer buffer size"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer cache file size"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer cache size"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer cache threshold"),
+		WI_INT32(WI_CONFIG_STRING),				WI_STR("transfer io priority"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer reads per volume"),
+		WI_INT32(WI_CONFIG_TIME_INTERVAL),		WI_STR("transfer sync interval"),
+		WI_INT32(WI_CONFIG_BOOL),				WI_STR("transfer tuning"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer tuning maximum"),
+		WI_INT32(WI_CONFIG_INTEGER),			WI_STR("transfer tuning minimum"),
 		WI_INT32(WI_CONFIG_USER),				WI_STR("user"),
 		NULL);
 	
@@ -74,16 +97,33 @@ void wd_settings_initialize(void) {
 		wi_number_with_bool(false),				WI_STR("enable tracker"),
 		WI_STR("files"),						WI_STR("files"),
 		WI_STR("daemon"),						WI_STR("group"),
+		WI_INT32(32),							WI_STR("handler queue depth"),
+		WI_INT32(16),							WI_STR("handler threads"),
+		WI_INT32(256),							WI_STR("handshake queue depth"),
+		WI_INT32(8),							WI_STR("handshake queue depth per address"),
+		WI_INT32(4),							WI_STR("handshake threads"),
 		WI_INT32(14400),						WI_STR("index time"),
 		wi_number_with_bool(false),				WI_STR("map port"),
 		WI_STR("Wired Server"),					WI_STR("name"),
 		WI_INT32(4871),							WI_STR("port"),
 		wi_number_with_bool(false),				WI_STR("register"),
+		WI_INT32(500),							WI_STR("send queue depth"),
+		WI_STR("coalesce"),						WI_STR("send queue overflow"),
 		WI_INT32(0),							WI_STR("total download speed"),
 		WI_INT32(10),							WI_STR("total downloads"),
 		WI_INT32(0),							WI_STR("total upload speed"),
 		WI_INT32(10),							WI_STR("total uploads"),
 		wi_array(),								WI_STR("tracker"),
+		WI_INT32(262144),						WI_STR("transfer buffer size"),
+		WI_INT32(1048576),						WI_STR("transfer cache file size"),
+		WI_INT32(33554432),						WI_STR("transfer cache size"),
+		WI_INT32(2),							WI_STR("transfer cache threshold"),
+		WI_STR("low"),							WI_STR("transfer io priority"),
+		WI_INT32(0),							WI_STR("transfer reads per volume"),
+		WI_INT32(5),							WI_STR("transfer sync interval"),
+		wi_number_with_bool(false),				WI_STR("transfer tuning"),
+		WI_INT32(50),							WI_STR("transfer tuning maximum"),
+		WI_INT32(2),							WI_STR("transfer tuning minimum"),
 		WI_STR("wired"),						WI_STR("user"),
 		NULL);
 	
@@ -109,10 +149,16 @@ wi_boolean_t wd_settings_read_config(void) {
 
 
 void wd_settings_apply_settings(wi_set_t *changes) {
+	wd_caches_apply_settings(changes);
 	wd_files_apply_settings(changes);
+	wd_handshakes_apply_settings(changes);
+	wd_pipelines_apply_settings(changes);
 	wd_server_apply_settings(changes);
+	wd_shapers_apply_settings(changes);
 	wd_trackers_apply_settings(changes);
 	wd_transfers_apply_settings(changes);
+	wd_users_apply_settings(changes);
+	wd_workers_apply_settings(changes);
 }
 
 
@@ -0,0 +1,365 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <wired/wired.h>
+
+#include "accounts.h"
+#include "settings.h"
+#include "shapers.h"
+#include "transfers.h"
+#include "users.h"
+
+#define WD_SHAPER_BURST_INTERVAL		0.1
+#define WD_SHAPER_MIN_BURST				65536
+#define WD_SHAPER_WAIT_INTERVAL			1.0
+
+
+/*
+ * Shapers form a tree per transfer direction: the server at the root, then
+ * the group, then the account, then one leaf per transfer. Every node with
+ * a rate is a token bucket, and sending charges the bytes to each bucket
+ * on the way to the root. Buckets may go into debt, and the sender sleeps
+ * until the deepest debt is repaid, waking up every so often to see if the
+ * user has gone away. Idle transfers take nothing,
+ * so whatever they leave unused is free for their siblings.
+ */
+
+struct _wd_shaper {
+	wi_runtime_base_t					base;
+	
+	wd_shaper_t							*parent;
+	wd_user_t							*user;
+	
+	wi_mutable_dictionary_t				*registry;
+	wi_string_t							*key;
+	wi_uinteger_t						references;
+	
+	wi_uinteger_t						rate;
+	double								tokens;
+	wi_time_interval_t					time;
+	
+	wd_transfer_type_t					type;
+};
+
+
+static wd_shaper_t *					wd_shapers_attach_shaper(wi_mutable_dictionary_t *, wi_string_t *, wd_shaper_t *, wi_uinteger_t);
+static void								wd_shapers_detach_shaper(wd_shaper_t *);
+
+static wd_shaper_t *					wd_shaper_init_with_parent(wd_shaper_t *, wd_shaper_t *, wd_transfer_type_t);
+static void								wd_shaper_dealloc(wi_runtime_instance_t *);
+static wi_string_t *					wd_shaper_description(wi_runtime_instance_t *);
+
+static void								wd_shaper_set_rate(wd_shaper_t *, wi_uinteger_t, wi_time_interval_t);
+static void								wd_shaper_refill(wd_shaper_t *, wi_time_interval_t);
+
+static wi_uinteger_t					wd_shaper_account_rate(wd_account_t *, wd_transfer_type_t);
+
+
+static wi_lock_t						*wd_shapers_lock;
+static wd_shaper_t						*wd_shapers_roots[2];
+static wi_mutable_dictionary_t			*wd_shapers_groups[2];
+static wi_mutable_dictionary_t			*wd_shapers_accounts[2];
+
+static wi_runtime_id_t					wd_shaper_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_shaper_runtime_class = {
+	"wd_shaper_t",
+	wd_shaper_dealloc,
+	NULL,
+	NULL,
+	wd_shaper_description,
+	NULL
+};
+
+
+
+void wd_shapers_initialize(void) {
+	wd_transfer_type_t		type;
+	
+	wd_shaper_runtime_id = wi_runtime_register_class(&wd_shaper_runtime_class);
+	
+	wd_shapers_lock = wi_lock_init(wi_lock_alloc());
+	
+	for(type = WD_TRANSFER_DOWNLOAD; type <= WD_TRANSFER_UPLOAD; type++) {
+		wd_shapers_roots[type]		= wd_shaper_init_with_parent(wd_shaper_alloc(), NULL, type);
+		wd_shapers_groups[type]		= wi_dictionary_init(wi_mutable_dictionary_alloc());
+		wd_shapers_accounts[type]	= wi_dictionary_init(wi_mutable_dictionary_alloc());
+	}
+}
+
+
+
+void wd_shapers_apply_settings(wi_set_t *changes) {
+	wi_time_interval_t		interval;
+	
+	interval = wi_time_interval();
+	
+	wi_lock_lock(wd_shapers_lock);
+	
+	wd_shaper_set_rate(wd_shapers_roots[WD_TRANSFER_DOWNLOAD],
+		wi_config_integer_for_name(wd_config, WI_STR("total download speed")), interval);
+	wd_shaper_set_rate(wd_shapers_roots[WD_TRANSFER_UPLOAD],
+		wi_config_integer_for_name(wd_config, WI_STR("total upload speed")), interval);
+	
+	wi_lock_unlock(wd_shapers_lock);
+}
+
+
+
+#pragma mark -
+
+static wd_shaper_t * wd_shapers_attach_shaper(wi_mutable_dictionary_t *registry, wi_string_t *key, wd_shaper_t *parent, wi_uinteger_t rate) {
+	wd_shaper_t		*shaper;
+	
+	shaper = wi_dictionary_data_for_key(registry, key);
+	
+	if(!shaper) {
+		shaper = wd_shaper_init_with_parent(wd_shaper_alloc(), parent, parent->type);
+		shaper->registry	= registry;
+		shaper->key			= wi_copy(key);
+		
+		wi_mutable_dictionary_set_data_for_key(registry, shaper, key);
+		wi_release(shaper);
+	}
+	
+	shaper->references++;
+	
+	wd_shaper_set_rate(shaper, rate, wi_time_interval());
+	
+	return shaper;
+}
+
+
+
+static void wd_shapers_detach_shaper(wd_shaper_t *shaper) {
+	if(!shaper->registry)
+		return;
+	
+	if(--shaper->references == 0)
+		wi_mutable_dictionary_remove_data_for_key(shaper->registry, shaper->key);
+}
+
+
+
+#pragma mark -
+
+wd_shaper_t * wd_shaper_alloc(void) {
+	return wi_runtime_create_instance(wd_shaper_runtime_id, sizeof(wd_shaper_t));
+}
+
+
+
+wd_shaper_t * wd_shaper_init_with_transfer(wd_shaper_t *shaper, wd_transfer_t *transfer) {
+	wd_account_t		*account, *group;
+	wi_string_t			*groupname;
+	wd_shaper_t			*parent;
+	wi_uinteger_t		grouprate;
+	
+	account		= wd_user_account(transfer->user);
+	groupname	= account ? wd_account_group(account) : NULL;
+	grouprate	= 0;
+	
+	if(groupname && wi_string_length(groupname) > 0) {
+		group = wd_accounts_read_group(groupname);
+		
+		if(group)
+			grouprate = wd_shaper_account_rate(group, transfer->type);
+	} else {
+		groupname = NULL;
+	}
+	
+	wi_lock_lock(wd_shapers_lock);
+	
+	parent = wd_shapers_roots[transfer->type];
+	
+	if(groupname)
+		parent = wd_shapers_attach_shaper(wd_shapers_groups[transfer->type], groupname, parent, grouprate);
+	
+	if(transfer->key) {
+		parent = wd_shapers_attach_shaper(wd_shapers_accounts[transfer->type], transfer->key, parent,
+			account ? wd_shaper_account_rate(account, transfer->type) : 0);
+	}
+	
+	shaper = wd_shaper_init_with_parent(shaper, parent, transfer->type);
+	shaper->user = wi_retain(transfer->user);
+	
+	wi_lock_unlock(wd_shapers_lock);
+	
+	return shaper;
+}
+
+
+
+static wd_shaper_t * wd_shaper_init_with_parent(wd_shaper_t *shaper, wd_shaper_t *parent, wd_transfer_type_t type) {
+	shaper->parent		= wi_retain(parent);
+	shaper->type		= type;
+	shaper->time		= wi_time_interval();
+	
+	return shaper;
+}
+
+
+
+static void wd_shaper_dealloc(wi_runtime_instance_t *instance) {
+	wd_shaper_t		*shaper = instance;
+	
+	wi_release(shaper->parent);
+	wi_release(shaper->user);
+	wi_release(shaper->key);
+}
+
+
+
+static wi_string_t * wd_shaper_description(wi_runtime_instance_t *instance) {
+	wd_shaper_t		*shaper = instance;
+	
+	return wi_string_with_format(WI_STR("<%@ %p>{key = %@, rate = %lu, tokens = %.0f}"),
+		wi_runtime_class_name(shaper),
+		shaper,
+		shaper->key,
+		shaper->rate,
+		shaper->tokens);
+}
+
+
+
+#pragma mark -
+
+void wd_shaper_update_account(wd_shaper_t *shaper, wd_account_t *account) {
+	wd_account_t		*group;
+	wi_string_t			*groupname;
+	wd_shaper_t			*parent;
+	wi_time_interval_t	interval;
+	
+	groupname	= wd_account_group(account);
+	group		= (groupname && wi_string_length(groupname) > 0) ? wd_accounts_read_group(groupname) : NULL;
+	interval	= wi_time_interval();
+	
+	wi_lock_lock(wd_shapers_lock);
+	
+	parent = shaper->parent;
+	
+	if(parent && parent->registry == wd_shapers_accounts[shaper->type]) {
+		wd_shaper_set_rate(parent, wd_shaper_account_rate(account, shaper->type), interval);
+		
+		parent = parent->parent;
+	}
+	
+	if(group && parent && parent->registry == wd_shapers_groups[shaper->type] && wi_is_equal(parent->key, groupname))
+		wd_shaper_set_rate(parent, wd_shaper_account_rate(group, shaper->type), interval);
+	
+	wi_lock_unlock(wd_shapers_lock);
+}
+
+
+
+void wd_shaper_limit(wd_shaper_t *shaper, wi_file_offset_t bytes) {
+	wd_shaper_t			*node;
+	wi_time_interval_t	interval, wait;
+	
+	interval	= wi_time_interval();
+	wait		= 0.0;
+	
+	wi_lock_lock(wd_shapers_lock);
+	
+	for(node = shaper; node; node = node->parent) {
+		if(node->rate == 0)
+			continue;
+		
+		wd_shaper_refill(node, interval);
+		
+		node->tokens -= bytes;
+		
+		if(node->tokens < 0.0)
+			wait = WI_MAX(wait, -node->tokens / node->rate);
+	}
+	
+	wi_lock_unlock(wd_shapers_lock);
+	
+	while(wait > 0.0 && wd_user_state(shaper->user) == WD_USER_LOGGED_IN) {
+		wi_thread_sleep(WI_MIN(wait, WD_SHAPER_WAIT_INTERVAL));
+		
+		wait -= WD_SHAPER_WAIT_INTERVAL;
+	}
+}
+
+
+
+void wd_shaper_close(wd_shaper_t *shaper) {
+	wd_shaper_t		*node;
+	
+	wi_lock_lock(wd_shapers_lock);
+	
+	for(node = shaper->parent; node; node = node->parent)
+		wd_shapers_detach_shaper(node);
+	
+	wi_lock_unlock(wd_shapers_lock);
+}
+
+
+
+#pragma mark -
+
+static void wd_shaper_set_rate(wd_shaper_t *shaper, wi_uinteger_t rate, wi_time_interval_t interval) {
+	if(shaper->rate == rate)
+		return;
+	
+	wd_shaper_refill(shaper, interval);
+	
+	if(rate == 0 || shaper->rate == 0)
+		shaper->tokens = 0.0;
+	
+	shaper->rate = rate;
+	shaper->time = interval;
+}
+
+
+
+static void wd_shaper_refill(wd_shaper_t *shaper, wi_time_interval_t interval) {
+	double		burst;
+	
+	if(shaper->rate > 0 && interval > shaper->time) {
+		burst = WI_MAX(WD_SHAPER_MIN_BURST, shaper->rate * WD_SHAPER_BURST_INTERVAL);
+		
+		shaper->tokens = WI_MIN(burst, shaper->tokens + ((interval - shaper->time) * shaper->rate));
+	}
+	
+	shaper->time = interval;
+}
+
+
+
+#pragma mark -
+
+static wi_uinteger_t wd_shaper_account_rate(wd_account_t *account, wd_transfer_type_t type) {
+	if(type == WD_TRANSFER_DOWNLOAD)
+		return wd_account_transfer_download_speed_limit(account);
+	else
+		return wd_account_transfer_upload_speed_limit(account);
+}
@@ -0,0 +1,163 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <wired/wired.h>
+
+#include "main.h"
+#include "stats.h"
+
+#define WD_STATS_INTERVAL				1.0
+#define WD_STATS_SHARDS					32
+#define WD_STATS_SHARD_SIZE				16
+
+
+static void								wd_stats_thread(wi_runtime_instance_t *);
+static void								wd_stats_snapshot(int64_t *);
+static void								wd_stats_write(int64_t *);
+
+
+/* Each thread adds to its own 128 byte shard, aligned so that no two shards share a cache line or an adjacent-line prefetch pair */
+static int64_t							wd_stats_shards[WD_STATS_SHARDS][WD_STATS_SHARD_SIZE] __attribute__((aligned(128)));
+
+
+
+void wd_stats_initialize(void) {
+	memset(wd_stats_shards, 0, sizeof(wd_stats_shards));
+}
+
+
+
+void wd_stats_schedule(void) {
+	int64_t		values[WD_STAT_LAST];
+	
+	wd_stats_snapshot(values);
+	wd_stats_write(values);
+	
+	if(!wi_thread_create_thread(wd_stats_thread, NULL))
+		wi_log_fatal(WI_STR("Could not create a status thread: %m"));
+}
+
+
+
+void wd_stats_cleanup(void) {
+	wi_string_t		*path;
+	
+	path = WI_STR("wired.status");
+
+	if(!wi_fs_delete_path(path))
+		wi_log_error(WI_STR("Could not delete \"%@\": %m"), path);
+}
+
+
+
+#pragma mark -
+
+void wd_stats_add(wd_stat_t stat, int64_t value) {
+	uint64_t		shard;
+	
+	shard = ((uint64_t) (uintptr_t) pthread_self() * 0x9E3779B97F4A7C15ULL) >> 32;
+	
+	__sync_fetch_and_add(&wd_stats_shards[shard % WD_STATS_SHARDS][stat], value);
+}
+
+
+
+#pragma mark -
+
+static void wd_stats_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t		*pool;
+	int64_t			values[WD_STAT_LAST], published[WD_STAT_LAST];
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	wd_stats_snapshot(published);
+	
+	while(true) {
+		wi_thread_sleep(WD_STATS_INTERVAL);
+		
+		wd_stats_snapshot(values);
+		
+		if(memcmp(values, published, sizeof(values)) != 0) {
+			wd_stats_write(values);
+			
+			memcpy(published, values, sizeof(published));
+		}
+		
+		wi_pool_drain(pool);
+	}
+	
+	wi_release(pool);
+}
+
+
+
+static void wd_stats_snapshot(int64_t *values) {
+	wi_uinteger_t		i, j;
+	
+	memset(values, 0, WD_STAT_LAST * sizeof(int64_t));
+	
+	for(i = 0; i < WD_STATS_SHARDS; i++) {
+		for(j = 0; j < WD_STAT_LAST; j++)
+			values[j] += __sync_fetch_and_add(&wd_stats_shards[i][j], 0);
+	}
+}
+
+
+
+static void wd_stats_write(int64_t *values) {
+	wi_string_t		*path, *string;
+	
+	wi_process_set_name(wi_process(), wi_string_with_format(WI_STR("%u %@"),
+		(wi_uinteger_t) values[WD_STAT_CURRENT_USERS],
+		values[WD_STAT_CURRENT_USERS] == 1
+			? WI_STR("user")
+			: WI_STR("users")));
+
+	path = WI_STR("wired.status");
+	string = wi_string_with_format(WI_STR("%.0f %u %u %u %u %u %u %llu %llu %u %u %llu %llu\n"),
+								   wi_date_time_interval(wd_start_date),
+								   (wi_uinteger_t) values[WD_STAT_CURRENT_USERS],
+								   (wi_uinteger_t) values[WD_STAT_TOTAL_USERS],
+								   (wi_uinteger_t) values[WD_STAT_CURRENT_DOWNLOADS],
+								   (wi_uinteger_t) values[WD_STAT_TOTAL_DOWNLOADS],
+								   (wi_uinteger_t) values[WD_STAT_CURRENT_UPLOADS],
+								   (wi_uinteger_t) values[WD_STAT_TOTAL_UPLOADS],
+								   (wi_file_offset_t) values[WD_STAT_DOWNLOADS_TRAFFIC],
+								   (wi_file_offset_t) values[WD_STAT_UPLOADS_TRAFFIC],
+								   (wi_uinteger_t) values[WD_STAT_TRACKER_SERVERS],
+								   (wi_uinteger_t) values[WD_STAT_TRACKER_USERS],
+								   (wi_file_offset_t) values[WD_STAT_TRACKER_FILES],
+								   (wi_file_offset_t) values[WD_STAT_TRACKER_SIZE]);
+	
+	if(!wi_string_write_to_file(string, path))
+		wi_log_error(WI_STR("Could not write to \"%@\": %m"), path);
+}
@@ -0,0 +1,59 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WD_STATS_H
+#define WD_STATS_H 1
+
+#include <wired/wired.h>
+
+enum _wd_stat {
+	WD_STAT_CURRENT_USERS				= 0,
+	WD_STAT_TOTAL_USERS,
+	WD_STAT_CURRENT_DOWNLOADS,
+	WD_STAT_TOTAL_DOWNLOADS,
+	WD_STAT_CURRENT_UPLOADS,
+	WD_STAT_TOTAL_UPLOADS,
+	WD_STAT_DOWNLOADS_TRAFFIC,
+	WD_STAT_UPLOADS_TRAFFIC,
+	WD_STAT_TRACKER_SERVERS,
+	WD_STAT_TRACKER_USERS,
+	WD_STAT_TRACKER_FILES,
+	WD_STAT_TRACKER_SIZE,
+	
+	WD_STAT_LAST
+};
+typedef enum _wd_stat					wd_stat_t;
+
+
+void									wd_stats_initialize(void);
+void									wd_stats_schedule(void);
+void									wd_stats_cleanup(void);
+
+void									wd_stats_add(wd_stat_t, int64_t);
+
+#endif /* WD_STATS_H */
@@ -0,0 +1,264 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <wired/wired.h>
+
+#include "metrics.h"
+#include "timeouts.h"
+
+#define WD_TIMEOUTS_SLOTS				512
+#define WD_TIMEOUTS_TICK				1.0
+
+/*
+ * A hashed timer wheel. Timeouts further away than one revolution are kept
+ * in their slot with a count of remaining rounds, so each tick only visits
+ * the timeouts hashed to the current slot.
+ */
+
+
+struct _wd_timeout {
+	wi_runtime_base_t					base;
+	
+	wd_timeout_func_t					*func;
+	wi_runtime_instance_t				*instance;
+	
+	wd_timeout_t						*prev, *next;
+	wi_uinteger_t						slot;
+	wi_uinteger_t						rounds;
+	wi_boolean_t						scheduled;
+	wi_boolean_t						invalidated;
+};
+
+
+static void								wd_timeouts_tick(wi_timer_t *);
+static void								wd_timeouts_unlink(wd_timeout_t *);
+
+
+static wd_timeout_t						*wd_timeouts_slots[WD_TIMEOUTS_SLOTS];
+static wi_uinteger_t					wd_timeouts_cursor;
+static wi_time_interval_t				wd_timeouts_time;
+static wi_uinteger_t					wd_timeouts_count;
+static wi_lock_t						*wd_timeouts_lock;
+static wi_timer_t						*wd_timeouts_timer;
+
+static wi_runtime_id_t					wd_timeout_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_timeout_runtime_class = {
+	"wd_timeout_t",
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+
+
+void wd_timeouts_initialize(void) {
+	wd_timeout_runtime_id = wi_runtime_register_class(&wd_timeout_runtime_class);
+	
+	wd_timeouts_lock = wi_lock_init(wi_lock_alloc());
+	wd_timeouts_time = wi_time_interval();
+	
+	wd_timeouts_timer = wi_timer_init_with_function(wi_timer_alloc(),
+													wd_timeouts_tick,
+													WD_TIMEOUTS_TICK,
+													true);
+}
+
+
+
+void wd_timeouts_schedule(void) {
+	wi_timer_schedule(wd_timeouts_timer);
+}
+
+
+
+#pragma mark -
+
+static void wd_timeouts_tick(wi_timer_t *timer) {
+	wi_mutable_array_t		*expired = NULL;
+	wd_timeout_t			*timeout, *next;
+	wi_time_interval_t		interval;
+	wi_uinteger_t			i, count;
+	wi_boolean_t			invalidated;
+	
+	interval = wi_time_interval();
+	
+	wi_lock_lock(wd_timeouts_lock);
+	
+	if(interval - wd_timeouts_time > WD_TIMEOUTS_SLOTS * WD_TIMEOUTS_TICK)
+		wd_timeouts_time = interval - (WD_TIMEOUTS_SLOTS * WD_TIMEOUTS_TICK);
+	
+	while(wd_timeouts_time + WD_TIMEOUTS_TICK <= interval) {
+		wd_timeouts_time += WD_TIMEOUTS_TICK;
+		wd_timeouts_cursor = (wd_timeouts_cursor + 1) % WD_TIMEOUTS_SLOTS;
+		
+		for(timeout = wd_timeouts_slots[wd_timeouts_cursor]; timeout; timeout = next) {
+			next = timeout->next;
+			
+			if(timeout->rounds > 0) {
+				timeout->rounds--;
+				
+				continue;
+			}
+			
+			wd_timeouts_unlink(timeout);
+			
+			if(!expired)
+				expired = wi_mutable_array();
+			
+			wi_mutable_array_add_data(expired, timeout);
+			wi_release(timeout);
+		}
+	}
+	
+	wd_metrics_set(WD_METRIC_TIMEOUTS_PENDING, wd_timeouts_count);
+	
+	wi_lock_unlock(wd_timeouts_lock);
+	
+	if(!expired)
+		return;
+	
+	count = wi_array_count(expired);
+	
+	wd_metrics_add(WD_METRIC_TIMEOUTS_EXPIRED, count);
+	
+	for(i = 0; i < count; i++) {
+		timeout = WI_ARRAY(expired, i);
+		
+		wi_lock_lock(wd_timeouts_lock);
+		invalidated = timeout->invalidated;
+		wi_lock_unlock(wd_timeouts_lock);
+		
+		if(!invalidated)
+			(*timeout->func)(timeout, timeout->instance);
+		
+		wi_release(timeout->instance);
+	}
+}
+
+
+
+static void wd_timeouts_unlink(wd_timeout_t *timeout) {
+	if(timeout->prev)
+		timeout->prev->next = timeout->next;
+	else
+		wd_timeouts_slots[timeout->slot] = timeout->next;
+	
+	if(timeout->next)
+		timeout->next->prev = timeout->prev;
+	
+	timeout->prev		= NULL;
+	timeout->next		= NULL;
+	timeout->scheduled	= false;
+	
+	wd_timeouts_count--;
+}
+
+
+
+#pragma mark -
+
+wd_timeout_t * wd_timeout_alloc(void) {
+	return wi_runtime_create_instance(wd_timeout_runtime_id, sizeof(wd_timeout_t));
+}
+
+
+
+wd_timeout_t * wd_timeout_init_with_function(wd_timeout_t *timeout, wd_timeout_func_t *func, wi_runtime_instance_t *instance) {
+	timeout->func		= func;
+	timeout->instance	= instance;
+	
+	return timeout;
+}
+
+
+
+#pragma mark -
+
+void wd_timeout_schedule(wd_timeout_t *timeout, wi_time_interval_t interval) {
+	wi_uinteger_t		ticks;
+	
+	ticks = (interval > 0.0) ? (wi_uinteger_t) ceil(interval / WD_TIMEOUTS_TICK) : 1;
+	ticks = WI_MAX(1, ticks);
+	
+	wi_lock_lock(wd_timeouts_lock);
+	
+	/* A callback that was already running when its timeout was invalidated must not re-arm it */
+	if(timeout->invalidated) {
+		wi_lock_unlock(wd_timeouts_lock);
+		
+		return;
+	}
+	
+	if(timeout->scheduled) {
+		wd_timeouts_unlink(timeout);
+	} else {
+		wi_retain(timeout);
+		wi_retain(timeout->instance);
+	}
+	
+	timeout->slot		= (wd_timeouts_cursor + ticks) % WD_TIMEOUTS_SLOTS;
+	timeout->rounds		= (ticks - 1) / WD_TIMEOUTS_SLOTS;
+	timeout->prev		= NULL;
+	timeout->next		= wd_timeouts_slots[timeout->slot];
+	timeout->scheduled	= true;
+	
+	if(timeout->next)
+		timeout->next->prev = timeout;
+	
+	wd_timeouts_slots[timeout->slot] = timeout;
+	wd_timeouts_count++;
+	
+	wi_lock_unlock(wd_timeouts_lock);
+}
+
+
+
+void wd_timeout_invalidate(wd_timeout_t *timeout) {
+	wi_boolean_t		scheduled;
+	
+	wi_lock_lock(wd_timeouts_lock);
+	
+	timeout->invalidated = true;
+	
+	scheduled = timeout->scheduled;
+	
+	if(scheduled)
+		wd_timeouts_unlink(timeout);
+	
+	wi_lock_unlock(wd_timeouts_lock);
+	
+	if(scheduled) {
+		wi_release(timeout->instance);
+		wi_release(timeout);
+	}
+}
@@ -0,0 +1,47 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WD_TIMEOUTS_H
+#define WD_TIMEOUTS_H 1
+
+#include <wired/wired.h>
+
+typedef struct _wd_timeout				wd_timeout_t;
+typedef void							wd_timeout_func_t(wd_timeout_t *, wi_runtime_instance_t *);
+
+
+void									wd_timeouts_initialize(void);
+void									wd_timeouts_schedule(void);
+
+wd_timeout_t *							wd_timeout_alloc(void);
+wd_timeout_t *							wd_timeout_init_with_function(wd_timeout_t *, wd_timeout_func_t *, wi_runtime_instance_t *);
+
+void									wd_timeout_schedule(wd_timeout_t *, wi_time_interval_t);
+void									wd_timeout_invalidate(wd_timeout_t *);
+
+#endif /* WD_TIMEOUTS_H */
@@ -28,6 +28,13 @@
 
 #include "config.h"
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -36,17 +43,32 @@
 #include <openssl/err.h>
 #include <wired/wired.h>
 
+#include "caches.h"
 #include "files.h"
 #include "index.h"
 #include "main.h"
 #include "messages.h"
+#include "metrics.h"
+#include "pipelines.h"
 #include "server.h"
 #include "settings.h"
+#include "shapers.h"
+#include "stats.h"
 #include "transfers.h"
 
 #define WD_TRANSFERS_PARTIAL_EXTENSION		"WiredTransfer"
 
-#define WD_TRANSFER_BUFFER_SIZE				16384
+#define WD_TRANSFERS_STATISTICS_INTERVAL	1.0
+
+#define WD_TRANSFERS_MAX_SEGMENTS			4
+
+#define WD_TRANSFERS_TUNING_INTERVAL		10.0
+#define WD_TRANSFERS_TUNING_GAIN			0.05
+#define WD_TRANSFERS_TUNING_DISK_WAIT		0.5
+#define WD_TRANSFERS_TUNING_SOCKET_WAIT		0.5
+#define WD_TRANSFERS_TUNING_HOLD			6
+
+#define WD_TRANSFER_SENDFILE_SIZE			1048576
 
 
 enum _wd_transfers_statistics_type {
@@ -57,36 +79,112 @@ enum _wd_transfers_statistics_type {
 typedef enum _wd_transfers_statistics_type	wd_transfers_statistics_type_t;
 
 
-static void									wd_transfers_queue_thread(wi_runtime_instance_t *);
+struct _wd_transfers_queue {
+	wi_runtime_base_t						base;
+	
+	wi_string_t								*key;
+	wd_transfer_type_t						type;
+	wi_mutable_array_t						*transfers;
+	wi_integer_t							index;
+};
+typedef struct _wd_transfers_queue			wd_transfers_queue_t;
+
+
+struct _wd_transfers_tuning {
+	wi_uinteger_t							slots;
+	wi_integer_t							step;
+	wi_uinteger_t							hold;
+	double									rate;
+	
+	wi_file_offset_t						bytes;
+	wi_time_interval_t						diskwait, socketwait;
+};
+typedef struct _wd_transfers_tuning			wd_transfers_tuning_t;
+
+
+static void									wd_transfers_tune(wi_timer_t *);
+static wi_uinteger_t						wd_transfers_slots(wd_transfer_type_t);
 static wi_integer_t							wd_transfers_queue_compare(wi_runtime_instance_t *, wi_runtime_instance_t *);
 static wi_boolean_t							wd_transfers_wait_until_ready(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wd_transfer_t *						wd_transfers_segment_leader(wd_transfer_t *);
+static wi_boolean_t							wd_transfers_wait_for_leader(wd_transfer_t *);
+static void									wd_transfers_finish_segment(wd_transfer_t *, wd_user_t *, wi_boolean_t);
+static void									wd_transfers_enqueue_transfer(wd_transfer_t *);
+static wi_boolean_t							wd_transfers_dequeue_transfer(wd_transfer_t *);
+static void									wd_transfers_finish_transfer(wd_transfer_t *);
+static void									wd_transfers_dispatch(wd_transfer_type_t);
+static void									wd_transfers_update_positions(wd_transfer_type_t, wi_uinteger_t);
+static wi_boolean_t							wd_transfers_is_full(wd_transfer_type_t);
+static wi_boolean_t							wd_transfers_is_full_for_user(wd_transfer_t *);
+static void									wd_transfers_heap_push(wd_transfers_queue_t *);
+static void									wd_transfers_heap_remove(wd_transfers_queue_t *);
+static void									wd_transfers_heap_sift_up(wd_transfers_queue_t *);
+static void									wd_transfers_heap_sift_down(wd_transfers_queue_t *);
+static wd_transfers_queue_t *				wd_transfers_queue_alloc(void);
+static wd_transfers_queue_t *				wd_transfers_queue_init_with_key(wd_transfers_queue_t *, wi_string_t *, wd_transfer_type_t);
+static void									wd_transfers_queue_dealloc(wi_runtime_instance_t *);
 static wi_boolean_t							wd_transfers_run_download(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wi_boolean_t							wd_transfers_run_directory_download(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wi_boolean_t							wd_transfers_list_directory_download(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wi_p7_message_t *					wd_transfers_download_message(wd_transfer_t *, wi_p7_message_t *);
+static wi_p7_message_t *					wd_transfers_okay_message(wi_p7_message_t *);
 static wi_boolean_t							wd_transfers_run_upload(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wi_boolean_t							wd_transfers_run_batch_upload(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wi_boolean_t							wd_transfers_preallocate_upload(wd_transfer_t *, wd_user_t *, wi_p7_message_t *);
+static wi_boolean_t							wd_transfers_create_batch_directories(wd_transfer_t *, wd_user_t *, wi_p7_message_t *, wi_mutable_array_t *);
+static wi_p7_message_t *					wd_transfers_upload_ready_message(wd_transfer_t *, wi_p7_message_t *);
+static wi_p7_message_t *					wd_transfers_read_upload_message(wd_user_t *);
+static wi_boolean_t							wd_transfers_upload_is_allowed(wi_string_t *, wd_user_t *);
+static wi_string_t *						wd_transfers_complete_upload(wd_transfer_t *);
 static wi_string_t *						wd_transfers_transfer_key_for_user(wd_user_t *);
 static void									wd_transfers_add_or_remove_transfer(wd_transfer_t *, wi_boolean_t);
 static void									wd_transfers_note_statistics(wd_transfer_type_t, wd_transfers_statistics_type_t, wi_file_offset_t);
+static void									wd_transfers_note_tuning(wd_transfer_type_t, wi_file_offset_t, wi_time_interval_t, wi_time_interval_t);
 
 static wd_transfer_t *						wd_transfer_alloc(void);
 static wd_transfer_t *						wd_transfer_init(wd_transfer_t *);
 static void									wd_transfer_dealloc(wi_runtime_instance_t *);
 static wi_string_t *						wd_transfer_description(wi_runtime_instance_t *);
 
-static inline void							wd_transfer_limit_speed(wd_transfer_t *, wi_uinteger_t, wi_uinteger_t, wi_uinteger_t, wi_uinteger_t, ssize_t, wi_time_interval_t, wi_time_interval_t);
-
+static wd_transfer_t *						wd_transfer_open_download(wi_string_t *, wi_file_offset_t, wi_file_offset_t, wi_file_offset_t, wd_user_t *, wi_p7_message_t *);
 static wi_boolean_t							wd_transfer_download(wd_transfer_t *);
+static wi_boolean_t							wd_transfer_can_sendfile(wi_p7_socket_t *);
+static wi_boolean_t							wd_transfer_sendfile(int, int, wi_file_offset_t, wi_time_interval_t);
+#ifdef HAVE_SYS_SENDFILE_H
+static wi_boolean_t							wd_transfer_send_padding(int, wi_file_offset_t, wi_time_interval_t);
+#endif
 static wi_boolean_t							wd_transfer_upload(wd_transfer_t *);
+static wi_boolean_t							wd_transfer_restart_upload(wd_transfer_t *, wi_p7_message_t *);
 
 
 static wi_mutable_array_t					*wd_transfers;
 
 static wi_uinteger_t						wd_transfers_total_downloads, wd_transfers_total_uploads;
-static wi_uinteger_t						wd_transfers_total_download_speed, wd_transfers_total_upload_speed;
+
+static wi_boolean_t							wd_transfers_tuning_enabled;
+static wi_uinteger_t						wd_transfers_tuning_minimum, wd_transfers_tuning_maximum;
+static wd_transfers_tuning_t				wd_transfers_tuning[2];
+static wi_timer_t							*wd_transfers_tuning_timer;
 
 static wi_lock_t							*wd_transfers_status_lock;
 static wi_mutable_dictionary_t				*wd_transfers_user_downloads, *wd_transfers_user_uploads;
 static wi_uinteger_t						wd_transfers_active_downloads, wd_transfers_active_uploads;
 
-static wi_condition_lock_t					*wd_transfers_queue_lock;
+static wi_lock_t							*wd_transfers_queues_lock;
+static wi_mutable_dictionary_t				*wd_transfers_queues[2];
+static wi_mutable_array_t					*wd_transfers_queued[2];
+static wd_transfers_queue_t					**wd_transfers_heaps[2];
+static wi_uinteger_t						wd_transfers_heap_counts[2], wd_transfers_heap_capacities[2];
+
+static wi_runtime_id_t						wd_transfers_queue_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t					wd_transfers_queue_runtime_class = {
+	"wd_transfers_queue_t",
+	wd_transfers_queue_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
 
 static wi_runtime_id_t						wd_transfer_runtime_id = WI_RUNTIME_ID_NULL;
 static wi_runtime_class_t					wd_transfer_runtime_class = {
@@ -101,7 +199,10 @@ static wi_runtime_class_t					wd_transfer_runtime_class = {
 
 
 void wd_transfers_initialize(void) {
+	wd_transfer_type_t		type;
+	
 	wd_transfer_runtime_id = wi_runtime_register_class(&wd_transfer_runtime_class);
+	wd_transfers_queue_runtime_id = wi_runtime_register_class(&wd_transfers_queue_runtime_class);
 
 	wd_transfers = wi_array_init(wi_mutable_array_alloc());
 
@@ -113,154 +214,169 @@ void wd_transfers_initialize(void) {
 	wd_transfers_user_uploads = wi_dictionary_init_with_capacity_and_callbacks(wi_mutable_dictionary_alloc(),
 		0, wi_dictionary_default_key_callbacks, wi_dictionary_null_value_callbacks);
 	
-	wd_transfers_queue_lock = wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
+	wd_transfers_queues_lock = wi_lock_init(wi_lock_alloc());
+	
+	for(type = WD_TRANSFER_DOWNLOAD; type <= WD_TRANSFER_UPLOAD; type++) {
+		wd_transfers_queues[type] = wi_dictionary_init(wi_mutable_dictionary_alloc());
+		wd_transfers_queued[type] = wi_array_init(wi_mutable_array_alloc());
+	}
+	
+	wd_transfers_tuning_timer = wi_timer_init_with_function(wi_timer_alloc(),
+															wd_transfers_tune,
+															WD_TRANSFERS_TUNING_INTERVAL,
+															true);
 }
 
 
 
 void wd_transfers_apply_settings(wi_set_t *changes) {
+	wd_transfers_tuning_t	*tuning;
+	wd_transfer_type_t		type;
+	wi_uinteger_t			total;
+	
+	wi_lock_lock(wd_transfers_status_lock);
+	
 	wd_transfers_total_downloads		= wi_config_integer_for_name(wd_config, WI_STR("total downloads"));
 	wd_transfers_total_uploads			= wi_config_integer_for_name(wd_config, WI_STR("total uploads"));
-	wd_transfers_total_download_speed	= wi_config_integer_for_name(wd_config, WI_STR("total download speed"));
-	wd_transfers_total_upload_speed		= wi_config_integer_for_name(wd_config, WI_STR("total upload speed"));
-
-	wi_condition_lock_lock(wd_transfers_queue_lock);	
-	wi_condition_lock_unlock_with_condition(wd_transfers_queue_lock, 1);
+	
+	wd_transfers_tuning_enabled			= wi_config_bool_for_name(wd_config, WI_STR("transfer tuning"));
+	wd_transfers_tuning_minimum			= WI_MAX(1, wi_config_integer_for_name(wd_config, WI_STR("transfer tuning minimum")));
+	wd_transfers_tuning_maximum			= WI_MAX(wd_transfers_tuning_minimum, wi_config_integer_for_name(wd_config, WI_STR("transfer tuning maximum")));
+	
+	for(type = WD_TRANSFER_DOWNLOAD; type <= WD_TRANSFER_UPLOAD; type++) {
+		tuning	= &wd_transfers_tuning[type];
+		total	= (type == WD_TRANSFER_DOWNLOAD) ? wd_transfers_total_downloads : wd_transfers_total_uploads;
+		
+		/* Tuning starts from the configured limit, and keeps its slots across reloads */
+		if(!wd_transfers_tuning_enabled || tuning->slots == 0)
+			tuning->slots = (total > 0) ? total : wd_transfers_tuning_maximum;
+		
+		if(wd_transfers_tuning_enabled)
+			tuning->slots = WI_MIN(WI_MAX(tuning->slots, wd_transfers_tuning_minimum), wd_transfers_tuning_maximum);
+		
+		tuning->step = 0;
+		tuning->hold = 0;
+	}
+	
+	wi_lock_unlock(wd_transfers_status_lock);
+	
+	wi_lock_lock(wd_transfers_queues_lock);
+	wd_transfers_dispatch(WD_TRANSFER_DOWNLOAD);
+	wd_transfers_dispatch(WD_TRANSFER_UPLOAD);
+	wi_lock_unlock(wd_transfers_queues_lock);
 }
 
 
 
 void wd_transfers_schedule(void) {
-	if(!wi_thread_create_thread(wd_transfers_queue_thread, NULL))
-		wi_log_fatal(WI_STR("Could not create a transfers queue thread: %m"));
+	wi_timer_schedule(wd_transfers_tuning_timer);
 }
 
 
 
 #pragma mark -
 
-static void wd_transfers_queue_thread(wi_runtime_instance_t *argument) {
-	wi_pool_t					*pool;
-	wi_enumerator_t				*enumerator;
-	wi_mutable_dictionary_t		*key_queues;
-	wi_mutable_array_t			*key_queue, *keys;
-	wi_string_t					*key;
-	wd_transfer_t				*transfer;
-	wd_account_t				*account;
-	wi_uinteger_t				user_downloads, user_uploads, user_transfers;
-	wi_uinteger_t				new_position, position, queue, i, count, longest_queue;
-	
-	pool = wi_pool_init(wi_pool_alloc());
-	
-	key_queues = wi_dictionary_init(wi_mutable_dictionary_alloc());
+static void wd_transfers_tune(wi_timer_t *timer) {
+	wd_transfers_tuning_t	*tuning;
+	wi_string_t				*reason;
+	wd_transfer_type_t		type;
+	wi_uinteger_t			active, queued, slots, previous;
+	double					rate, diskwait, socketwait;
 	
-	while(true) {
-		wi_mutable_dictionary_remove_all_data(key_queues);
-
-		wi_condition_lock_lock_when_condition(wd_transfers_queue_lock, 1, 0.0);
-		wi_array_rdlock(wd_transfers);
+	for(type = WD_TRANSFER_DOWNLOAD; type <= WD_TRANSFER_UPLOAD; type++) {
+		wi_lock_lock(wd_transfers_queues_lock);
 		
-		longest_queue	= 0;
-		enumerator		= wi_array_data_enumerator(wd_transfers);
+		queued = wd_transfers_heap_counts[type];
 		
-		while((transfer = wi_enumerator_next_data(enumerator))) {
-			wi_condition_lock_lock(transfer->queue_lock);
-			
-			if(transfer->state == WD_TRANSFER_QUEUED && transfer->queue != 0) {
-				key_queue = wi_dictionary_data_for_key(key_queues, transfer->key);
-				
-				if(!key_queue) {
-					key_queue = wi_mutable_array();
-					
-					wi_mutable_dictionary_set_data_for_key(key_queues, key_queue, transfer->key);
-				}
-				
-				wi_mutable_array_add_data(key_queue, transfer);
-				
-				if(wi_array_count(key_queue) > longest_queue)
-					longest_queue = wi_array_count(key_queue);
+		wi_lock_lock(wd_transfers_status_lock);
+		
+		tuning		= &wd_transfers_tuning[type];
+		active		= (type == WD_TRANSFER_DOWNLOAD) ? wd_transfers_active_downloads : wd_transfers_active_uploads;
+		rate		= tuning->bytes / WD_TRANSFERS_TUNING_INTERVAL;
+		diskwait	= (active > 0) ? tuning->diskwait / (WD_TRANSFERS_TUNING_INTERVAL * active) : 0.0;
+		socketwait	= (active > 0) ? tuning->socketwait / (WD_TRANSFERS_TUNING_INTERVAL * active) : 0.0;
+		previous	= tuning->slots;
+		slots		= previous;
+		reason		= NULL;
+		
+		tuning->bytes		= 0;
+		tuning->diskwait	= 0.0;
+		tuning->socketwait	= 0.0;
+		
+		if(tuning->hold > 0)
+			tuning->hold--;
+		
+		/* Only judge the slot count while every slot is in use */
+		if(wd_transfers_tuning_enabled && active >= slots) {
+			if(tuning->step > 0 && rate < tuning->rate * (1.0 + WD_TRANSFERS_TUNING_GAIN)) {
+				slots			-= tuning->step;
+				tuning->hold	= WD_TRANSFERS_TUNING_HOLD;
+				reason			= WI_STR("the last slot did not raise throughput");
+			}
+			else if(diskwait > WD_TRANSFERS_TUNING_DISK_WAIT) {
+				slots--;
+				reason			= WI_STR("transfers are waiting for the disk");
+			}
+			else if(queued > 0 && tuning->hold == 0) {
+				slots			+= (socketwait > WD_TRANSFERS_TUNING_SOCKET_WAIT) ? 2 : 1;
+				reason			= WI_STR("transfers are queued");
 			}
 			
-			wi_condition_lock_unlock(transfer->queue_lock);
+			slots = WI_MIN(WI_MAX(slots, wd_transfers_tuning_minimum), wd_transfers_tuning_maximum);
 		}
 		
-		keys		= wi_autorelease(wi_mutable_copy(wi_dictionary_keys_sorted_by_value(key_queues, wd_transfers_queue_compare)));
-		position	= 1;
-		count		= wi_array_count(keys);
+		tuning->step	= (wi_integer_t) slots - (wi_integer_t) previous;
+		tuning->rate	= rate;
+		tuning->slots	= slots;
 		
-		while(longest_queue > 0) {
-			for(i = 0; i < count; i++) {
-				key			= WI_ARRAY(keys, i);
-				key_queue	= wi_dictionary_data_for_key(key_queues, key);
-				
-				if(wi_array_count(key_queue) > 0) {
-					transfer	= WI_ARRAY(key_queue, 0);
-					account		= wd_user_account(transfer->user);
-
-					wi_lock_lock(wd_transfers_status_lock);
-					
-					if(transfer->type == WD_TRANSFER_DOWNLOAD) {
-						wi_dictionary_rdlock(wd_transfers_user_downloads);
-						
-						user_downloads	= wd_account_transfer_download_limit(account);
-						user_transfers	= (wi_integer_t) wi_dictionary_data_for_key(wd_transfers_user_downloads, transfer->key);
-						queue			= ((wd_transfers_total_downloads > 0 && wd_transfers_active_downloads >= wd_transfers_total_downloads) ||
-										   (user_downloads > 0 && user_transfers >= user_downloads));
-
-						wi_dictionary_unlock(wd_transfers_user_downloads);
-					} else {
-						wi_dictionary_rdlock(wd_transfers_user_uploads);
-						
-						user_uploads	= wd_account_transfer_upload_limit(account);
-						user_transfers	= (wi_integer_t) wi_dictionary_data_for_key(wd_transfers_user_uploads, transfer->key);
-						queue			= ((wd_transfers_total_uploads > 0 && wd_transfers_active_uploads >= wd_transfers_total_uploads) ||
-										   (user_uploads > 0 && user_transfers >= user_uploads));
-
-						wi_dictionary_unlock(wd_transfers_user_uploads);
-					}
-					
-					wi_lock_unlock(wd_transfers_status_lock);
-					
-					if(queue)
-						new_position = position++;
-					else
-						new_position = 0;
-					
-					if(new_position != (wi_uinteger_t) transfer->queue) {
-						if(new_position == 0)
-							wd_transfers_add_or_remove_transfer(transfer, true);
-						
-						wi_condition_lock_lock(transfer->queue_lock);
-						transfer->queue = new_position;
-						wi_condition_lock_unlock_with_condition(transfer->queue_lock, 1);
-					}
-					
-					wi_mutable_array_remove_data_at_index(key_queue, 0);
-				}
-			}
-				
-			longest_queue--;
-		}
+		wi_lock_unlock(wd_transfers_status_lock);
 		
-		wi_array_unlock(wd_transfers);
-		wi_condition_lock_unlock_with_condition(wd_transfers_queue_lock, 0);
+		/* Also picks up queues whose users had their transfer limits raised */
+		wd_transfers_dispatch(type);
 		
-		wi_pool_drain(pool);
+		wi_lock_unlock(wd_transfers_queues_lock);
+		
+		if(slots != previous) {
+			wi_log_info(WI_STR("Changed %@ slots from %u to %u because %@ (%.0f bytes/sec, %.0f%% disk wait, %.0f%% socket wait, %u queued)"),
+				(type == WD_TRANSFER_DOWNLOAD) ? WI_STR("download") : WI_STR("upload"),
+				previous, slots, reason, rate, diskwait * 100.0, socketwait * 100.0, queued);
+			
+			wd_metrics_add((slots > previous) ? WD_METRIC_TRANSFER_SLOTS_ADDED : WD_METRIC_TRANSFER_SLOTS_REMOVED,
+				(slots > previous) ? slots - previous : previous - slots);
+		}
+		
+		if(type == WD_TRANSFER_DOWNLOAD) {
+			wd_metrics_set(WD_METRIC_TRANSFER_DOWNLOAD_SLOTS, slots);
+			wd_metrics_set(WD_METRIC_TRANSFER_DOWNLOAD_RATE, (uint64_t) rate);
+			wd_metrics_set(WD_METRIC_TRANSFER_DOWNLOAD_DISK_WAIT, (uint64_t) (diskwait * 100.0));
+			wd_metrics_set(WD_METRIC_TRANSFER_DOWNLOAD_SOCKET_WAIT, (uint64_t) (socketwait * 100.0));
+		} else {
+			wd_metrics_set(WD_METRIC_TRANSFER_UPLOAD_SLOTS, slots);
+			wd_metrics_set(WD_METRIC_TRANSFER_UPLOAD_RATE, (uint64_t) rate);
+			wd_metrics_set(WD_METRIC_TRANSFER_UPLOAD_DISK_WAIT, (uint64_t) (diskwait * 100.0));
+			wd_metrics_set(WD_METRIC_TRANSFER_UPLOAD_SOCKET_WAIT, (uint64_t) (socketwait * 100.0));
+		}
 	}
+}
+
+
+
+static wi_uinteger_t wd_transfers_slots(wd_transfer_type_t type) {
+	if(wd_transfers_tuning_enabled)
+		return wd_transfers_tuning[type].slots;
 	
-	wi_release(key_queues);
-	wi_release(pool);
+	return (type == WD_TRANSFER_DOWNLOAD) ? wd_transfers_total_downloads : wd_transfers_total_uploads;
 }
 
 
 
 static wi_integer_t wd_transfers_queue_compare(wi_runtime_instance_t *instance1, wi_runtime_instance_t *instance2) {
-	wi_array_t			*queue1 = instance1;
-	wi_array_t			*queue2 = instance2;
-	wd_transfer_t		*transfer1, *transfer2;
+	wd_transfers_queue_t	*queue1 = instance1;
+	wd_transfers_queue_t	*queue2 = instance2;
+	wd_transfer_t			*transfer1, *transfer2;
 	
-	transfer1 = WI_ARRAY(queue1, 0);
-	transfer2 = WI_ARRAY(queue2, 0);
+	transfer1 = WI_ARRAY(queue1->transfers, 0);
+	transfer2 = WI_ARRAY(queue2->transfers, 0);
 	
 	if(transfer1->queue_time > transfer2->queue_time)
 		return 1;
@@ -274,163 +390,1177 @@ static wi_integer_t wd_transfers_queue_compare(wi_runtime_instance_t *instance1,
 
 static wi_boolean_t wd_transfers_wait_until_ready(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
 	wi_p7_message_t			*reply;
-	wi_uinteger_t			queue;
+	wi_integer_t			queue;
 	wi_p7_uint32_t			transaction;
 	
 	while(true) {
-		if(wi_condition_lock_lock_when_condition(transfer->queue_lock, 1, 1.0)) {
-			queue = transfer->queue;
+		if(!wi_condition_lock_lock_when_condition(transfer->queue_lock, 1, 1.0)) {
+			if(wd_user_state(user) != WD_USER_LOGGED_IN)
+				return true;
 			
-			wi_condition_lock_unlock_with_condition(transfer->queue_lock, 0);
+			continue;
+		}
+		
+		queue = transfer->queue;
 		
-			if(queue > 0) {
-				reply = wi_p7_message_with_name(WI_STR("wired.transfer.queue"), wd_p7_spec);
-				wi_p7_message_set_string_for_name(reply, transfer->path, WI_STR("wired.file.path"));
-				wi_p7_message_set_uint32_for_name(reply, queue, WI_STR("wired.transfer.queue_position"));
+		wi_condition_lock_unlock_with_condition(transfer->queue_lock, 0);
+		
+		if(queue == 0 || wd_user_state(user) != WD_USER_LOGGED_IN)
+			return true;
+	
+		if(queue > 0) {
+			reply = wi_p7_message_with_name(WI_STR("wired.transfer.queue"), wd_p7_spec);
+			wi_p7_message_set_string_for_name(reply, transfer->path, WI_STR("wired.file.path"));
+			wi_p7_message_set_uint32_for_name(reply, queue, WI_STR("wired.transfer.queue_position"));
 
-				if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
-					wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
+			if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
+				wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
+			
+			if(!wd_user_write_message(user, 30.0, reply)) {
+				wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+					wi_p7_message_name(reply), wd_user_identifier(user));
 				
-				if(!wd_user_write_message(user, 30.0, reply)) {
-					wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
-						wi_p7_message_name(reply), wd_user_identifier(user));
-					
-					return false;
-				}
-			} 
+				return false;
+			}
+		}
+	}
+}
+
+
+
+static wd_transfer_t * wd_transfers_segment_leader(wd_transfer_t *transfer) {
+	wd_transfer_t		*each;
+	wi_uinteger_t		i, count;
+	
+	count = wi_array_count(wd_transfers);
+	
+	for(i = 0; i < count; i++) {
+		each = WI_ARRAY(wd_transfers, i);
+		
+		if(each->segment && !each->leader && each->session_id == transfer->session_id &&
+		   wi_is_equal(each->path, transfer->path))
+			return each;
+	}
+	
+	return NULL;
+}
+
+
+
+static wi_boolean_t wd_transfers_wait_for_leader(wd_transfer_t *transfer) {
+	wd_transfer_t		*leader = transfer->leader;
+	wi_boolean_t		running;
+	
+	wi_condition_lock_lock_when_condition(leader->started_lock, 1, 0.0);
+	
+	running = (leader->state == WD_TRANSFER_RUNNING);
+	
+	wi_condition_lock_unlock_with_condition(leader->started_lock, 1);
+	
+	if(running) {
+		wi_condition_lock_lock(transfer->queue_lock);
+		transfer->queue = 0;
+		wi_condition_lock_unlock(transfer->queue_lock);
+	}
+	
+	return running;
+}
+
+
+
+static void wd_transfers_finish_segment(wd_transfer_t *transfer, wd_user_t *user, wi_boolean_t result) {
+	wd_transfer_t		*leader;
+	wi_file_offset_t	transferred = 0;
+	wi_boolean_t		last, complete = false;
+	
+	leader = transfer->leader ? transfer->leader : transfer;
+	
+	wi_array_wrlock(wd_transfers);
+	
+	leader->segmenttransferred += transfer->actualtransferred;
+	
+	if(!result)
+		leader->segmentfailed = true;
+	
+	last = (--leader->segments == 0);
+	
+	if(last) {
+		transferred					= leader->segmenttransferred;
+		complete					= !leader->segmentfailed;
+		leader->segmenttransferred	= 0;
+		leader->segmentfailed		= false;
+	}
+	
+	wi_array_unlock(wd_transfers);
+	
+	if(last)
+		wd_accounts_add_download_statistics(wd_user_account(user), complete, transferred);
+}
+
+
+
+#pragma mark -
+
+static void wd_transfers_enqueue_transfer(wd_transfer_t *transfer) {
+	wd_transfers_queue_t	*queue;
+	
+	wi_lock_lock(wd_transfers_queues_lock);
+	
+	queue = wi_dictionary_data_for_key(wd_transfers_queues[transfer->type], transfer->key);
+	
+	if(!queue) {
+		queue = wd_transfers_queue_init_with_key(wd_transfers_queue_alloc(), transfer->key, transfer->type);
+		wi_mutable_dictionary_set_data_for_key(wd_transfers_queues[transfer->type], queue, transfer->key);
+		wi_release(queue);
+	}
+	
+	wi_mutable_array_add_data(queue->transfers, transfer);
+	wi_mutable_array_add_data(wd_transfers_queued[transfer->type], transfer);
+	
+	if(queue->index < 0)
+		wd_transfers_heap_push(queue);
+	
+	wd_transfers_dispatch(transfer->type);
+	
+	/* Transfers that did not start right away go to the back of the line */
+	if(transfer->queue < 0)
+		wd_transfers_update_positions(transfer->type, wi_array_count(wd_transfers_queued[transfer->type]) - 1);
+	
+	wi_lock_unlock(wd_transfers_queues_lock);
+}
+
+
+
+static wi_boolean_t wd_transfers_dequeue_transfer(wd_transfer_t *transfer) {
+	wd_transfers_queue_t	*queue;
+	wi_uinteger_t			index, position;
+	
+	wi_lock_lock(wd_transfers_queues_lock);
+	
+	queue = wi_dictionary_data_for_key(wd_transfers_queues[transfer->type], transfer->key);
+	index = queue ? wi_array_index_of_data(queue->transfers, transfer) : WI_NOT_FOUND;
+	
+	if(index != WI_NOT_FOUND) {
+		wi_mutable_array_remove_data_at_index(queue->transfers, index);
+		
+		if(wi_array_count(queue->transfers) == 0) {
+			if(queue->index >= 0)
+				wd_transfers_heap_remove(queue);
 			
-			if(queue == 0 || wd_user_state(user) != WD_USER_LOGGED_IN)
-				return true;
+			wi_mutable_dictionary_remove_data_for_key(wd_transfers_queues[transfer->type], transfer->key);
+		}
+		else if(index == 0 && queue->index >= 0) {
+			wd_transfers_heap_sift_down(queue);
+		}
+		
+		position = wi_array_index_of_data(wd_transfers_queued[transfer->type], transfer);
+		
+		if(position != WI_NOT_FOUND) {
+			wi_mutable_array_remove_data_at_index(wd_transfers_queued[transfer->type], position);
+			
+			wd_transfers_update_positions(transfer->type, position);
+		}
+	}
+	
+	wi_lock_unlock(wd_transfers_queues_lock);
+	
+	if(index != WI_NOT_FOUND) {
+		wi_condition_lock_lock(transfer->queue_lock);
+		wi_condition_lock_unlock_with_condition(transfer->queue_lock, 1);
+	}
+	
+	return (index != WI_NOT_FOUND);
+}
+
+
+
+static void wd_transfers_finish_transfer(wd_transfer_t *transfer) {
+	wi_lock_lock(wd_transfers_queues_lock);
+	wd_transfers_dispatch(transfer->type);
+	
+	wi_lock_unlock(wd_transfers_queues_lock);
+}
+
+
+
+static void wd_transfers_dispatch(wd_transfer_type_t type) {
+	wi_mutable_array_t		*blocked = NULL;
+	wd_transfers_queue_t	*queue;
+	wd_transfer_t			*transfer;
+	wi_uinteger_t			i, count, index, first = WI_NOT_FOUND;
+	
+	while(wd_transfers_heap_counts[type] > 0 && !wd_transfers_is_full(type)) {
+		queue		= wd_transfers_heaps[type][0];
+		transfer	= WI_ARRAY(queue->transfers, 0);
+		
+		/* Users at their limit are set aside for this pass only, so they stay in line */
+		if(wd_transfers_is_full_for_user(transfer)) {
+			if(!blocked)
+				blocked = wi_array_init(wi_mutable_array_alloc());
+			
+			wi_mutable_array_add_data(blocked, queue);
+			wd_transfers_heap_remove(queue);
+			
+			continue;
+		}
+		
+		wi_retain(transfer);
+		wi_mutable_array_remove_data_at_index(queue->transfers, 0);
+		
+		if(wi_array_count(queue->transfers) == 0) {
+			wd_transfers_heap_remove(queue);
+			wi_mutable_dictionary_remove_data_for_key(wd_transfers_queues[type], transfer->key);
+		} else {
+			wd_transfers_heap_sift_down(queue);
+		}
+		
+		index = wi_array_index_of_data(wd_transfers_queued[type], transfer);
+		
+		if(index != WI_NOT_FOUND) {
+			wi_mutable_array_remove_data_at_index(wd_transfers_queued[type], index);
+			
+			first = WI_MIN(first, index);
+		}
+		
+		wd_transfers_add_or_remove_transfer(transfer, true);
+		
+		wi_condition_lock_lock(transfer->queue_lock);
+		transfer->queue = 0;
+		wi_condition_lock_unlock_with_condition(transfer->queue_lock, 1);
+		
+		wi_release(transfer);
+	}
+	
+	if(blocked) {
+		count = wi_array_count(blocked);
+		
+		for(i = 0; i < count; i++)
+			wd_transfers_heap_push(WI_ARRAY(blocked, i));
+		
+		wi_release(blocked);
+	}
+	
+	if(first != WI_NOT_FOUND)
+		wd_transfers_update_positions(type, first);
+}
+
+
+
+static void wd_transfers_update_positions(wd_transfer_type_t type, wi_uinteger_t index) {
+	wd_transfer_t			*transfer;
+	wi_uinteger_t			i, count;
+	
+	/* Only the transfers behind the one that left the line move up */
+	count = wi_array_count(wd_transfers_queued[type]);
+	
+	for(i = index; i < count; i++) {
+		transfer = WI_ARRAY(wd_transfers_queued[type], i);
+		
+		if(transfer->queue != (wi_integer_t) i + 1) {
+			wi_condition_lock_lock(transfer->queue_lock);
+			transfer->queue = i + 1;
+			wi_condition_lock_unlock_with_condition(transfer->queue_lock, 1);
 		}
 	}
 }
 
 
 
-static wi_boolean_t wd_transfers_run_download(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
-	wi_p7_message_t		*reply;
-	wi_data_t			*data;
-	wi_p7_uint32_t		transaction;
-	wi_boolean_t		result;
+static wi_boolean_t wd_transfers_is_full(wd_transfer_type_t type) {
+	wi_uinteger_t		slots;
+	wi_boolean_t		full;
+	
+	wi_lock_lock(wd_transfers_status_lock);
+	
+	slots = wd_transfers_slots(type);
+	
+	if(type == WD_TRANSFER_DOWNLOAD)
+		full = (slots > 0 && wd_transfers_active_downloads >= slots);
+	else
+		full = (slots > 0 && wd_transfers_active_uploads >= slots);
+	
+	wi_lock_unlock(wd_transfers_status_lock);
+	
+	return full;
+}
+
+
+
+static wi_boolean_t wd_transfers_is_full_for_user(wd_transfer_t *transfer) {
+	wi_mutable_dictionary_t		*dictionary;
+	wd_account_t				*account;
+	wi_uinteger_t				limit, count;
+	
+	account = wd_user_account(transfer->user);
+	
+	if(!account)
+		return false;
+	
+	if(transfer->type == WD_TRANSFER_DOWNLOAD) {
+		dictionary	= wd_transfers_user_downloads;
+		limit		= wd_account_transfer_download_limit(account);
+	} else {
+		dictionary	= wd_transfers_user_uploads;
+		limit		= wd_account_transfer_upload_limit(account);
+	}
+	
+	if(limit == 0)
+		return false;
+	
+	wi_dictionary_rdlock(dictionary);
+	
+	count = (wi_integer_t) wi_dictionary_data_for_key(dictionary, transfer->key);
+	
+	wi_dictionary_unlock(dictionary);
+	
+	return (count >= limit);
+}
+
+
+
+#pragma mark -
+
+static void wd_transfers_heap_push(wd_transfers_queue_t *queue) {
+	wi_uinteger_t		count;
+	
+	count = wd_transfers_heap_counts[queue->type];
+	
+	if(count == wd_transfers_heap_capacities[queue->type]) {
+		wd_transfers_heap_capacities[queue->type] = WI_MAX(16, count * 2);
+		wd_transfers_heaps[queue->type] = wi_realloc(wd_transfers_heaps[queue->type],
+			wd_transfers_heap_capacities[queue->type] * sizeof(wd_transfers_queue_t *));
+	}
+	
+	wd_transfers_heaps[queue->type][count] = queue;
+	wd_transfers_heap_counts[queue->type]++;
+	queue->index = count;
+	
+	wd_transfers_heap_sift_up(queue);
+}
+
+
+
+static void wd_transfers_heap_remove(wd_transfers_queue_t *queue) {
+	wd_transfers_queue_t	**heap, *last;
+	wi_integer_t			index;
+	
+	heap	= wd_transfers_heaps[queue->type];
+	index	= queue->index;
+	last	= heap[--wd_transfers_heap_counts[queue->type]];
+	
+	queue->index = -1;
+	
+	if(last != queue) {
+		heap[index] = last;
+		last->index = index;
+		
+		wd_transfers_heap_sift_up(last);
+		wd_transfers_heap_sift_down(last);
+	}
+}
+
+
+
+static void wd_transfers_heap_sift_up(wd_transfers_queue_t *queue) {
+	wd_transfers_queue_t	**heap;
+	wi_integer_t			index, parent;
+	
+	heap	= wd_transfers_heaps[queue->type];
+	index	= queue->index;
+	
+	while(index > 0) {
+		parent = (index - 1) / 2;
+		
+		if(wd_transfers_queue_compare(heap[parent], queue) <= 0)
+			break;
+		
+		heap[index] = heap[parent];
+		heap[index]->index = index;
+		index = parent;
+	}
+	
+	heap[index] = queue;
+	queue->index = index;
+}
+
+
+
+static void wd_transfers_heap_sift_down(wd_transfers_queue_t *queue) {
+	wd_transfers_queue_t	**heap;
+	wi_integer_t			index, child, count;
+	
+	heap	= wd_transfers_heaps[queue->type];
+	count	= wd_transfers_heap_counts[queue->type];
+	index	= queue->index;
+	
+	while((child = (2 * index) + 1) < count) {
+		if(child + 1 < count && wd_transfers_queue_compare(heap[child + 1], heap[child]) < 0)
+			child++;
+		
+		if(wd_transfers_queue_compare(queue, heap[child]) <= 0)
+			break;
+		
+		heap[index] = heap[child];
+		heap[index]->index = index;
+		index = child;
+	}
+	
+	heap[index] = queue;
+	queue->index = index;
+}
+
+
+
+#pragma mark -
+
+static wd_transfers_queue_t * wd_transfers_queue_alloc(void) {
+	return wi_runtime_create_instance(wd_transfers_queue_runtime_id, sizeof(wd_transfers_queue_t));
+}
+
+
+
+static wd_transfers_queue_t * wd_transfers_queue_init_with_key(wd_transfers_queue_t *queue, wi_string_t *key, wd_transfer_type_t type) {
+	queue->key			= wi_copy(key);
+	queue->type			= type;
+	queue->transfers	= wi_array_init(wi_mutable_array_alloc());
+	queue->index		= -1;
+	
+	return queue;
+}
+
+
+
+static void wd_transfers_queue_dealloc(wi_runtime_instance_t *instance) {
+	wd_transfers_queue_t	*queue = instance;
+	
+	wi_release(queue->key);
+	wi_release(queue->transfers);
+}
+
+
+
+#pragma mark -
+
+static wi_boolean_t wd_transfers_run_download(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+	wi_p7_message_t		*reply;
+	wi_boolean_t		result;
+	
+	reply = wd_transfers_download_message(transfer, message);
+
+	if(!wd_user_write_message(user, 30.0, reply)) {
+		wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+			wi_p7_message_name(reply), wd_user_identifier(user));
+
+		return false;
+	}
+	
+	wi_socket_set_interactive(wd_user_socket(user), false);
+	
+	result = wd_transfer_download(transfer);
+	
+	wi_socket_set_interactive(wd_user_socket(user), true);
+	
+	/* Segments are recorded as one download when the last one finishes */
+	if(transfer->segment)
+		return result;
+	
+	if(transfer->transferred == transfer->datasize + transfer->rsrcsize)
+		wd_accounts_add_download_statistics(wd_user_account(user), true, transfer->actualtransferred);
+	else
+		wd_accounts_add_download_statistics(wd_user_account(user), false, transfer->actualtransferred);
+	
+	return result;
+}
+
+
+
+static wi_boolean_t wd_transfers_run_directory_download(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+	wi_pool_t			*pool;
+	wi_enumerator_t		*enumerator;
+	wi_p7_message_t		*reply;
+	wi_string_t			*relativepath, *path, *realpath;
+	wd_transfer_t		*file;
+	wi_fs_stat_t		sb;
+	wi_time_interval_t	interval;
+	wi_file_offset_t	dataoffset, rsrcoffset;
+	wi_p7_uint32_t		transaction;
+	wd_file_type_t		type;
+	wi_boolean_t		result;
+	
+	if(!wd_transfers_list_directory_download(transfer, user, message))
+		return false;
+	
+	pool		= wi_pool_init(wi_pool_alloc());
+	interval	= wi_time_interval();
+	result		= true;
+	
+	wi_socket_set_interactive(wd_user_socket(user), false);
+	
+	wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, WD_TRANSFER_STATISTICS_ADD, 0);
+	
+	enumerator = wi_array_data_enumerator(transfer->entries);
+	
+	while((relativepath = wi_enumerator_next_data(enumerator))) {
+		if(wd_user_state(user) != WD_USER_LOGGED_IN) {
+			result = false;
+			break;
+		}
+		
+		path		= wi_string_by_appending_path_component(transfer->path, relativepath);
+		realpath	= wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
+		
+		/* Entries removed since the listing are left out rather than ending the whole stream */
+		if(!wi_fs_stat_path(realpath, &sb)) {
+			wi_log_info(WI_STR("Skipped \"%@\" in download: %m"), realpath);
+			wi_pool_drain(pool);
+			
+			continue;
+		}
+		
+		type = wd_files_type_with_stat(realpath, &sb);
+		
+		if(transfer->resumepath && wi_is_equal(relativepath, transfer->resumepath)) {
+			dataoffset	= transfer->dataoffset;
+			rsrcoffset	= transfer->rsrcoffset;
+		} else {
+			dataoffset	= 0;
+			rsrcoffset	= 0;
+		}
+		
+		if(type == WD_FILE_TYPE_FILE) {
+			file = wd_transfer_open_download(path, dataoffset, rsrcoffset, 0, user, message);
+			
+			if(!file) {
+				wi_pool_drain(pool);
+				
+				continue;
+			}
+			
+			file->parent = transfer;
+			
+			reply = wd_transfers_download_message(file, message);
+		} else {
+			file = NULL;
+			
+			reply = wi_p7_message_with_name(WI_STR("wired.transfer.download"), wd_p7_spec);
+			wi_p7_message_set_string_for_name(reply, path, WI_STR("wired.file.path"));
+			wi_p7_message_set_oobdata_for_name(reply, 0, WI_STR("wired.transfer.data"));
+			wi_p7_message_set_oobdata_for_name(reply, 0, WI_STR("wired.transfer.rsrc"));
+			wi_p7_message_set_data_for_name(reply, wi_data(), WI_STR("wired.transfer.finderinfo"));
+
+			if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
+				wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
+		}
+		
+		wi_p7_message_set_enum_for_name(reply, type, WI_STR("wired.file.type"));
+		
+		if(!wd_user_write_message(user, 30.0, reply)) {
+			wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+				wi_p7_message_name(reply), wd_user_identifier(user));
+			
+			result = false;
+			break;
+		}
+		
+		if(file) {
+			result = wd_transfer_download(file);
+			
+			transfer->speed = transfer->actualtransferred / (wi_time_interval() - interval);
+			
+			if(!result)
+				break;
+		}
+		
+		wi_pool_drain(pool);
+	}
+	
+	/* The transfer holds the socket, so queued replies would be dropped */
+	if(result) {
+		reply = wd_transfers_okay_message(message);
+		
+		if(!wd_user_write_message(user, 30.0, reply)) {
+			wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+				wi_p7_message_name(reply), wd_user_identifier(user));
+			
+			result = false;
+		}
+	}
+	
+	wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, WD_TRANSFER_STATISTICS_REMOVE, 0);
+	
+	wi_socket_set_interactive(wd_user_socket(user), true);
+	
+	wd_accounts_add_download_statistics(wd_user_account(user), result, transfer->actualtransferred);
+	
+	wi_release(pool);
+	
+	return result;
+}
+
+
+
+static wi_boolean_t wd_transfers_list_directory_download(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+	wi_pool_t					*pool;
+	wi_string_t					*filepath, *resolvedpath, *relativepath;
+	wi_mutable_array_t			*entries;
+	wi_fsenumerator_t			*fsenumerator;
+	wd_account_t				*account;
+	wi_fs_stat_t				sb;
+	wi_fsenumerator_status_t	status;
+	wi_file_offset_t			datasize, rsrcsize;
+	wi_uinteger_t				pathlength, i;
+	wd_file_type_t				type;
+	
+	fsenumerator = wi_fs_enumerator_at_path(transfer->realdatapath);
+	
+	if(!fsenumerator) {
+		wi_log_error(WI_STR("Could not open \"%@\" for download: %m"), transfer->realdatapath);
+		wd_user_reply_file_errno(user, message);
+		
+		return false;
+	}
+	
+	pool		= wi_pool_init(wi_pool_alloc());
+	account		= wd_user_account(user);
+	entries		= wi_array_init(wi_mutable_array_alloc());
+	datasize	= 0;
+	rsrcsize	= 0;
+	pathlength	= wi_string_length(transfer->realdatapath) + 1;
+	i			= 0;
+	
+	while((status = wi_fsenumerator_get_next_path(fsenumerator, &filepath)) != WI_FSENUMERATOR_EOF) {
+		if(++i % 100 == 0)
+			wi_pool_drain(pool);
+		
+		if(status == WI_FSENUMERATOR_ERROR) {
+			wi_log_error(WI_STR("Could not list \"%@\": %m"), filepath);
+			
+			continue;
+		}
+		
+		if(wi_fs_path_is_invisible(filepath)) {
+			wi_fsenumerator_skip_descendents(fsenumerator);
+			
+			continue;
+		}
+		
+		resolvedpath = wi_string_by_resolving_aliases_in_path(filepath);
+		
+		if(!wi_fs_stat_path(resolvedpath, &sb)) {
+			wi_log_error(WI_STR("Could not read info for \"%@\": %m"), resolvedpath);
+			
+			continue;
+		}
+		
+		type = wd_files_type_with_stat(resolvedpath, &sb);
+		
+		if(type == WD_FILE_TYPE_DROPBOX &&
+		   !wd_files_privileges_is_readable_by_account(wd_files_drop_box_privileges(resolvedpath), account)) {
+			wi_fsenumerator_skip_descendents(fsenumerator);
+			
+			continue;
+		}
+		
+		relativepath = wi_string_substring_from_index(filepath, pathlength);
+		
+		/* Entries are sent in sorted order, so everything before the resumed file has already been received */
+		if(transfer->resumepath && wi_string_compare(relativepath, transfer->resumepath) < 0)
+			continue;
+		
+		wi_mutable_array_add_data(entries, relativepath);
+		
+		if(type == WD_FILE_TYPE_FILE) {
+			datasize += sb.size;
+			
+			if(wd_user_supports_rsrc(user))
+				rsrcsize += wi_fs_resource_fork_size_for_path(resolvedpath);
+		}
+	}
+	
+	transfer->entries			= wi_retain(wi_array_by_sorting(entries, wi_string_compare));
+	transfer->datasize			= datasize;
+	transfer->rsrcsize			= rsrcsize;
+	
+	if(transfer->resumepath && (wi_array_count(transfer->entries) == 0 ||
+								!wi_is_equal(WI_ARRAY(transfer->entries, 0), transfer->resumepath))) {
+		transfer->dataoffset	= 0;
+		transfer->rsrcoffset	= 0;
+	}
+	
+	transfer->transferred		= transfer->dataoffset + transfer->rsrcoffset;
+	
+	wi_release(entries);
+	wi_release(pool);
+	
+	return true;
+}
+
+
+
+static wi_p7_message_t * wd_transfers_download_message(wd_transfer_t *transfer, wi_p7_message_t *message) {
+	wi_p7_message_t		*reply;
+	wi_data_t			*data;
+	wi_p7_uint32_t		transaction;
+	
+	if(transfer->finderinfo)
+		data = transfer->finderinfo;
+	else
+		data = wi_fs_finder_info_for_path(transfer->realdatapath);
+	
+	reply = wi_p7_message_with_name(WI_STR("wired.transfer.download"), wd_p7_spec);
+	wi_p7_message_set_string_for_name(reply, transfer->path, WI_STR("wired.file.path"));
+	wi_p7_message_set_uint64_for_name(reply, transfer->dataoffset, WI_STR("wired.transfer.data_offset"));
+	wi_p7_message_set_oobdata_for_name(reply, transfer->remainingdatasize, WI_STR("wired.transfer.data"));
+	wi_p7_message_set_oobdata_for_name(reply, transfer->remainingrsrcsize, WI_STR("wired.transfer.rsrc"));
+	wi_p7_message_set_data_for_name(reply, data ? data : wi_data(), WI_STR("wired.transfer.finderinfo"));
+
+	if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
+		wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
+	
+	return reply;
+}
+
+
+
+static wi_p7_message_t * wd_transfers_okay_message(wi_p7_message_t *message) {
+	wi_p7_message_t		*reply;
+	wi_p7_uint32_t		transaction;
+	
+	reply = wi_p7_message_with_name(WI_STR("wired.okay"), wd_p7_spec);
+	
+	if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
+		wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
+	
+	return reply;
+}
+
+
+
+static wi_boolean_t wd_transfers_run_upload(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+	wi_p7_message_t		*reply;
+	wi_string_t			*path;
+	wi_file_offset_t	dataoffset;
+	wi_boolean_t		result;
+	
+	reply = wd_transfers_upload_ready_message(transfer, message);
+	
+	if(!wd_user_write_message(user, 30.0, reply)) {
+		wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+			wi_p7_message_name(reply), wd_user_identifier(user));
+
+		return false;
+	}
+	
+	reply = wd_transfers_read_upload_message(user);
+	
+	if(!reply)
+		return false;
+	
+	if(wi_p7_message_get_uint64_for_name(reply, &dataoffset, WI_STR("wired.transfer.data_offset")) && dataoffset < transfer->dataoffset) {
+		dataoffset -= dataoffset % WD_HASHES_BLOCK_SIZE;
+		
+		if(ftruncate(transfer->datafd, dataoffset) < 0) {
+			wi_log_error(WI_STR("Could not truncate \"%@\" to %llu for upload: %s"),
+				transfer->realdatapath, dataoffset, strerror(errno));
+			wd_user_reply_internal_error(user, wi_string_with_cstring(strerror(errno)), reply);
+			
+			return false;
+		}
+		
+		transfer->transferred	-= transfer->dataoffset - dataoffset;
+		transfer->dataoffset	= dataoffset;
+		
+		if(transfer->hashlist)
+			wd_hashlist_truncate(transfer->hashlist, dataoffset);
+	}
+	
+	wi_p7_message_get_uint64_for_name(reply, &transfer->remainingdatasize, WI_STR("wired.transfer.data"));
+	wi_p7_message_get_uint64_for_name(reply, &transfer->remainingrsrcsize, WI_STR("wired.transfer.rsrc"));
+	
+	transfer->finderinfo = wi_retain(wi_p7_message_data_for_name(reply, WI_STR("wired.transfer.finderinfo")));
+	
+	if(!wd_transfers_preallocate_upload(transfer, user, reply))
+		return false;
+	
+	wi_socket_set_interactive(wd_user_socket(user), false);
+	
+	result = wd_transfer_upload(transfer);
+
+	wi_socket_set_interactive(wd_user_socket(user), true);
+	
+	path = wd_transfers_complete_upload(transfer);
+	
+	if(path)
+		wd_index_add_file(path);
+
+	if(transfer->transferred == transfer->datasize + transfer->rsrcsize)
+		wd_accounts_add_upload_statistics(wd_user_account(user), true, transfer->actualtransferred);
+	else
+		wd_accounts_add_upload_statistics(wd_user_account(user), false, transfer->actualtransferred);
+	
+	return result;
+}
+
+
+
+static wi_boolean_t wd_transfers_run_batch_upload(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+	wi_pool_t				*pool;
+	wi_mutable_array_t		*paths;
+	wi_p7_message_t			*reply;
+	wi_string_t				*prefix, *path;
+	wd_transfer_t			*file;
+	wi_time_interval_t		interval;
+	wi_file_offset_t		datasize, rsrcsize;
+	wi_uinteger_t			i;
+	wi_boolean_t			executable, result;
+	
+	paths = wi_mutable_array();
+	
+	if(!wd_transfers_create_batch_directories(transfer, user, message, paths)) {
+		wd_index_add_files(paths);
+		
+		return false;
+	}
+	
+	reply = wd_transfers_upload_ready_message(transfer, message);
+	
+	if(!wd_user_write_message(user, 30.0, reply)) {
+		wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+			wi_p7_message_name(reply), wd_user_identifier(user));
+		
+		wd_index_add_files(paths);
+
+		return false;
+	}
+	
+	prefix		= wi_string_has_suffix(transfer->path, WI_STR("/"))
+		? transfer->path
+		: wi_string_by_appending_string(transfer->path, WI_STR("/"));
+	pool		= wi_pool_init(wi_pool_alloc());
+	interval	= wi_time_interval();
+	result		= true;
+	
+	wi_socket_set_interactive(wd_user_socket(user), false);
+	
+	wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, WD_TRANSFER_STATISTICS_ADD, 0);
+	
+	for(i = 0; i < transfer->filecount; i++) {
+		if(wd_user_state(user) != WD_USER_LOGGED_IN) {
+			result = false;
+			break;
+		}
+		
+		reply = wd_transfers_read_upload_message(user);
+		
+		if(!reply) {
+			result = false;
+			break;
+		}
+		
+		path = wi_p7_message_string_for_name(reply, WI_STR("wired.file.path"));
+		
+		if(!wd_files_path_is_valid(path)) {
+			wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+			
+			result = false;
+			break;
+		}
+		
+		path = wi_string_by_normalizing_path(path);
+		
+		if(!wi_string_has_prefix(path, prefix) || !wd_transfers_upload_is_allowed(path, user)) {
+			wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
+			
+			result = false;
+			break;
+		}
+		
+		wi_p7_message_get_uint64_for_name(reply, &datasize, WI_STR("wired.transfer.data"));
+		wi_p7_message_get_uint64_for_name(reply, &rsrcsize, WI_STR("wired.transfer.rsrc"));
+		
+		if(!wi_p7_message_get_bool_for_name(reply, &executable, WI_STR("wired.file.executable")))
+			executable = false;
+		
+		file = wd_transfer_upload_transfer(path, datasize, rsrcsize, executable, user, message);
+		
+		if(!file) {
+			result = false;
+			break;
+		}
+		
+		/* The client sends each file from the start, so stale partial files cannot be resumed */
+		if((file->dataoffset > 0 || file->rsrcoffset > 0) && !wd_transfer_restart_upload(file, message)) {
+			result = false;
+			break;
+		}
+		
+		file->parent		= transfer;
+		file->finderinfo	= wi_retain(wi_p7_message_data_for_name(reply, WI_STR("wired.transfer.finderinfo")));
+		
+		if(!wd_transfers_preallocate_upload(file, user, message)) {
+			result = false;
+			break;
+		}
+		
+		result = wd_transfer_upload(file);
+		
+		transfer->speed = transfer->actualtransferred / (wi_time_interval() - interval);
+		
+		path = wd_transfers_complete_upload(file);
+		
+		if(path)
+			wi_mutable_array_add_data(paths, path);
+		
+		if(!result)
+			break;
+		
+		wi_pool_drain(pool);
+	}
+	
+	wd_index_add_files(paths);
+	
+	if(result) {
+		reply = wd_transfers_okay_message(message);
+		
+		if(!wd_user_write_message(user, 30.0, reply)) {
+			wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
+				wi_p7_message_name(reply), wd_user_identifier(user));
+			
+			result = false;
+		}
+	}
+	
+	wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, WD_TRANSFER_STATISTICS_REMOVE, 0);
+	
+	wi_socket_set_interactive(wd_user_socket(user), true);
+	
+	wd_accounts_add_upload_statistics(wd_user_account(user), result, transfer->actualtransferred);
+	
+	wi_release(pool);
+	
+	return result;
+}
+
+
+
+static wi_boolean_t wd_transfers_preallocate_upload(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+	wi_fs_statfs_t			sfb;
+	wi_file_offset_t		datalength, rsrclength, available;
 	
-	data = wi_fs_finder_info_for_path(transfer->realdatapath);
+	datalength = (transfer->datasize > transfer->dataoffset) ? transfer->datasize - transfer->dataoffset : 0;
+	rsrclength = (transfer->rsrcsize > transfer->rsrcoffset) ? transfer->rsrcsize - transfer->rsrcoffset : 0;
 	
-	reply = wi_p7_message_with_name(WI_STR("wired.transfer.download"), wd_p7_spec);
-	wi_p7_message_set_string_for_name(reply, transfer->path, WI_STR("wired.file.path"));
-	wi_p7_message_set_oobdata_for_name(reply, transfer->remainingdatasize, WI_STR("wired.transfer.data"));
-	wi_p7_message_set_oobdata_for_name(reply, transfer->remainingrsrcsize, WI_STR("wired.transfer.rsrc"));
-	wi_p7_message_set_data_for_name(reply, data ? data : wi_data(), WI_STR("wired.transfer.finderinfo"));
-
-	if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
-		wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
-
-	if(!wd_user_write_message(user, 30.0, reply)) {
-		wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
-			wi_p7_message_name(reply), wd_user_identifier(user));
-
+	if(datalength + rsrclength == 0)
+		return true;
+	
+	/* The sizes come from the client, so never reserve more than the volume has free */
+	if(!wi_fs_statfs_path(wi_string_by_deleting_last_path_component(transfer->realdatapath), &sfb))
+		return true;
+	
+	available = (wi_file_offset_t) sfb.bavail * (wi_file_offset_t) sfb.frsize;
+	
+	if(datalength + rsrclength > available)
+		return true;
+	
+	if(!wd_pipelines_preallocate(transfer->datafd, transfer->dataoffset, datalength)) {
+		wi_log_error(WI_STR("Could not allocate %llu bytes in \"%@\" for upload: %s"),
+			datalength, transfer->realdatapath, strerror(errno));
+		wd_user_reply_internal_error(user, wi_string_with_cstring(strerror(errno)), message);
+		
 		return false;
 	}
 	
-	wi_socket_set_interactive(wd_user_socket(user), false);
+	if(transfer->rsrcfd >= 0 && !wd_pipelines_preallocate(transfer->rsrcfd, transfer->rsrcoffset, rsrclength)) {
+		wi_log_error(WI_STR("Could not allocate %llu bytes in \"%@\" for upload: %s"),
+			rsrclength, transfer->realrsrcpath, strerror(errno));
+		wd_user_reply_internal_error(user, wi_string_with_cstring(strerror(errno)), message);
+		
+		return false;
+	}
 	
-	result = wd_transfer_download(transfer);
+	return true;
+}
+
+
+
+static wi_boolean_t wd_transfers_create_batch_directories(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message, wi_mutable_array_t *paths) {
+	wi_enumerator_t			*enumerator;
+	wi_string_t				*directory, *directorypath, *realpath;
+	wd_account_t			*account;
+	wd_files_privileges_t	*privileges;
+	wd_file_type_t			parenttype;
+	wi_boolean_t			isdirectory;
 	
-	wi_socket_set_interactive(wd_user_socket(user), true);
+	account		= wd_user_account(user);
 	
-	if(transfer->transferred == transfer->datasize + transfer->rsrcsize)
-		wd_accounts_add_download_statistics(wd_user_account(user), true, transfer->actualtransferred);
-	else
-		wd_accounts_add_download_statistics(wd_user_account(user), false, transfer->actualtransferred);
+	/* Entries are sorted, which puts every directory after its parent, so the skeleton can be created in one pass */
+	enumerator	= wi_array_data_enumerator(transfer->entries);
 	
-	return result;
+	while((directory = wi_enumerator_next_data(enumerator))) {
+		directorypath	= wi_string_by_normalizing_path(wi_string_by_appending_path_component(transfer->path, directory));
+		realpath		= wi_string_by_resolving_aliases_in_path(wd_files_real_path(directorypath, user));
+		
+		if(wi_fs_path_exists(realpath, &isdirectory)) {
+			if(!isdirectory) {
+				wd_user_reply_error(user, WI_STR("wired.error.file_exists"), message);
+				
+				return false;
+			}
+			
+			continue;
+		}
+		
+		privileges = wd_files_privileges(directorypath, user);
+		
+		if(privileges && !wd_files_privileges_is_writable_by_account(privileges, account)) {
+			wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
+			
+			return false;
+		}
+		
+		parenttype = wd_files_type(wi_string_by_deleting_last_path_component(realpath));
+		
+		if(parenttype == WD_FILE_TYPE_DIR && !wd_account_transfer_upload_anywhere(account)) {
+			wd_user_reply_error(user, WI_STR("wired.error.permission_denied"), message);
+			
+			return false;
+		}
+		
+		if(!wi_fs_create_directory(realpath, 0777)) {
+			wi_log_error(WI_STR("Could not create \"%@\": %m"), realpath);
+			wd_user_reply_file_errno(user, message);
+			
+			return false;
+		}
+		
+		if(parenttype != WD_FILE_TYPE_DIR)
+			wd_files_set_type(directorypath, parenttype, user, message);
+		
+		wi_mutable_array_add_data(paths, realpath);
+	}
+	
+	return true;
 }
 
 
 
-static wi_boolean_t wd_transfers_run_upload(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
+static wi_p7_message_t * wd_transfers_upload_ready_message(wd_transfer_t *transfer, wi_p7_message_t *message) {
 	wi_p7_message_t		*reply;
-	wi_string_t			*path;
 	wi_p7_uint32_t		transaction;
-	wi_boolean_t		result;
 	
 	reply = wi_p7_message_with_name(WI_STR("wired.transfer.upload_ready"), wd_p7_spec);
 	wi_p7_message_set_string_for_name(reply, transfer->path, WI_STR("wired.file.path"));
 	wi_p7_message_set_oobdata_for_name(reply, transfer->dataoffset, WI_STR("wired.transfer.data_offset"));
 	wi_p7_message_set_oobdata_for_name(reply, transfer->rsrcoffset, WI_STR("wired.transfer.rsrc_offset"));
 	
+	if(transfer->hashlist)
+		wi_p7_message_set_data_for_name(reply, wd_hashlist_data(transfer->hashlist), WI_STR("wired.transfer.block_hashes"));
+	
 	if(wi_p7_message_get_uint32_for_name(message, &transaction, WI_STR("wired.transaction")))
 		wi_p7_message_set_uint32_for_name(reply, transaction, WI_STR("wired.transaction"));
 	
-	if(!wd_user_write_message(user, 30.0, reply)) {
-		wi_log_error(WI_STR("Could not write message \"%@\" to %@: %m"),
-			wi_p7_message_name(reply), wd_user_identifier(user));
+	return reply;
+}
 
-		return false;
-	}
+
+
+static wi_p7_message_t * wd_transfers_read_upload_message(wd_user_t *user) {
+	wi_p7_message_t		*message;
 	
-	reply = wd_user_read_message(user, 30.0);
+	message = wd_user_read_message(user, 30.0);
 	
-	if(!reply) {
+	if(!message) {
 		wi_log_warn(WI_STR("Could not read message from %@ while waiting for upload: %m"),
 			wd_user_identifier(user));
 		
-		return false;
+		return NULL;
 	}
 	
-	if(!wi_p7_spec_verify_message(wd_p7_spec, reply)) {
+	if(!wi_p7_spec_verify_message(wd_p7_spec, message)) {
 		wi_log_error(WI_STR("Could not verify message from %@ while waiting for upload: %m"),
 			wd_user_identifier(user));
-		wd_user_reply_error(user, WI_STR("wired.error.invalid_message"), reply);
+		wd_user_reply_error(user, WI_STR("wired.error.invalid_message"), message);
 		
-		return false;
+		return NULL;
 	}
 	
-	if(!wi_is_equal(wi_p7_message_name(reply), WI_STR("wired.transfer.upload"))) {
+	if(!wi_is_equal(wi_p7_message_name(message), WI_STR("wired.transfer.upload"))) {
 		wi_log_error(WI_STR("Could not accept message %@ from %@: Expected \"wired.transfer.upload\""),
-			wi_p7_message_name(reply), wd_user_identifier(user));
-		wd_user_reply_error(user, WI_STR("wired.error.invalid_message"), reply);
+			wi_p7_message_name(message), wd_user_identifier(user));
+		wd_user_reply_error(user, WI_STR("wired.error.invalid_message"), message);
 		
-		return false;
+		return NULL;
 	}
 	
-	wi_p7_message_get_uint64_for_name(reply, &transfer->remainingdatasize, WI_STR("wired.transfer.data"));
-	wi_p7_message_get_uint64_for_name(reply, &transfer->remainingrsrcsize, WI_STR("wired.transfer.rsrc"));
+	return message;
+}
+
+
+
+static wi_boolean_t wd_transfers_upload_is_allowed(wi_string_t *path, wd_user_t *user) {
+	wi_string_t				*realparentpath;
+	wd_account_t			*account;
+	wd_files_privileges_t	*privileges;
 	
-	transfer->finderinfo = wi_retain(wi_p7_message_data_for_name(reply, WI_STR("wired.transfer.finderinfo")));
+	account		= wd_user_account(user);
+	privileges	= wd_files_privileges(path, user);
 	
-	wi_socket_set_interactive(wd_user_socket(user), false);
+	if(privileges && !wd_files_privileges_is_writable_by_account(privileges, account))
+		return false;
 	
-	result = wd_transfer_upload(transfer);
+	realparentpath = wi_string_by_deleting_last_path_component(
+		wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user)));
+	
+	switch(wd_files_type(realparentpath)) {
+		case WD_FILE_TYPE_UPLOADS:
+		case WD_FILE_TYPE_DROPBOX:
+			return wd_account_transfer_upload_files(account);
+			break;
+		
+		default:
+			return wd_account_transfer_upload_anywhere(account);
+			break;
+	}
+}
+
 
-	wi_socket_set_interactive(wd_user_socket(user), true);
 
-	if(transfer->transferred == transfer->datasize + transfer->rsrcsize) {
-		path = wi_string_by_deleting_path_extension(transfer->realdatapath);
+static wi_string_t * wd_transfers_complete_upload(wd_transfer_t *transfer) {
+	wi_string_t		*path;
+	
+	if(transfer->transferred != transfer->datasize + transfer->rsrcsize) {
+		if(transfer->hashlist)
+			wd_hashlist_write_to_path(transfer->hashlist, transfer->realdatapath, false);
 		
-		if(wi_fs_rename_path(transfer->realdatapath, path)) {
-			if(transfer->executable) {
-				if(!wi_fs_set_mode_for_path(path, 0755))
-					wi_log_error(WI_STR("Could not set mode for \"%@\": %m"), path);
-			}
-			
-			wd_files_move_comment(transfer->realdatapath, path, NULL, NULL);
-			wd_files_move_label(transfer->realdatapath, path, NULL, NULL);
-			
-			if(wi_data_length(transfer->finderinfo) > 0)
-				wi_fs_set_finder_info_for_path(transfer->finderinfo, path);
-			
-			wd_index_add_file(path);
-		} else {
-			wi_log_error(WI_STR("Could not move \"%@\" to \"%@\": %m"),
-				transfer->realdatapath, path);
-		}
+		return NULL;
+	}
 	
-		wd_accounts_add_upload_statistics(wd_user_account(user), true, transfer->actualtransferred);
-	} else {
-		wd_accounts_add_upload_statistics(wd_user_account(user), false, transfer->actualtransferred);
+	path = wi_string_by_deleting_path_extension(transfer->realdatapath);
+	
+	if(!wi_fs_rename_path(transfer->realdatapath, path)) {
+		wi_log_error(WI_STR("Could not move \"%@\" to \"%@\": %m"),
+			transfer->realdatapath, path);
+		
+		return NULL;
 	}
 	
-	return result;
+	if(transfer->executable) {
+		if(!wi_fs_set_mode_for_path(path, 0755))
+			wi_log_error(WI_STR("Could not set mode for \"%@\": %m"), path);
+	}
+	
+	wd_files_move_comment(transfer->realdatapath, path, NULL, NULL);
+	wd_files_move_label(transfer->realdatapath, path, NULL, NULL);
+	
+	if(wi_data_length(transfer->finderinfo) > 0)
+		wi_fs_set_finder_info_for_path(transfer->finderinfo, path);
+	
+	if(transfer->hashlist && wd_hashlist_length(transfer->hashlist) == transfer->datasize)
+		wd_hashlist_write_to_path(transfer->hashlist, path, true);
+	
+	wd_hashes_remove_path(transfer->realdatapath);
+	
+	return path;
 }
 
 
@@ -487,33 +1617,41 @@ static void wd_transfers_add_or_remove_transfer(wd_transfer_t *transfer, wi_bool
 
 
 static void wd_transfers_note_statistics(wd_transfer_type_t type, wd_transfers_statistics_type_t statistics, wi_file_offset_t bytes) {
-	wi_lock_lock(wd_status_lock);
-
 	if(type == WD_TRANSFER_DOWNLOAD) {
 		if(statistics == WD_TRANSFER_STATISTICS_ADD) {
-			wd_current_downloads++;
-			wd_total_downloads++;
+			wd_stats_add(WD_STAT_CURRENT_DOWNLOADS, 1);
+			wd_stats_add(WD_STAT_TOTAL_DOWNLOADS, 1);
 		}
 		else if(statistics == WD_TRANSFER_STATISTICS_REMOVE) {
-			wd_current_downloads--;
+			wd_stats_add(WD_STAT_CURRENT_DOWNLOADS, -1);
 		}
 		
-		wd_downloads_traffic += bytes;
+		if(bytes > 0)
+			wd_stats_add(WD_STAT_DOWNLOADS_TRAFFIC, bytes);
 	} else {
 		if(statistics == WD_TRANSFER_STATISTICS_ADD) {
-			wd_current_uploads++;
-			wd_total_uploads++;
+			wd_stats_add(WD_STAT_CURRENT_UPLOADS, 1);
+			wd_stats_add(WD_STAT_TOTAL_UPLOADS, 1);
 		}
 		else if(statistics == WD_TRANSFER_STATISTICS_REMOVE) {
-			wd_current_uploads--;
+			wd_stats_add(WD_STAT_CURRENT_UPLOADS, -1);
 		}
 		
-		wd_uploads_traffic += bytes;
+		if(bytes > 0)
+			wd_stats_add(WD_STAT_UPLOADS_TRAFFIC, bytes);
 	}
+}
+
+
 
-	wd_write_status((statistics != WD_TRANSFER_STATISTICS_DATA));
+static void wd_transfers_note_tuning(wd_transfer_type_t type, wi_file_offset_t bytes, wi_time_interval_t diskwait, wi_time_interval_t socketwait) {
+	wi_lock_lock(wd_transfers_status_lock);
+	
+	wd_transfers_tuning[type].bytes			+= bytes;
+	wd_transfers_tuning[type].diskwait		+= diskwait;
+	wd_transfers_tuning[type].socketwait	+= socketwait;
 	
-	wi_lock_unlock(wd_status_lock);
+	wi_lock_unlock(wd_transfers_status_lock);
 }
 
 
@@ -521,28 +1659,56 @@ static void wd_transfers_note_statistics(wd_transfer_type_t type, wd_transfers_s
 #pragma mark -
 
 wi_boolean_t wd_transfers_run_transfer(wd_transfer_t *transfer, wd_user_t *user, wi_p7_message_t *message) {
-	wi_boolean_t		result = false;
+	wd_transfer_t		*leader;
+	wi_boolean_t		ready, result = false;
 	
 	wi_array_wrlock(wd_transfers);
+	
+	if(transfer->segment) {
+		leader = wd_transfers_segment_leader(transfer);
+		
+		/* Segments past the limit go through the queue and take slots like any other download */
+		if(leader && leader->segments < WD_TRANSFERS_MAX_SEGMENTS) {
+			transfer->leader = wi_retain(leader);
+			
+			leader->segments++;
+		} else {
+			transfer->segments = 1;
+		}
+	}
+	
 	wi_mutable_array_add_data(wd_transfers, transfer);
 	wi_array_unlock(wd_transfers);
 	
-	wi_condition_lock_lock(wd_transfers_queue_lock);
-	wi_condition_lock_unlock_with_condition(wd_transfers_queue_lock, 1);
+	if(transfer->leader) {
+		ready = wd_transfers_wait_for_leader(transfer);
+	} else {
+		wd_transfers_enqueue_transfer(transfer);
+		
+		ready = wd_transfers_wait_until_ready(transfer, user, message);
+	}
 	
-	if(wd_transfers_wait_until_ready(transfer, user, message)) {
+	if(ready && wd_user_state(user) == WD_USER_LOGGED_IN) {
 		wi_condition_lock_lock(transfer->queue_lock);
 		transfer->state = WD_TRANSFER_RUNNING;
 		wi_condition_lock_unlock(transfer->queue_lock);
 		
-		if(transfer->type == WD_TRANSFER_DOWNLOAD)
+		wi_condition_lock_lock(transfer->started_lock);
+		wi_condition_lock_unlock_with_condition(transfer->started_lock, 1);
+		
+		if(transfer->type == WD_TRANSFER_DOWNLOAD && transfer->directory)
+			result = wd_transfers_run_directory_download(transfer, user, message);
+		else if(transfer->type == WD_TRANSFER_DOWNLOAD)
 			result = wd_transfers_run_download(transfer, user, message);
+		else if(transfer->directory)
+			result = wd_transfers_run_batch_upload(transfer, user, message);
 		else
 			result = wd_transfers_run_upload(transfer, user, message);
 			
 		wi_condition_lock_lock(transfer->finished_lock);
 		wi_condition_lock_unlock_with_condition(transfer->finished_lock, 1);
-	} else {
+	}
+	else if(!ready) {
 		wi_log_error(WI_STR("Could not process %@ for %@: %m"),
 			(transfer->type == WD_TRANSFER_DOWNLOAD)
 				? WI_STR("download")
@@ -550,15 +1716,20 @@ wi_boolean_t wd_transfers_run_transfer(wd_transfer_t *transfer, wd_user_t *user,
 			wd_user_identifier(user));
 	}
 	
-	if(transfer->queue == 0)
+	if(transfer->segment)
+		wd_transfers_finish_segment(transfer, user, result);
+	
+	if(!transfer->leader && !wd_transfers_dequeue_transfer(transfer) && transfer->queue == 0) {
 		wd_transfers_add_or_remove_transfer(transfer, false);
+		wd_transfers_finish_transfer(transfer);
+	}
 
 	wi_array_wrlock(wd_transfers);
 	wi_mutable_array_remove_data(wd_transfers, transfer);
 	wi_array_unlock(wd_transfers);
 	
-	wi_condition_lock_lock(wd_transfers_queue_lock);
-	wi_condition_lock_unlock_with_condition(wd_transfers_queue_lock, 1);
+	wi_condition_lock_lock(transfer->started_lock);
+	wi_condition_lock_unlock_with_condition(transfer->started_lock, 1);
 	
 	return result;
 }
@@ -571,20 +1742,32 @@ void wd_transfers_remove_user(wd_user_t *user, wi_boolean_t removingallusers) {
 	wd_user_t				*each_user;
 	wd_transfer_t			*transfer;
 	wi_uinteger_t			i, count;
-	wi_boolean_t			update = false, present = false;
+	wi_boolean_t			present = false;
 	
 	key = wd_transfers_transfer_key_for_user(user);
 	
 	if(!key)
 		return;
 	
+	wi_array_rdlock(wd_transfers);
+	
+	enumerator = wi_array_data_enumerator(wd_transfers);
+	
+	while((transfer = wi_enumerator_next_data(enumerator))) {
+		if(transfer->user == user && transfer->state == WD_TRANSFER_QUEUED)
+			wd_transfers_dequeue_transfer(transfer);
+	}
+	
+	wi_array_unlock(wd_transfers);
+	
 	if(!removingallusers) {
 		wi_dictionary_rdlock(wd_users);
 		
 		enumerator = wi_dictionary_data_enumerator(wd_users);
 		
 		while((each_user = wi_enumerator_next_data(enumerator))) {
-			if(wd_user_state(each_user) == WD_USER_LOGGED_IN && wi_is_equal(wd_transfers_transfer_key_for_user(each_user), key)) {
+			if(wd_user_state(each_user) == WD_USER_LOGGED_IN && wd_user_session_id(each_user) == 0 &&
+			   wi_is_equal(wd_transfers_transfer_key_for_user(each_user), key)) {
 				present = true;
 				
 				break;
@@ -609,20 +1792,15 @@ void wd_transfers_remove_user(wd_user_t *user, wi_boolean_t removingallusers) {
 					if(wi_condition_lock_lock_when_condition(transfer->finished_lock, 1, 1.0))
 						wi_condition_lock_unlock(transfer->finished_lock);
 				} else {
+					wd_transfers_dequeue_transfer(transfer);
+					
 					wi_mutable_array_remove_data_at_index(wd_transfers, i);
 					
 					i--;
 					count--;
-					
-					update = true;
 				}
 			}
 		}
-		
-		if(update) {
-			wi_condition_lock_lock(wd_transfers_queue_lock);
-			wi_condition_lock_unlock_with_condition(wd_transfers_queue_lock, 1);
-		}
 
 		wi_array_unlock(wd_transfers);
 	}
@@ -657,83 +1835,38 @@ wd_transfer_t * wd_transfers_transfer_with_path(wd_user_t *user, wi_string_t *pa
 
 #pragma mark -
 
-wd_transfer_t * wd_transfer_download_transfer(wi_string_t *path, wi_file_offset_t dataoffset, wi_file_offset_t rsrcoffset, wd_user_t *user, wi_p7_message_t *message) {
-	wi_string_t				*realdatapath, *realrsrcpath;
+wd_transfer_t * wd_transfer_download_transfer(wi_string_t *path, wi_file_offset_t dataoffset, wi_file_offset_t rsrcoffset, wi_file_offset_t datalength, wd_user_t *user, wi_p7_message_t *message) {
 	wd_transfer_t			*transfer;
-	wi_fs_stat_t			sb;
-	wi_file_offset_t		datasize, rsrcsize;
-	int						datafd, rsrcfd;
-	
-	realdatapath = wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
-	
-	if(wi_fs_stat_path(realdatapath, &sb))
-		datasize = sb.size;
-	else
-		datasize = 0;
 	
-	datafd = open(wi_string_cstring(realdatapath), O_RDONLY, 0);
+	transfer = wd_transfer_open_download(path, dataoffset, rsrcoffset, datalength, user, message);
 	
-	if(datafd < 0) {
-		wi_log_error(WI_STR("Could not open \"%@\" for download: %s"),
-			realdatapath, strerror(errno));
+	if(!transfer)
 		wd_user_reply_file_errno(user, message);
+	
+	return transfer;
+}
 
-		return NULL;
-	}
 
-	if(lseek(datafd, dataoffset, SEEK_SET) < 0) {
-		wi_log_error(WI_STR("Could not seek to %llu in \"%@\" for download: %s"),
-			dataoffset, realdatapath, strerror(errno));
-		wd_user_reply_file_errno(user, message);
-		
-		close(datafd);
-		
-		return NULL;
-	}
-	
-	realrsrcpath = wi_fs_resource_fork_path_for_path(realdatapath);
-		
-	if(wd_user_supports_rsrc(user) && realrsrcpath) {
-		if(wi_fs_stat_path(realrsrcpath, &sb))
-			rsrcsize = sb.size;
-		else
-			rsrcsize = 0;
-		
-		rsrcfd = open(wi_string_cstring(realrsrcpath), O_RDONLY, 0);
-		
-		if(rsrcfd >= 0) {
-			if(lseek(rsrcfd, rsrcoffset, SEEK_SET) < 0) {
-				wi_log_error(WI_STR("Could not seek to %llu in \"%@\" for download: %s"),
-					rsrcoffset, realrsrcpath, strerror(errno));
-				wd_user_reply_file_errno(user, message);
-				
-				close(datafd);
-				close(rsrcfd);
-				
-				return NULL;
-			}
-		}
-	} else {
-		rsrcfd						= -1;
-		rsrcsize					= 0;
-	}
+
+wd_transfer_t * wd_transfer_download_directory_transfer(wi_string_t *path, wi_string_t *resumepath, wi_file_offset_t dataoffset, wi_file_offset_t rsrcoffset, wd_user_t *user, wi_p7_message_t *message) {
+	wd_transfer_t			*transfer;
 	
 	transfer						= wd_transfer_init(wd_transfer_alloc());
 	transfer->type					= WD_TRANSFER_DOWNLOAD;
+	transfer->directory				= true;
 	transfer->user					= user;
 	transfer->key					= wi_retain(wd_transfers_transfer_key_for_user(user));
 	transfer->path					= wi_retain(path);
-	transfer->realdatapath			= wi_retain(realdatapath);
-	transfer->realrsrcpath			= wi_retain(realrsrcpath);
-	transfer->datafd				= datafd;
-	transfer->rsrcfd				= rsrcfd;
-	transfer->datasize				= datasize;
-	transfer->rsrcsize				= rsrcsize;
-	transfer->dataoffset			= dataoffset;
-	transfer->rsrcoffset			= rsrcoffset;
-	transfer->transferred			= dataoffset + rsrcoffset;
-	transfer->remainingdatasize		= datasize - dataoffset;
-	transfer->remainingrsrcsize		= rsrcsize - rsrcoffset;
+	transfer->realdatapath			= wi_retain(wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user)));
+	transfer->datafd				= -1;
+	transfer->rsrcfd				= -1;
+	
+	/* The tree is listed by wd_transfers_list_directory_download() once the transfer leaves the queue */
+	if(resumepath) {
+		transfer->resumepath		= wi_retain(resumepath);
+		transfer->dataoffset		= dataoffset;
+		transfer->rsrcoffset		= rsrcoffset;
+	}
 	
 	return wi_autorelease(transfer);
 }
@@ -763,7 +1896,7 @@ wd_transfer_t * wd_transfer_upload_transfer(wi_string_t *path, wi_file_offset_t
 	else
 		dataoffset = 0;
 	
-	datafd = open(wi_string_cstring(realdatapath), O_WRONLY | O_APPEND | O_CREAT, 0666);
+	datafd = open(wi_string_cstring(realdatapath), O_RDWR | O_APPEND | O_CREAT, 0666);
 	
 	if(datafd < 0) {
 		wi_log_error(WI_STR("Could not open \"%@\" for upload: %s"),
@@ -821,29 +1954,72 @@ wd_transfer_t * wd_transfer_upload_transfer(wi_string_t *path, wi_file_offset_t
 			
 			return NULL;
 		}
-	} else {
-		realrsrcpath				= NULL;
-		rsrcoffset					= 0;
-		rsrcfd						= -1;
+	} else {
+		realrsrcpath				= NULL;
+		rsrcoffset					= 0;
+		rsrcfd						= -1;
+	}
+	
+	transfer						= wd_transfer_init(wd_transfer_alloc());
+	transfer->type					= WD_TRANSFER_UPLOAD;
+	transfer->user					= user;
+	transfer->key					= wi_retain(wd_transfers_transfer_key_for_user(user));
+	transfer->path					= wi_retain(path);
+	transfer->realdatapath			= wi_retain(realdatapath);
+	transfer->realrsrcpath			= wi_retain(realrsrcpath);
+	transfer->datafd				= datafd;
+	transfer->rsrcfd				= rsrcfd;
+	transfer->datasize				= datasize;
+	transfer->rsrcsize				= rsrcsize;
+	transfer->dataoffset			= dataoffset;
+	transfer->rsrcoffset			= rsrcoffset;
+	transfer->transferred			= dataoffset + rsrcoffset;
+	transfer->executable			= executable;
+	transfer->remainingdatasize		= datasize - dataoffset;
+	transfer->remainingrsrcsize		= rsrcsize - rsrcoffset;
+	transfer->hashlist				= wd_hashlist_init_with_path(wd_hashlist_alloc(), realdatapath, dataoffset);
+	
+	if(!wd_hashlist_update_with_file(transfer->hashlist, datafd, dataoffset)) {
+		wi_log_warn(WI_STR("Could not hash \"%@\" for upload: %s"),
+			realdatapath, strerror(errno));
+		
+		wi_release(transfer->hashlist);
+		transfer->hashlist = NULL;
+	}
+	
+	return wi_autorelease(transfer);
+}
+
+
+
+wd_transfer_t * wd_transfer_upload_batch_transfer(wi_string_t *path, wi_array_t *directories, wi_uinteger_t filecount, wi_file_offset_t datasize, wi_file_offset_t rsrcsize, wd_user_t *user, wi_p7_message_t *message) {
+	wi_enumerator_t			*enumerator;
+	wi_string_t				*directory;
+	wd_transfer_t			*transfer;
+	
+	enumerator = wi_array_data_enumerator(directories);
+	
+	while((directory = wi_enumerator_next_data(enumerator))) {
+		if(!wd_files_path_is_valid(directory)) {
+			wd_user_reply_error(user, WI_STR("wired.error.file_not_found"), message);
+			
+			return NULL;
+		}
 	}
 	
 	transfer						= wd_transfer_init(wd_transfer_alloc());
 	transfer->type					= WD_TRANSFER_UPLOAD;
+	transfer->directory				= true;
 	transfer->user					= user;
 	transfer->key					= wi_retain(wd_transfers_transfer_key_for_user(user));
 	transfer->path					= wi_retain(path);
-	transfer->realdatapath			= wi_retain(realdatapath);
-	transfer->realrsrcpath			= wi_retain(realrsrcpath);
-	transfer->datafd				= datafd;
-	transfer->rsrcfd				= rsrcfd;
+	transfer->realdatapath			= wi_retain(wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user)));
+	transfer->datafd				= -1;
+	transfer->rsrcfd				= -1;
+	transfer->entries				= wi_retain(wi_array_by_sorting(directories, wi_string_compare));
+	transfer->filecount				= filecount;
 	transfer->datasize				= datasize;
 	transfer->rsrcsize				= rsrcsize;
-	transfer->dataoffset			= dataoffset;
-	transfer->rsrcoffset			= rsrcoffset;
-	transfer->transferred			= dataoffset + rsrcoffset;
-	transfer->executable			= executable;
-	transfer->remainingdatasize		= datasize - dataoffset;
-	transfer->remainingrsrcsize		= rsrcsize - rsrcoffset;
 	
 	return wi_autorelease(transfer);
 }
@@ -864,6 +2040,7 @@ static wd_transfer_t * wd_transfer_init(wd_transfer_t *transfer) {
 	transfer->queue_time		= wi_time_interval();
 	transfer->state				= WD_TRANSFER_QUEUED;
 	transfer->finished_lock		= wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
+	transfer->started_lock		= wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
 	
 	return transfer;
 }
@@ -873,11 +2050,19 @@ static wd_transfer_t * wd_transfer_init(wd_transfer_t *transfer) {
 static void wd_transfer_dealloc(wi_runtime_instance_t *instance) {
 	wd_transfer_t		*transfer = instance;
 	
-	if(transfer->datafd >= 0)
+	if(transfer->datafd >= 0) {
+		if(transfer->type == WD_TRANSFER_UPLOAD)
+			wd_pipelines_release(transfer->datafd);
+		
 		close(transfer->datafd);
+	}
 	
-	if(transfer->rsrcfd >= 0)
+	if(transfer->rsrcfd >= 0) {
+		if(transfer->type == WD_TRANSFER_UPLOAD)
+			wd_pipelines_release(transfer->rsrcfd);
+		
 		close(transfer->rsrcfd);
+	}
 
 	wi_release(transfer->key);
 
@@ -886,6 +2071,12 @@ static void wd_transfer_dealloc(wi_runtime_instance_t *instance) {
 	wi_release(transfer->realrsrcpath);
 
 	wi_release(transfer->finished_lock);
+	wi_release(transfer->started_lock);
+	wi_release(transfer->hashlist);
+	wi_release(transfer->cachedata);
+	wi_release(transfer->leader);
+	wi_release(transfer->entries);
+	wi_release(transfer->resumepath);
 	
 	wi_release(transfer->queue_lock);
 	
@@ -907,51 +2098,161 @@ static wi_string_t * wd_transfer_description(wi_runtime_instance_t *instance) {
 
 #pragma mark -
 
-static inline void wd_transfer_limit_speed(wd_transfer_t *transfer, wi_uinteger_t totalspeed, wi_uinteger_t accountspeed, wi_uinteger_t totalcount, wi_uinteger_t accountcount, ssize_t bytes, wi_time_interval_t now, wi_time_interval_t then) {
-	wi_uinteger_t		limit, totallimit, accountlimit;
-	wi_time_interval_t	start;
+static wd_transfer_t * wd_transfer_open_download(wi_string_t *path, wi_file_offset_t dataoffset, wi_file_offset_t rsrcoffset, wi_file_offset_t datalength, wd_user_t *user, wi_p7_message_t *message) {
+	wi_string_t				*realdatapath, *realrsrcpath;
+	wd_transfer_t			*transfer;
+	wd_hashlist_t			*hashlist;
+	wd_cache_entry_t		*entry;
+	wi_data_t				*hashes, *cachedata;
+	wi_fs_stat_t			sb;
+	wi_file_offset_t		datasize, rsrcsize, length, cachedsize;
+	int						datafd, rsrcfd;
+	wi_boolean_t			resuming;
+	
+	realdatapath = wi_string_by_resolving_aliases_in_path(wd_files_real_path(path, user));
+	
+	if(wi_fs_stat_path(realdatapath, &sb)) {
+		datasize	= sb.size;
+		entry		= wd_caches_entry_for_path(realdatapath, &sb);
+	} else {
+		datasize	= 0;
+		entry		= NULL;
+	}
+	
+	cachedata	= entry ? wd_cache_entry_data(entry) : NULL;
+	hashes		= wi_p7_message_data_for_name(message, WI_STR("wired.transfer.block_hashes"));
+	resuming	= (hashes && datalength == 0 && dataoffset > 0);
+	
+	if(cachedata && wi_data_length(cachedata) == datasize && !resuming) {
+		datafd = -1;
+	} else {
+		datafd = open(wi_string_cstring(realdatapath), O_RDONLY, 0);
+		
+		if(datafd < 0) {
+			wi_log_error(WI_STR("Could not open \"%@\" for download: %s"),
+				realdatapath, strerror(errno));
+
+			return NULL;
+		}
+		
+		if(!entry && datasize > 0) {
+			entry		= wd_caches_add_path(realdatapath, &sb, datafd);
+			cachedata	= entry ? wd_cache_entry_data(entry) : NULL;
+		}
+	}
 	
-	if(totalspeed > 0 || accountspeed > 0) {
-		totallimit		= (totalspeed > 0 && totalcount > 0) ? (float) totalspeed / (float) totalcount : 0;
-		accountlimit	= (accountspeed > 0 && accountcount > 0) ? (float) accountspeed / (float) accountcount : 0;
+	if(resuming) {
+		length		= WI_MIN(dataoffset, (wi_file_offset_t) (wi_data_length(hashes) / 8) * WD_HASHES_BLOCK_SIZE);
+		hashlist	= wd_hashlist_init_with_path(wd_hashlist_alloc(), realdatapath, length);
 		
-		if(totallimit > 0 && accountlimit > 0)
-			limit = WI_MIN(totallimit, accountlimit);
-		else if(totallimit > 0)
-			limit = totallimit;
-		else
-			limit = accountlimit;
+		if(wd_hashlist_update_with_file(hashlist, datafd, length - (length % WD_HASHES_BLOCK_SIZE)))
+			dataoffset = WI_MIN(dataoffset, wd_hashlist_matching_length(hashlist, hashes));
+		
+		wi_release(hashlist);
+	}
+	
+	if(cachedata && dataoffset < wi_data_length(cachedata))
+		cachedsize = wi_data_length(cachedata) - dataoffset;
+	else
+		cachedsize = 0;
 
-		if(limit > 0) {
-			start = now;
+	if(datafd >= 0) {
+		if(lseek(datafd, dataoffset + cachedsize, SEEK_SET) < 0) {
+			wi_log_error(WI_STR("Could not seek to %llu in \"%@\" for download: %s"),
+				dataoffset + cachedsize, realdatapath, strerror(errno));
+			
+			close(datafd);
 			
-			while(transfer->speed > limit && now - start < 5.0) {
-				usleep(10000);
-				now += 0.01;
+			return NULL;
+		}
+		
+		wd_pipelines_prefetch(datafd, dataoffset + cachedsize);
+	}
+	
+	realrsrcpath = wi_fs_resource_fork_path_for_path(realdatapath);
+		
+	if(datalength == 0 && wd_user_supports_rsrc(user) && realrsrcpath) {
+		if(wi_fs_stat_path(realrsrcpath, &sb))
+			rsrcsize = sb.size;
+		else
+			rsrcsize = 0;
+		
+		rsrcfd = open(wi_string_cstring(realrsrcpath), O_RDONLY, 0);
+		
+		if(rsrcfd >= 0) {
+			if(lseek(rsrcfd, rsrcoffset, SEEK_SET) < 0) {
+				wi_log_error(WI_STR("Could not seek to %llu in \"%@\" for download: %s"),
+					rsrcoffset, realrsrcpath, strerror(errno));
+				
+				close(datafd);
+				close(rsrcfd);
 				
-				transfer->speed = bytes / (now - then);
+				return NULL;
 			}
 		}
+	} else {
+		rsrcfd						= -1;
+		rsrcsize					= 0;
+	}
+	
+	transfer						= wd_transfer_init(wd_transfer_alloc());
+	transfer->type					= WD_TRANSFER_DOWNLOAD;
+	transfer->user					= user;
+	transfer->key					= wi_retain(wd_transfers_transfer_key_for_user(user));
+	transfer->path					= wi_retain(path);
+	transfer->realdatapath			= wi_retain(realdatapath);
+	transfer->realrsrcpath			= wi_retain(realrsrcpath);
+	transfer->datafd				= datafd;
+	transfer->rsrcfd				= rsrcfd;
+	transfer->datasize				= datasize;
+	transfer->rsrcsize				= rsrcsize;
+	transfer->dataoffset			= dataoffset;
+	transfer->rsrcoffset			= rsrcoffset;
+	transfer->transferred			= dataoffset + rsrcoffset;
+	transfer->remainingdatasize		= datasize - dataoffset;
+	transfer->remainingrsrcsize		= rsrcsize - rsrcoffset;
+	
+	if(cachedsize > 0) {
+		transfer->cachedata			= wi_retain(cachedata);
+		transfer->finderinfo		= wi_retain(wd_cache_entry_finder_info(entry));
+	}
+	
+	if(dataoffset == 0 && datalength == 0)
+		transfer->hashlist			= wd_hashlist_init(wd_hashlist_alloc());
+	
+	if(datalength > 0) {
+		transfer->segment				= true;
+		transfer->session_id			= wd_user_session_id(user);
+		transfer->remainingdatasize		= WI_MIN(datalength, transfer->remainingdatasize);
+		transfer->remainingrsrcsize		= 0;
+		
+		if(transfer->session_id == 0)
+			transfer->session_id = wd_user_id(user);
 	}
+	
+	return wi_autorelease(transfer);
 }
 
 
 
-#pragma mark -
-
 static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 	wi_pool_t				*pool;
 	wi_socket_t				*socket;
 	wi_p7_socket_t			*p7_socket;
 	wd_account_t			*account;
-	char					buffer[WD_TRANSFER_BUFFER_SIZE];
+	wd_pipeline_t			*pipeline;
+	wd_shaper_t				*shaper;
+	wd_hashlist_t			*hashlist, *stored;
+	const void				*buffer;
+	const char				*cachebuffer;
 	wi_socket_state_t		state;
 	wi_time_interval_t		timeout, interval, speedinterval, statusinterval, accountinterval;
-	wi_file_offset_t		sendbytes, speedbytes, statsbytes;
-	wi_uinteger_t			i, transfers;
+	wi_time_interval_t		readinterval, diskwait, socketwait;
+	wi_file_offset_t		sendbytes, speedbytes, statsbytes, cachedbytes;
+	wi_uinteger_t			i;
 	ssize_t					readbytes;
 	int						sd;
-	wi_boolean_t			data, result;
+	wi_boolean_t			data, result, zerocopy, cached;
 	wd_user_state_t			user_state;
 	
 	interval				= wi_time_interval();
@@ -960,6 +2261,8 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 	accountinterval			= interval;
 	speedbytes				= 0;
 	statsbytes				= 0;
+	diskwait				= 0.0;
+	socketwait				= 0.0;
 	i						= 0;
 	socket					= wd_user_socket(transfer->user);
 	sd						= wi_socket_descriptor(socket);
@@ -967,27 +2270,59 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 	account					= wd_user_account(transfer->user);
 	data					= true;
 	result					= true;
+	zerocopy				= wd_transfer_can_sendfile(p7_socket);
+	pipeline				= NULL;
+	hashlist				= zerocopy ? NULL : transfer->hashlist;
+	shaper					= wd_shaper_init_with_transfer(wd_shaper_alloc(), transfer);
+	cachebuffer				= NULL;
+	cachedbytes				= 0;
+	
+	if(transfer->cachedata) {
+		cachebuffer			= (const char *) wi_data_bytes(transfer->cachedata) + transfer->dataoffset;
+		cachedbytes			= WI_MIN(wi_data_length(transfer->cachedata) - transfer->dataoffset, transfer->remainingdatasize);
+	}
 	
-	wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, WD_TRANSFER_STATISTICS_ADD, 0);
-	
-	wi_dictionary_rdlock(wd_transfers_user_downloads);
-	
-	transfers = (wi_integer_t) wi_dictionary_data_for_key(wd_transfers_user_downloads, transfer->key);
+	if(!zerocopy && transfer->datafd >= 0)
+		pipeline = wd_pipeline_init_for_reading(wd_pipeline_alloc(), transfer->datafd, transfer->remainingdatasize - cachedbytes);
 	
-	wi_dictionary_unlock(wd_transfers_user_downloads);
+	wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, (transfer->leader || transfer->parent) ? WD_TRANSFER_STATISTICS_DATA : WD_TRANSFER_STATISTICS_ADD, 0);
 
 	pool = wi_pool_init(wi_pool_alloc());
 	
+	wd_pipelines_set_transfer_io_priority(true);
+	
 	wd_user_lock_socket(transfer->user);
 	
 	while(wd_user_state(transfer->user) == WD_USER_LOGGED_IN) {
-		if(data && transfer->remainingdatasize == 0)
+		if(data && transfer->remainingdatasize == 0) {
 			data = false;
+			
+			if(!zerocopy) {
+				if(pipeline) {
+					wd_pipeline_close(pipeline);
+					wi_release(pipeline);
+				}
+				
+				pipeline = wd_pipeline_init_for_reading(wd_pipeline_alloc(), transfer->rsrcfd, transfer->remainingrsrcsize);
+			}
+		}
 			  
 		if(!data && transfer->remainingrsrcsize == 0)
 			break;
 		
-		readbytes = read(data ? transfer->datafd : transfer->rsrcfd, buffer, sizeof(buffer));
+		cached			= (data && cachedbytes > 0);
+		readinterval	= wi_time_interval();
+		
+		if(cached) {
+			buffer		= cachebuffer;
+			readbytes	= WI_MIN(cachedbytes, WD_TRANSFER_SENDFILE_SIZE);
+		}
+		else if(zerocopy) {
+			readbytes	= WD_TRANSFER_SENDFILE_SIZE;
+		}
+		else {
+			readbytes	= wd_pipeline_read(pipeline, &buffer);
+		}
 		
 		if(readbytes <= 0) {
 			if(readbytes < 0) {
@@ -999,7 +2334,8 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 			break;
 		}
 
-		timeout = wi_time_interval();
+		timeout		= wi_time_interval();
+		diskwait	+= timeout - readinterval;
 		
 		do {
 			user_state		= wd_user_state(transfer->user);
@@ -1035,7 +2371,16 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 				: (wi_file_offset_t) readbytes;
 		}
 		
-		if(!wi_p7_socket_write_oobdata(p7_socket, 30.0, buffer, sendbytes)) {
+		if(zerocopy && !cached) {
+			if(!wd_transfer_sendfile(sd, data ? transfer->datafd : transfer->rsrcfd, sendbytes, 30.0)) {
+				wi_log_error(WI_STR("Could not write download to %@: %s"),
+					wd_user_identifier(transfer->user), errno ? strerror(errno) : "File truncated");
+				
+				result = false;
+				break;
+			}
+		}
+		else if(!wi_p7_socket_write_oobdata(p7_socket, 30.0, buffer, sendbytes)) {
 			wi_log_error(WI_STR("Could not write download to %@: %m"),
 				wd_user_identifier(transfer->user));
 			
@@ -1043,36 +2388,47 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 			break;
 		}
 		
-		if(data)
+		if(data) {
+			if(hashlist)
+				wd_hashlist_update(hashlist, buffer, sendbytes);
+			
+			if(cached) {
+				cachebuffer					+= sendbytes;
+				cachedbytes					-= sendbytes;
+			}
+			
 			transfer->remainingdatasize		-= sendbytes;
-		else
+		} else {
 			transfer->remainingrsrcsize		-= sendbytes;
+		}
 		
 		interval							= wi_time_interval();
+		socketwait							+= interval - timeout;
 		transfer->transferred				+= sendbytes;
 		transfer->actualtransferred			+= sendbytes;
 		speedbytes							+= sendbytes;
 		statsbytes							+= sendbytes;
 		transfer->speed						= speedbytes / (interval - speedinterval);
+		
+		if(transfer->parent) {
+			transfer->parent->transferred		+= sendbytes;
+			transfer->parent->actualtransferred	+= sendbytes;
+		}
 
-		wd_transfer_limit_speed(transfer,
-								wd_transfers_total_download_speed,
-								wd_account_transfer_download_speed_limit(account),
-								wd_current_downloads,
-								transfers,
-								speedbytes,
-								interval,
-								speedinterval);
+		wd_shaper_limit(shaper, sendbytes);
 		
 		if(interval - speedinterval > 30.0) {
 			speedbytes = 0;
 			speedinterval = interval;
 		}
 
-		if(interval - statusinterval > wd_current_downloads) {
+		if(interval - statusinterval > WD_TRANSFERS_STATISTICS_INTERVAL) {
 			wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, WD_TRANSFER_STATISTICS_DATA, statsbytes);
+			wd_transfers_note_tuning(WD_TRANSFER_DOWNLOAD, statsbytes, diskwait, socketwait);
 
 			statsbytes = 0;
+			diskwait = 0.0;
+			socketwait = 0.0;
 			statusinterval = interval;
 		}
 		
@@ -1080,11 +2436,7 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 			account = wd_user_account(transfer->user);
 			accountinterval = interval;
 
-			wi_dictionary_rdlock(wd_transfers_user_downloads);
-			
-			transfers = (wi_integer_t) wi_dictionary_data_for_key(wd_transfers_user_downloads, transfer->key);
-			
-			wi_dictionary_unlock(wd_transfers_user_downloads);
+			wd_shaper_update_account(shaper, account);
 		}
 		
 		if(++i % 1000 == 0)
@@ -1093,25 +2445,201 @@ static wi_boolean_t wd_transfer_download(wd_transfer_t *transfer) {
 	
 	wd_user_unlock_socket(transfer->user);
 	
+	wd_pipelines_set_transfer_io_priority(false);
+	
+	if(pipeline) {
+		wd_pipeline_close(pipeline);
+		wi_release(pipeline);
+	}
+	
+	if(hashlist && wd_hashlist_length(hashlist) == transfer->datasize) {
+		stored = wd_hashlist_init_with_path(wd_hashlist_alloc(), transfer->realdatapath, transfer->datasize);
+		
+		if(wd_hashlist_length(stored) != transfer->datasize) {
+			wd_hashlist_write_to_path(hashlist, transfer->realdatapath, true);
+		}
+		else if(!wd_hashlist_is_equal(hashlist, stored)) {
+			wi_log_error(WI_STR("Could not verify \"%@\": Contents do not match stored block hashes"),
+				transfer->realdatapath);
+		}
+		
+		wi_release(stored);
+	}
+	
+	wd_shaper_close(shaper);
+	wi_release(shaper);
 	wi_release(pool);
 
-	wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, WD_TRANSFER_STATISTICS_REMOVE, statsbytes);
+	wd_transfers_note_statistics(WD_TRANSFER_DOWNLOAD, (transfer->leader || transfer->parent) ? WD_TRANSFER_STATISTICS_DATA : WD_TRANSFER_STATISTICS_REMOVE, statsbytes);
+	wd_transfers_note_tuning(WD_TRANSFER_DOWNLOAD, statsbytes, diskwait, socketwait);
 	
 	return result;
 }
 
 
 
+static wi_boolean_t wd_transfer_can_sendfile(wi_p7_socket_t *p7_socket) {
+#ifdef HAVE_SYS_SENDFILE_H
+	if(wi_p7_socket_cipher(p7_socket))
+		return false;
+	
+	if(wi_p7_socket_options(p7_socket) & (WI_P7_COMPRESSION_DEFLATE | WI_P7_CHECKSUM_SHA1))
+		return false;
+	
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+
+static wi_boolean_t wd_transfer_sendfile(int sd, int fd, wi_file_offset_t size, wi_time_interval_t timeout) {
+#ifdef HAVE_SYS_SENDFILE_H
+	wi_socket_state_t		state;
+	unsigned char			header[4];
+	ssize_t					bytes;
+	size_t					offset;
+	wi_boolean_t			failed, truncated;
+	int						error;
+	
+	/* Same framing as wi_p7_socket_write_oobdata() on a plain binary socket */
+	header[0] = (size >> 24) & 0xFF;
+	header[1] = (size >> 16) & 0xFF;
+	header[2] = (size >>  8) & 0xFF;
+	header[3] = (size >>  0) & 0xFF;
+	
+	errno		= 0;
+	failed		= false;
+	truncated	= false;
+	
+	for(offset = 0; offset < sizeof(header); offset += bytes) {
+		state = wi_socket_wait_descriptor(sd, timeout, false, true);
+		
+		if(state != WI_SOCKET_READY) {
+			if(state == WI_SOCKET_TIMEOUT)
+				errno = ETIMEDOUT;
+			
+			failed = true;
+			break;
+		}
+		
+		bytes = send(sd, header + offset, sizeof(header) - offset, MSG_MORE);
+		
+		if(bytes < 0) {
+			if(errno == EINTR || errno == EAGAIN) {
+				bytes = 0;
+				
+				continue;
+			}
+			
+			failed = true;
+			break;
+		}
+	}
+	
+	while(!failed && size > 0) {
+		state = wi_socket_wait_descriptor(sd, timeout, false, true);
+		
+		if(state != WI_SOCKET_READY) {
+			if(state == WI_SOCKET_TIMEOUT)
+				errno = ETIMEDOUT;
+			
+			failed = true;
+			break;
+		}
+		
+		bytes = sendfile(sd, fd, NULL, size);
+		
+		if(bytes < 0) {
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			
+			failed = true;
+			break;
+		}
+		else if(bytes == 0) {
+			/* The file was truncated after the header went out, so fill the rest of the chunk to keep the stream in frame */
+			failed		= !wd_transfer_send_padding(sd, size, timeout);
+			truncated	= true;
+			break;
+		}
+		
+		size -= bytes;
+	}
+	
+	if(failed) {
+		/* A partly written chunk leaves the stream out of frame, so nothing more may be sent on it */
+		error = errno;
+		shutdown(sd, SHUT_RDWR);
+		errno = error;
+		
+		return false;
+	}
+	
+	if(truncated) {
+		errno = 0;
+		
+		return false;
+	}
+	
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+
+#ifdef HAVE_SYS_SENDFILE_H
+
+static wi_boolean_t wd_transfer_send_padding(int sd, wi_file_offset_t size, wi_time_interval_t timeout) {
+	static const char		padding[8192];
+	wi_socket_state_t		state;
+	ssize_t					bytes;
+	
+	while(size > 0) {
+		state = wi_socket_wait_descriptor(sd, timeout, false, true);
+		
+		if(state != WI_SOCKET_READY) {
+			if(state == WI_SOCKET_TIMEOUT)
+				errno = ETIMEDOUT;
+			
+			return false;
+		}
+		
+		bytes = send(sd, padding, WI_MIN(size, sizeof(padding)), 0);
+		
+		if(bytes < 0) {
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			
+			return false;
+		}
+		
+		size -= bytes;
+	}
+	
+	return true;
+}
+
+#endif
+
+
+
 static wi_boolean_t wd_transfer_upload(wd_transfer_t *transfer) {
 	wi_pool_t				*pool;
 	wi_socket_t				*socket;
 	wi_p7_socket_t			*p7_socket;
 	wd_account_t			*account;
+	wd_pipeline_t			*pipeline;
+	wd_shaper_t				*shaper;
 	void					*buffer;
 	wi_time_interval_t		timeout, interval, speedinterval, statusinterval, accountinterval;
+	wi_time_interval_t		writeinterval, diskwait, socketwait;
 	wi_socket_state_t		state;
-	ssize_t					speedbytes, statsbytes, writtenbytes;
-	wi_uinteger_t			i, transfers;
+	ssize_t					speedbytes, statsbytes;
+	wi_uinteger_t			i;
 	wi_integer_t			readbytes;
 	int						sd;
 	wi_boolean_t			data, result;
@@ -1123,6 +2651,8 @@ static wi_boolean_t wd_transfer_upload(wd_transfer_t *transfer) {
 	accountinterval			= interval;
 	speedbytes				= 0;
 	statsbytes				= 0;
+	diskwait				= 0.0;
+	socketwait				= 0.0;
 	i						= 0;
 	socket					= wd_user_socket(transfer->user);
 	sd						= wi_socket_descriptor(socket);
@@ -1130,22 +2660,33 @@ static wi_boolean_t wd_transfer_upload(wd_transfer_t *transfer) {
 	account					= wd_user_account(transfer->user);
 	data					= true;
 	result					= true;
+	pipeline				= wd_pipeline_init_for_writing(wd_pipeline_alloc(), transfer->datafd);
+	shaper					= wd_shaper_init_with_transfer(wd_shaper_alloc(), transfer);
 	
-	wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, WD_TRANSFER_STATISTICS_ADD, 0);
-
-	wi_dictionary_rdlock(wd_transfers_user_uploads);
-	
-	transfers = (wi_integer_t) wi_dictionary_data_for_key(wd_transfers_user_uploads, transfer->key);
-	
-	wi_dictionary_unlock(wd_transfers_user_uploads);
+	wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, transfer->parent ? WD_TRANSFER_STATISTICS_DATA : WD_TRANSFER_STATISTICS_ADD, 0);
 
 	pool = wi_pool_init(wi_pool_alloc());
 	
+	wd_pipelines_set_transfer_io_priority(true);
+	
 	wd_user_lock_socket(transfer->user);
 	
 	while(wd_user_state(transfer->user) == WD_USER_LOGGED_IN) {
-		if(transfer->remainingdatasize == 0)
+		if(data && transfer->remainingdatasize == 0) {
 			data = false;
+			
+			if(!wd_pipeline_close(pipeline)) {
+				wi_log_error(WI_STR("Could not write upload to \"%@\": %s"),
+					transfer->realdatapath, strerror(errno));
+				
+				result = false;
+				break;
+			}
+			
+			wi_release(pipeline);
+			
+			pipeline = wd_pipeline_init_for_writing(wd_pipeline_alloc(), transfer->rsrcfd);
+		}
 		
 		if(!data && transfer->remainingrsrcsize == 0)
 			break;
@@ -1188,48 +2729,53 @@ static wi_boolean_t wd_transfer_upload(wd_transfer_t *transfer) {
 			break;
 		}
 
-		writtenbytes = write(data ? transfer->datafd : transfer->rsrcfd, buffer, readbytes);
-		
-		if(writtenbytes <= 0) {
-			if(writtenbytes < 0) {
-				wi_log_error(WI_STR("Could not write upload to \"%@\": %s"),
-					data ? transfer->realdatapath : transfer->realrsrcpath, strerror(errno));
-			}
+		writeinterval	= wi_time_interval();
+		socketwait		+= writeinterval - timeout;
+
+		if(!wd_pipeline_write(pipeline, buffer, readbytes)) {
+			wi_log_error(WI_STR("Could not write upload to \"%@\": %s"),
+				data ? transfer->realdatapath : transfer->realrsrcpath, strerror(errno));
 			
 			result = false;
 			break;
 		}
 
-		if(data)
+		if(data) {
+			if(transfer->hashlist)
+				wd_hashlist_update(transfer->hashlist, buffer, readbytes);
+			
 			transfer->remainingdatasize		-= readbytes;
-		else
+		} else {
 			transfer->remainingrsrcsize		-= readbytes;
+		}
 
 		interval							= wi_time_interval();
+		diskwait							+= interval - writeinterval;
 		transfer->transferred				+= readbytes;
 		transfer->actualtransferred			+= readbytes;
 		speedbytes							+= readbytes;
 		statsbytes							+= readbytes;
 		transfer->speed						= speedbytes / (interval - speedinterval);
+		
+		if(transfer->parent) {
+			transfer->parent->transferred		+= readbytes;
+			transfer->parent->actualtransferred	+= readbytes;
+		}
 
-		wd_transfer_limit_speed(transfer,
-								wd_transfers_total_upload_speed,
-								wd_account_transfer_upload_speed_limit(account),
-								wd_current_uploads,
-								transfers,
-								speedbytes,
-								interval,
-								speedinterval);
+		wd_shaper_limit(shaper, readbytes);
 		
 		if(interval - speedinterval > 30.0) {
 			speedbytes = 0;
 			speedinterval = interval;
 		}
 
-		if(interval - statusinterval > wd_current_uploads) {
+		if(interval - statusinterval > WD_TRANSFERS_STATISTICS_INTERVAL) {
 			wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, WD_TRANSFER_STATISTICS_DATA, statsbytes);
+			wd_transfers_note_tuning(WD_TRANSFER_UPLOAD, statsbytes, diskwait, socketwait);
 
 			statsbytes = 0;
+			diskwait = 0.0;
+			socketwait = 0.0;
 			statusinterval = interval;
 		}
 		
@@ -1237,11 +2783,7 @@ static wi_boolean_t wd_transfer_upload(wd_transfer_t *transfer) {
 			account = wd_user_account(transfer->user);
 			accountinterval = interval;
 			
-			wi_dictionary_rdlock(wd_transfers_user_uploads);
-			
-			transfers = (wi_integer_t) wi_dictionary_data_for_key(wd_transfers_user_uploads, transfer->key);
-			
-			wi_dictionary_unlock(wd_transfers_user_uploads);
+			wd_shaper_update_account(shaper, account);
 		}
 		
 		if(++i % 1000 == 0)
@@ -1250,9 +2792,53 @@ static wi_boolean_t wd_transfer_upload(wd_transfer_t *transfer) {
 	
 	wd_user_unlock_socket(transfer->user);
 	
+	wd_pipelines_set_transfer_io_priority(false);
+	
+	if(!wd_pipeline_close(pipeline) && result) {
+		wi_log_error(WI_STR("Could not write upload to \"%@\": %s"),
+			data ? transfer->realdatapath : transfer->realrsrcpath, strerror(errno));
+		
+		result = false;
+	}
+	
+	wd_shaper_close(shaper);
+	wi_release(shaper);
+	wi_release(pipeline);
 	wi_release(pool);
 
-	wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, WD_TRANSFER_STATISTICS_REMOVE, statsbytes);
+	wd_transfers_note_statistics(WD_TRANSFER_UPLOAD, transfer->parent ? WD_TRANSFER_STATISTICS_DATA : WD_TRANSFER_STATISTICS_REMOVE, statsbytes);
+	wd_transfers_note_tuning(WD_TRANSFER_UPLOAD, statsbytes, diskwait, socketwait);
 	
 	return result;
 }
+
+
+
+static wi_boolean_t wd_transfer_restart_upload(wd_transfer_t *transfer, wi_p7_message_t *message) {
+	if(ftruncate(transfer->datafd, 0) < 0) {
+		wi_log_error(WI_STR("Could not truncate \"%@\" for upload: %s"),
+			transfer->realdatapath, strerror(errno));
+		wd_user_reply_internal_error(transfer->user, wi_string_with_cstring(strerror(errno)), message);
+		
+		return false;
+	}
+	
+	if(transfer->rsrcfd >= 0 && ftruncate(transfer->rsrcfd, 0) < 0) {
+		wi_log_error(WI_STR("Could not truncate \"%@\" for upload: %s"),
+			transfer->realrsrcpath, strerror(errno));
+		wd_user_reply_internal_error(transfer->user, wi_string_with_cstring(strerror(errno)), message);
+		
+		return false;
+	}
+	
+	if(transfer->hashlist)
+		wd_hashlist_truncate(transfer->hashlist, 0);
+	
+	transfer->dataoffset			= 0;
+	transfer->rsrcoffset			= 0;
+	transfer->transferred			= 0;
+	transfer->remainingdatasize		= transfer->datasize;
+	transfer->remainingrsrcsize		= transfer->rsrcsize;
+	
+	return true;
+}
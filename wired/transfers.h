@@ -32,6 +32,7 @@
 #include <wired/wired.h>
 
 #include "files.h"
+#include "hashes.h"
 #include "main.h"
 
 enum _wd_transfer_type {
@@ -59,6 +60,22 @@ struct _wd_transfer {
 	int									datafd, rsrcfd;
 	
 	wi_condition_lock_t					*finished_lock;
+	wd_hashlist_t						*hashlist;
+	wi_data_t							*cachedata;
+	
+	wi_boolean_t						segment;
+	wi_uinteger_t						session_id;
+	struct _wd_transfer					*leader;
+	wi_uinteger_t						segments;
+	wi_file_offset_t					segmenttransferred;
+	wi_boolean_t						segmentfailed;
+	wi_condition_lock_t					*started_lock;
+	
+	wi_boolean_t						directory;
+	wi_array_t							*entries;
+	wi_uinteger_t						filecount;
+	wi_string_t							*resumepath;
+	struct _wd_transfer					*parent;
 
 	wd_transfer_state_t					state;
 	wd_transfer_type_t					type;
@@ -87,7 +104,9 @@ wi_boolean_t							wd_transfers_run_transfer(wd_transfer_t *, wd_user_t *, wi_p7
 void									wd_transfers_remove_user(wd_user_t *, wi_boolean_t);
 wd_transfer_t *							wd_transfers_transfer_with_path(wd_user_t *, wi_string_t *);
 
-wd_transfer_t *							wd_transfer_download_transfer(wi_string_t *, wi_file_offset_t, wi_file_offset_t, wd_user_t *, wi_p7_message_t *);
+wd_transfer_t *							wd_transfer_download_transfer(wi_string_t *, wi_file_offset_t, wi_file_offset_t, wi_file_offset_t, wd_user_t *, wi_p7_message_t *);
+wd_transfer_t *							wd_transfer_download_directory_transfer(wi_string_t *, wi_string_t *, wi_file_offset_t, wi_file_offset_t, wd_user_t *, wi_p7_message_t *);
 wd_transfer_t *							wd_transfer_upload_transfer(wi_string_t *, wi_file_offset_t, wi_file_offset_t, wi_boolean_t, wd_user_t *, wi_p7_message_t *);
+wd_transfer_t *							wd_transfer_upload_batch_transfer(wi_string_t *, wi_array_t *, wi_uinteger_t, wi_file_offset_t, wi_file_offset_t, wd_user_t *, wi_p7_message_t *);
 
 #endif /* WD_TRANFERS_H */
@@ -34,17 +34,23 @@
 #include <netinet/in.h>
 #include <wired/wired.h>
 
+#include "channels.h"
 #include "chats.h"
 #include "events.h"
+#include "metrics.h"
 #include "server.h"
 #include "settings.h"
+#include "reactor.h"
+#include "timeouts.h"
 #include "transfers.h"
 #include "users.h"
 
 #define WD_USERS_THREAD_KEY				"wd_user_t"
 
 #define WD_USERS_IDLE_TIME				600.0
-#define WD_USERS_TIMER_INTERVAL			60.0
+#define WD_USERS_PING_INTERVAL			60.0
+#define WD_USERS_READ_TIMEOUT			120.0
+#define WD_USERS_SEND_RETRY_INTERVAL	1.0
 
 #define WD_USER_SET_VALUE(user, dst, src)				\
 	WI_STMT_START										\
@@ -91,9 +97,16 @@ struct _wd_user {
 	
 	wi_recursive_lock_t					*user_lock;
 	wi_recursive_lock_t					*socket_lock;
+	wi_lock_t							*send_lock;
 	
 	wi_socket_t							*socket;
 	wi_p7_socket_t						*p7_socket;
+	wd_worker_queue_t					*queue;
+	wi_mutable_array_t					*send_queue;
+	wi_mutable_dictionary_t				*send_keys;
+	wi_uinteger_t						send_head;
+	wi_time_interval_t					send_time;
+	wi_boolean_t						send_scheduled;
 	
 	wd_uid_t							id;
 	wd_user_state_t						state;
@@ -112,6 +125,15 @@ struct _wd_user {
 	
 	wi_date_t							*login_time;
 	wi_date_t							*idle_time;
+	wi_time_interval_t					read_time;
+	wi_uinteger_t						read_trailer;
+	wi_boolean_t						read_trailer_known;
+	wi_uinteger_t						read_lowat;
+	
+	wd_timeout_t						*idle_timeout;
+	wd_timeout_t						*ping_timeout;
+	wd_timeout_t						*read_timeout;
+	wd_timeout_t						*send_timeout;
 	
 	wi_boolean_t						joined_public_chat;
 	
@@ -123,10 +145,12 @@ struct _wd_user {
 	wi_mutable_dictionary_t				*subscribed_virtualpaths;
 	
 	wd_transfer_t						*transfer;
+	wd_uid_t							session_id;
 };
 
 
-static void								wd_users_update_idle(wi_timer_t *);
+static wi_string_t *					wd_users_coalesce_key(wi_p7_message_t *);
+static wi_boolean_t						wd_users_message_is_chat(wi_p7_message_t *);
 
 static wd_user_t *						wd_user_alloc(void);
 static wd_user_t *						wd_user_init_with_socket(wd_user_t *, wi_socket_t *);
@@ -134,9 +158,40 @@ static void								wd_user_dealloc(wi_runtime_instance_t *);
 static wi_string_t *					wd_user_description(wi_runtime_instance_t *);
 
 static wd_uid_t							wd_user_next_id(void);
+static void								wd_user_schedule_timeouts(wd_user_t *);
+static void								wd_user_invalidate_timeouts(wd_user_t *);
+static void								wd_user_idle_timeout(wd_timeout_t *, wi_runtime_instance_t *);
+static void								wd_user_ping_timeout(wd_timeout_t *, wi_runtime_instance_t *);
+static void								wd_user_read_timeout(wd_timeout_t *, wi_runtime_instance_t *);
+static void								wd_user_send_timeout(wd_timeout_t *, wi_runtime_instance_t *);
+static void								wd_user_send_job(wi_runtime_instance_t *, wi_runtime_instance_t *);
+
+
+static wi_p7_message_t					*wd_users_ping_message;
+
+static const char						*wd_users_coalesce_message_names[] = {
+	"wired.send_ping",
+	"wired.server_info",
+	"wired.chat.user_status",
+	"wired.chat.user_icon",
+	"wired.chat.topic",
+	"wired.account.accounts_changed",
+	"wired.file.directory_changed",
+	NULL
+};
 
+static const char						*wd_users_chat_message_names[] = {
+	"wired.chat.say",
+	"wired.chat.me",
+	"wired.message.message",
+	"wired.message.broadcast",
+	NULL
+};
 
-static wi_timer_t						*wd_users_timer;
+static wi_mutable_set_t					*wd_users_coalesce_names;
+static wi_mutable_set_t					*wd_users_chat_names;
+static wi_uinteger_t					wd_users_send_queue_depth;
+static wd_users_send_overflow_t			wd_users_send_overflow;
 
 static wd_uid_t							wd_users_current_id;
 static wi_lock_t						*wd_users_id_lock;
@@ -186,54 +241,77 @@ static wi_runtime_class_t				wd_client_info_runtime_class = {
 
 
 void wd_users_initialize(void) {
+	wi_uinteger_t		i;
+	
 	wd_user_runtime_id = wi_runtime_register_class(&wd_user_runtime_class);
 	wd_client_info_runtime_id = wi_runtime_register_class(&wd_client_info_runtime_class);
 
 	wd_users = wi_dictionary_init(wi_mutable_dictionary_alloc());
 	
 	wd_users_id_lock = wi_lock_init(wi_lock_alloc());
-		
-	wd_users_timer = wi_timer_init_with_function(wi_timer_alloc(),
-												 wd_users_update_idle,
-												 WD_USERS_TIMER_INTERVAL,
-												 true);
+	
+	wd_users_ping_message = wi_retain(wi_p7_message_with_name(WI_STR("wired.send_ping"), wd_p7_spec));
+	
+	wd_users_coalesce_names = wi_set_init_with_capacity(wi_mutable_set_alloc(), 0, false);
+	
+	for(i = 0; wd_users_coalesce_message_names[i]; i++)
+		wi_mutable_set_add_data(wd_users_coalesce_names, wi_string_with_cstring(wd_users_coalesce_message_names[i]));
+	
+	wd_users_chat_names = wi_set_init_with_capacity(wi_mutable_set_alloc(), 0, false);
+	
+	for(i = 0; wd_users_chat_message_names[i]; i++)
+		wi_mutable_set_add_data(wd_users_chat_names, wi_string_with_cstring(wd_users_chat_message_names[i]));
 }
 
 
 
-void wd_users_schedule(void) {
-	wi_timer_schedule(wd_users_timer);
+void wd_users_apply_settings(wi_set_t *changes) {
+	wi_string_t		*overflow;
+	
+	wd_users_send_queue_depth = WI_MAX(1, wi_config_integer_for_name(wd_config, WI_STR("send queue depth")));
+	
+	overflow = wi_config_string_for_name(wd_config, WI_STR("send queue overflow"));
+	
+	if(wi_is_equal(overflow, WI_STR("drop"))) {
+		wd_users_send_overflow = WD_USERS_SEND_OVERFLOW_DROP;
+	}
+	else if(wi_is_equal(overflow, WI_STR("disconnect"))) {
+		wd_users_send_overflow = WD_USERS_SEND_OVERFLOW_DISCONNECT;
+	}
+	else {
+		if(!wi_is_equal(overflow, WI_STR("coalesce")))
+			wi_log_warn(WI_STR("Unknown send queue overflow \"%@\", using \"coalesce\""), overflow);
+		
+		wd_users_send_overflow = WD_USERS_SEND_OVERFLOW_COALESCE;
+	}
 }
 
 
 
-static void wd_users_update_idle(wi_timer_t *timer) {
-	wi_enumerator_t		*enumerator;
-	wd_user_t			*user;
-	wi_time_interval_t	interval;
-
-	wi_dictionary_rdlock(wd_users);
+static wi_string_t * wd_users_coalesce_key(wi_p7_message_t *message) {
+	wi_string_t		*name, *path;
+	wi_p7_uint32_t	uid, cid;
+	
+	name = wi_p7_message_name(message);
+	
+	if(!wi_set_contains_data(wd_users_coalesce_names, name))
+		return NULL;
+	
+	if(!wi_p7_message_get_uint32_for_name(message, &uid, WI_STR("wired.user.id")))
+		uid = 0;
+	
+	if(!wi_p7_message_get_uint32_for_name(message, &cid, WI_STR("wired.chat.id")))
+		cid = 0;
+	
+	path = wi_p7_message_string_for_name(message, WI_STR("wired.file.path"));
+	
+	return wi_string_with_format(WI_STR("%@ %u %u %@"), name, uid, cid, path);
+}
 
-	if(wi_dictionary_count(wd_users) > 0) {
-		interval = wi_time_interval();
 
-		enumerator = wi_dictionary_data_enumerator(wd_users);
-		
-		while((user = wi_enumerator_next_data(enumerator))) {
-			wi_recursive_lock_lock(user->user_lock);
-			
-			if(user->state == WD_USER_LOGGED_IN && !user->idle &&
-			   wi_date_time_interval(user->idle_time) + WD_USERS_IDLE_TIME < interval) {
-				user->idle = true;
-				
-				wd_user_broadcast_status(user);
-			}
 
-			wi_recursive_lock_unlock(user->user_lock);
-		}
-	}
-		
-	wi_dictionary_unlock(wd_users);
+static wi_boolean_t wd_users_message_is_chat(wi_p7_message_t *message) {
+	return wi_set_contains_data(wd_users_chat_names, wi_p7_message_name(message));
 }
 
 
@@ -244,15 +322,19 @@ void wd_users_add_user(wd_user_t *user) {
 	wi_dictionary_wrlock(wd_users);
 	wi_mutable_dictionary_set_data_for_key(wd_users, user, wi_number_with_int32(wd_user_id(user)));
 	wi_dictionary_unlock(wd_users);
+	
+	wd_user_schedule_timeouts(user);
 }
 
 
 
 void wd_users_remove_user(wd_user_t *user) {
 	wd_chats_remove_user(user);
+	wd_channels_remove_session(user);
 	wd_transfers_remove_user(user, false);
 	
 	wd_user_unsubscribe_paths(user);
+	wd_user_invalidate_timeouts(user);
 	
 	wi_dictionary_wrlock(wd_users);
 	wi_mutable_dictionary_remove_data_for_key(wd_users, wi_number_with_int32(wd_user_id(user)));
@@ -274,6 +356,7 @@ void wd_users_remove_all_users(void) {
 		wd_transfers_remove_user(user, true);
 
 		wd_user_unsubscribe_paths(user);
+		wd_user_invalidate_timeouts(user);
 	}
 
 	wi_mutable_dictionary_remove_all_data(wd_users);
@@ -331,6 +414,13 @@ void wd_users_reply_users(wd_user_t *user, wi_p7_message_t *message) {
 	while((peer = wi_enumerator_next_data(enumerator))) {
 		wi_recursive_lock_lock(peer->user_lock);
 		
+		/* Channel connections share their session's login and are not listed as users */
+		if(peer->session_id != 0) {
+			wi_recursive_lock_unlock(peer->user_lock);
+			
+			continue;
+		}
+		
 		switch(user->state) {
 			default:
 			case WD_USER_CONNECTED:			state = WD_USER_PROTOCOL_CONNECTED;		break;
@@ -403,9 +493,12 @@ static wd_user_t * wd_user_init_with_socket(wd_user_t *user, wi_socket_t *socket
 
 	user->id						= wd_user_next_id();
 	user->socket					= wi_retain(socket);
+	user->queue						= wi_retain(wd_worker_queue());
 	user->state						= WD_USER_CONNECTED;
 	user->login_time				= wi_date_init(wi_date_alloc());
 	user->idle_time					= wi_date_init(wi_date_alloc());
+	user->read_time					= wi_time_interval();
+	user->read_lowat				= 1;
 	
 	address							= wi_socket_address(socket);
 	user->ip						= wi_retain(wi_address_string(address));
@@ -413,10 +506,19 @@ static wd_user_t * wd_user_init_with_socket(wd_user_t *user, wi_socket_t *socket
 	
 	user->user_lock					= wi_recursive_lock_init(wi_recursive_lock_alloc());
 	user->socket_lock				= wi_recursive_lock_init(wi_recursive_lock_alloc());
+	user->send_lock					= wi_lock_init(wi_lock_alloc());
+	
+	user->send_queue				= wi_array_init(wi_mutable_array_alloc());
+	user->send_keys					= wi_dictionary_init(wi_mutable_dictionary_alloc());
 	
 	user->subscribed_paths			= wi_set_init_with_capacity(wi_mutable_set_alloc(), 0, true);
 	user->subscribed_virtualpaths	= wi_dictionary_init(wi_mutable_dictionary_alloc());
 	
+	user->idle_timeout				= wd_timeout_init_with_function(wd_timeout_alloc(), wd_user_idle_timeout, user);
+	user->ping_timeout				= wd_timeout_init_with_function(wd_timeout_alloc(), wd_user_ping_timeout, user);
+	user->read_timeout				= wd_timeout_init_with_function(wd_timeout_alloc(), wd_user_read_timeout, user);
+	user->send_timeout				= wd_timeout_init_with_function(wd_timeout_alloc(), wd_user_send_timeout, user);
+	
 	return user;
 }
 
@@ -427,9 +529,13 @@ static void wd_user_dealloc(wi_runtime_instance_t *instance) {
 	
 	wi_release(user->user_lock);
 	wi_release(user->socket_lock);
+	wi_release(user->send_lock);
 
 	wi_release(user->socket);
 	wi_release(user->p7_socket);
+	wi_release(user->queue);
+	wi_release(user->send_queue);
+	wi_release(user->send_keys);
 	
 	wi_release(user->account);
 	
@@ -443,6 +549,11 @@ static void wd_user_dealloc(wi_runtime_instance_t *instance) {
 
 	wi_release(user->idle_time);
 	wi_release(user->login_time);
+	
+	wi_release(user->idle_timeout);
+	wi_release(user->ping_timeout);
+	wi_release(user->read_timeout);
+	wi_release(user->send_timeout);
 
 	wi_release(user->transfer);
 	
@@ -482,6 +593,109 @@ static wd_uid_t wd_user_next_id(void) {
 
 
 
+static void wd_user_schedule_timeouts(wd_user_t *user) {
+	wd_timeout_schedule(user->idle_timeout, WD_USERS_IDLE_TIME);
+	wd_timeout_schedule(user->ping_timeout, WD_USERS_PING_INTERVAL);
+	wd_timeout_schedule(user->read_timeout, WD_USERS_READ_TIMEOUT);
+}
+
+
+
+static void wd_user_invalidate_timeouts(wd_user_t *user) {
+	wd_timeout_invalidate(user->idle_timeout);
+	wd_timeout_invalidate(user->ping_timeout);
+	wd_timeout_invalidate(user->read_timeout);
+	wd_timeout_invalidate(user->send_timeout);
+}
+
+
+
+static void wd_user_idle_timeout(wd_timeout_t *timeout, wi_runtime_instance_t *instance) {
+	wd_user_t			*user = instance;
+	wi_time_interval_t	interval;
+	
+	wi_recursive_lock_lock(user->user_lock);
+	
+	if(user->state == WD_USER_DISCONNECTED) {
+		wi_recursive_lock_unlock(user->user_lock);
+		
+		return;
+	}
+	
+	interval = wi_date_time_interval(user->idle_time) + WD_USERS_IDLE_TIME - wi_time_interval();
+	
+	if(user->state == WD_USER_LOGGED_IN && !user->idle && interval <= 0.0) {
+		user->idle = true;
+		
+		wd_user_broadcast_status(user);
+	}
+	
+	if(user->idle || interval <= 0.0)
+		interval = WD_USERS_IDLE_TIME;
+	
+	wi_recursive_lock_unlock(user->user_lock);
+	
+	wd_timeout_schedule(timeout, interval);
+}
+
+
+
+static void wd_user_ping_timeout(wd_timeout_t *timeout, wi_runtime_instance_t *instance) {
+	wd_user_t			*user = instance;
+	wd_user_state_t		state;
+	wi_time_interval_t	interval;
+	
+	state = wd_user_state(user);
+	
+	if(state == WD_USER_DISCONNECTED)
+		return;
+	
+	interval = wd_user_read_time(user) + WD_USERS_PING_INTERVAL - wi_time_interval();
+	
+	if(interval <= 0.0) {
+		if(state == WD_USER_LOGGED_IN)
+			wd_user_send_message(user, wd_users_ping_message);
+		
+		interval = WD_USERS_PING_INTERVAL;
+	}
+	
+	wd_timeout_schedule(timeout, interval);
+}
+
+
+
+static void wd_user_read_timeout(wd_timeout_t *timeout, wi_runtime_instance_t *instance) {
+	wd_user_t			*user = instance;
+	wi_time_interval_t	interval;
+	wi_boolean_t		disconnected;
+	
+	disconnected = (wd_user_state(user) == WD_USER_DISCONNECTED);
+	interval = wd_user_read_time(user) + WD_USERS_READ_TIMEOUT - wi_time_interval();
+	
+	if(!disconnected && interval > 0.0) {
+		wd_timeout_schedule(timeout, interval);
+		
+		return;
+	}
+	
+	if(!wd_reactor_expire_user(user, !disconnected) && !disconnected)
+		wd_timeout_schedule(timeout, WD_USERS_READ_TIMEOUT);
+}
+
+
+
+static void wd_user_send_timeout(wd_timeout_t *timeout, wi_runtime_instance_t *instance) {
+	wd_workers_submit(NULL, wd_user_send_job, instance, NULL);
+}
+
+
+
+static void wd_user_send_job(wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wd_user_flush_messages(argument1);
+}
+
+
+
 #pragma mark -
 
 void wd_user_reply_user_info(wd_user_t *peer, wd_user_t *user, wi_p7_message_t *message) {
@@ -591,10 +805,191 @@ void wd_user_unlock_socket(wd_user_t *user) {
 
 
 
+#pragma mark -
+
+/*
+ * The send queue keeps the sequence number of each queued update that may be
+ * coalesced, keyed by what it updates, so that a newer update replaces the
+ * queued one in place without reordering the queue or scanning it. Chat and
+ * private messages are never coalesced, and are only dropped by "drop".
+ */
+
+wi_boolean_t wd_user_queue_message(wd_user_t *user, wi_p7_message_t *message, wi_boolean_t reply) {
+	wi_string_t			*key;
+	wi_number_t			*sequence;
+	wi_uinteger_t		count;
+	wi_boolean_t		schedule, disconnect;
+	
+	if(wd_user_state(user) == WD_USER_DISCONNECTED)
+		return false;
+	
+	key = reply ? NULL : wd_users_coalesce_key(message);
+	disconnect = false;
+	
+	wi_lock_lock(user->send_lock);
+	
+	count = wi_array_count(user->send_queue);
+	
+	if(count < wd_users_send_queue_depth || reply ||
+	   (wd_users_send_overflow == WD_USERS_SEND_OVERFLOW_COALESCE && !key && count < 2 * wd_users_send_queue_depth && wd_users_message_is_chat(message))) {
+		if(key) {
+			wi_mutable_dictionary_set_data_for_key(user->send_keys,
+				wi_number_with_integer(user->send_head + count), key);
+		}
+		
+		wi_mutable_array_add_data(user->send_queue, message);
+		
+		wd_metrics_add(WD_METRIC_SEND_QUEUED, 1);
+		wd_metrics_set_max(WD_METRIC_SEND_QUEUE_MAX, count + 1);
+	} else {
+		switch(wd_users_send_overflow) {
+			case WD_USERS_SEND_OVERFLOW_COALESCE:
+				sequence = key ? wi_dictionary_data_for_key(user->send_keys, key) : NULL;
+				
+				if(sequence) {
+					wi_mutable_array_replace_data_at_index(user->send_queue, message,
+						wi_number_integer(sequence) - user->send_head);
+					
+					wd_metrics_add(WD_METRIC_SEND_COALESCED, 1);
+				}
+				else if(wd_users_message_is_chat(message)) {
+					wi_mutable_array_remove_all_data(user->send_queue);
+					wi_mutable_dictionary_remove_all_data(user->send_keys);
+					
+					wd_metrics_add(WD_METRIC_SEND_QUEUED, -(int64_t) count);
+					wd_metrics_add(WD_METRIC_SEND_DISCONNECTED, 1);
+					
+					disconnect = true;
+				}
+				else {
+					wd_metrics_add(WD_METRIC_SEND_DROPPED, 1);
+				}
+				break;
+
+			case WD_USERS_SEND_OVERFLOW_DROP:
+				wd_metrics_add(WD_METRIC_SEND_DROPPED, 1);
+				break;
+				
+			case WD_USERS_SEND_OVERFLOW_DISCONNECT:
+				wd_metrics_add(WD_METRIC_SEND_QUEUED, -(int64_t) count);
+				wd_metrics_add(WD_METRIC_SEND_DISCONNECTED, 1);
+				
+				wi_mutable_array_remove_all_data(user->send_queue);
+				wi_mutable_dictionary_remove_all_data(user->send_keys);
+				
+				disconnect = true;
+				break;
+		}
+	}
+	
+	schedule = (!user->send_scheduled && wi_array_count(user->send_queue) > 0);
+	
+	if(schedule) {
+		user->send_scheduled	= true;
+		user->send_time			= wi_time_interval();
+	}
+	
+	wi_lock_unlock(user->send_lock);
+	
+	if(disconnect) {
+		wi_log_warn(WI_STR("Disconnecting %@: Send queue overflow"), wd_user_identifier(user));
+		
+		wd_user_set_state(user, WD_USER_DISCONNECTED);
+	}
+	
+	return schedule;
+}
+
+
+
+wi_p7_message_t * wd_user_dequeue_message(wd_user_t *user) {
+	wi_p7_message_t		*message;
+	wi_string_t			*key;
+	wi_number_t			*sequence;
+	
+	wi_lock_lock(user->send_lock);
+	
+	if(wi_array_count(user->send_queue) > 0) {
+		message = wi_autorelease(wi_retain(WI_ARRAY(user->send_queue, 0)));
+		
+		wi_mutable_array_remove_data_at_index(user->send_queue, 0);
+		
+		if(wi_dictionary_count(user->send_keys) > 0) {
+			key			= wd_users_coalesce_key(message);
+			sequence	= key ? wi_dictionary_data_for_key(user->send_keys, key) : NULL;
+			
+			if(sequence && (wi_uinteger_t) wi_number_integer(sequence) == user->send_head)
+				wi_mutable_dictionary_remove_data_for_key(user->send_keys, key);
+		}
+		
+		user->send_head++;
+		user->send_time = wi_time_interval();
+		
+		wd_metrics_add(WD_METRIC_SEND_QUEUED, -1);
+	} else {
+		message = NULL;
+		
+		user->send_scheduled = false;
+	}
+	
+	wi_lock_unlock(user->send_lock);
+	
+	return message;
+}
+
+
+
+wi_uinteger_t wd_user_queued_messages(wd_user_t *user) {
+	wi_uinteger_t		count;
+	
+	wi_lock_lock(user->send_lock);
+	count = wi_array_count(user->send_queue);
+	wi_lock_unlock(user->send_lock);
+	
+	return count;
+}
+
+
+
+wi_boolean_t wd_user_queue_is_full(wd_user_t *user) {
+	return (wd_user_queued_messages(user) > wd_users_send_queue_depth);
+}
+
+
+
+void wd_user_unschedule_messages(wd_user_t *user) {
+	wi_lock_lock(user->send_lock);
+	user->send_scheduled = false;
+	wi_lock_unlock(user->send_lock);
+}
+
+
+
+void wd_user_retry_messages(wd_user_t *user) {
+	wd_timeout_schedule(user->send_timeout, WD_USERS_SEND_RETRY_INTERVAL);
+}
+
+
+
+wi_time_interval_t wd_user_send_time(wd_user_t *user) {
+	wi_time_interval_t		interval;
+	
+	wi_lock_lock(user->send_lock);
+	interval = user->send_time;
+	wi_lock_unlock(user->send_lock);
+	
+	return interval;
+}
+
+
+
 #pragma mark -
 
 void wd_user_set_state(wd_user_t *user, wd_user_state_t state) {
 	WD_USER_SET_VALUE(user, user->state, state);
+	
+	if(state == WD_USER_DISCONNECTED)
+		wd_timeout_schedule(user->read_timeout, 0.0);
 }
 
 
@@ -713,6 +1108,54 @@ wi_date_t * wd_user_idle_time(wd_user_t *user) {
 
 
 
+void wd_user_set_read_time(wd_user_t *user, wi_time_interval_t read_time) {
+	WD_USER_SET_VALUE(user, user->read_time, read_time);
+}
+
+
+
+wi_time_interval_t wd_user_read_time(wd_user_t *user) {
+	WD_USER_RETURN_VALUE(user, user->read_time);
+}
+
+
+
+void wd_user_set_read_trailer(wd_user_t *user, wi_uinteger_t read_trailer) {
+	WD_USER_SET_VALUE(user, user->read_trailer, read_trailer);
+}
+
+
+
+wi_uinteger_t wd_user_read_trailer(wd_user_t *user) {
+	WD_USER_RETURN_VALUE(user, user->read_trailer);
+}
+
+
+
+void wd_user_set_read_trailer_known(wd_user_t *user, wi_boolean_t read_trailer_known) {
+	WD_USER_SET_VALUE(user, user->read_trailer_known, read_trailer_known);
+}
+
+
+
+wi_boolean_t wd_user_read_trailer_known(wd_user_t *user) {
+	WD_USER_RETURN_VALUE(user, user->read_trailer_known);
+}
+
+
+
+void wd_user_set_read_lowat(wd_user_t *user, wi_uinteger_t read_lowat) {
+	WD_USER_SET_VALUE(user, user->read_lowat, read_lowat);
+}
+
+
+
+wi_uinteger_t wd_user_read_lowat(wd_user_t *user) {
+	WD_USER_RETURN_VALUE(user, user->read_lowat);
+}
+
+
+
 void wd_user_set_transfer(wd_user_t *user, wd_transfer_t *transfer) {
 	WD_USER_SET_INSTANCE(user, user->transfer, transfer);
 }
@@ -737,6 +1180,18 @@ wi_boolean_t wd_user_has_joined_public_chat(wd_user_t *user) {
 
 
 
+void wd_user_set_session_id(wd_user_t *user, wd_uid_t session_id) {
+	WD_USER_SET_VALUE(user, user->session_id, session_id);
+}
+
+
+
+wd_uid_t wd_user_session_id(wd_user_t *user) {
+	WD_USER_RETURN_VALUE(user, user->session_id);
+}
+
+
+
 #pragma mark -
 
 wi_boolean_t wd_user_supports_rsrc(wd_user_t *user) {
@@ -963,6 +1418,12 @@ wi_p7_socket_t * wd_user_p7_socket(wd_user_t *user) {
 
 
 
+wd_worker_queue_t * wd_user_queue(wd_user_t *user) {
+	return user->queue;
+}
+
+
+
 wd_uid_t wd_user_id(wd_user_t *user) {
 	return user->id;
 }
@@ -34,6 +34,7 @@
 #include "accounts.h"
 #include "main.h"
 #include "transfers.h"
+#include "workers.h"
 
 #define WD_USER_BUFFER_INITIAL_SIZE		BUFSIZ
 #define WD_USER_BUFFER_MAX_SIZE			131072
@@ -59,12 +60,20 @@ enum _wd_user_protocol_state {
 typedef enum _wd_user_protocol_state	wd_user_protocol_state_t;
 
 
+enum _wd_users_send_overflow {
+	WD_USERS_SEND_OVERFLOW_DROP			= 0,
+	WD_USERS_SEND_OVERFLOW_COALESCE,
+	WD_USERS_SEND_OVERFLOW_DISCONNECT
+};
+typedef enum _wd_users_send_overflow	wd_users_send_overflow_t;
+
+
 typedef uint32_t						wd_uid_t;
 typedef struct _wd_client_info			wd_client_info_t;
 
 
 void									wd_users_initialize(void);
-void									wd_users_schedule(void);
+void									wd_users_apply_settings(wi_set_t *);
 
 void									wd_users_add_user(wd_user_t *);
 void									wd_users_remove_user(wd_user_t *);
@@ -82,6 +91,14 @@ void									wd_user_broadcast_icon(wd_user_t *);
 void									wd_user_lock_socket(wd_user_t *);
 void									wd_user_unlock_socket(wd_user_t *);
 
+wi_boolean_t							wd_user_queue_message(wd_user_t *, wi_p7_message_t *, wi_boolean_t);
+wi_p7_message_t *						wd_user_dequeue_message(wd_user_t *);
+wi_uinteger_t							wd_user_queued_messages(wd_user_t *);
+wi_boolean_t							wd_user_queue_is_full(wd_user_t *);
+void									wd_user_unschedule_messages(wd_user_t *);
+void									wd_user_retry_messages(wd_user_t *);
+wi_time_interval_t						wd_user_send_time(wd_user_t *);
+
 void									wd_user_set_state(wd_user_t *, wd_user_state_t);
 wd_user_state_t							wd_user_state(wd_user_t *);
 
@@ -103,10 +120,20 @@ void									wd_user_set_color(wd_user_t *, wi_p7_enum_t);
 wi_p7_enum_t							wd_user_color(wd_user_t *);
 void									wd_user_set_idle_time(wd_user_t *, wi_date_t *);
 wi_date_t *								wd_user_idle_time(wd_user_t *);
+void									wd_user_set_read_time(wd_user_t *, wi_time_interval_t);
+wi_time_interval_t						wd_user_read_time(wd_user_t *);
+void									wd_user_set_read_trailer(wd_user_t *, wi_uinteger_t);
+wi_uinteger_t							wd_user_read_trailer(wd_user_t *);
+void									wd_user_set_read_trailer_known(wd_user_t *, wi_boolean_t);
+wi_boolean_t							wd_user_read_trailer_known(wd_user_t *);
+void									wd_user_set_read_lowat(wd_user_t *, wi_uinteger_t);
+wi_uinteger_t							wd_user_read_lowat(wd_user_t *);
 void									wd_user_set_transfer(wd_user_t *, wd_transfer_t *);
 wd_transfer_t *							wd_user_transfer(wd_user_t *);
 void									wd_user_set_joined_public_chat(wd_user_t *, wi_boolean_t);
 wi_boolean_t							wd_user_has_joined_public_chat(wd_user_t *);
+void									wd_user_set_session_id(wd_user_t *, wd_uid_t);
+wd_uid_t								wd_user_session_id(wd_user_t *);
 
 wi_boolean_t							wd_user_supports_rsrc(wd_user_t *);
 
@@ -134,6 +161,7 @@ wi_array_t *							wd_user_subscribed_virtual_paths_for_path(wd_user_t *, wi_str
 
 wi_socket_t *							wd_user_socket(wd_user_t *);
 wi_p7_socket_t *						wd_user_p7_socket(wd_user_t *);
+wd_worker_queue_t *						wd_user_queue(wd_user_t *);
 wd_uid_t								wd_user_id(wd_user_t *);
 wi_string_t *							wd_user_identifier(wd_user_t *);
 wi_date_t *								wd_user_login_time(wd_user_t *);
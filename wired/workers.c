@@ -0,0 +1,356 @@
+/* $Id$ */
+
+/*
+ *  Copyright (c) 2009 Axel Andersson
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <wired/wired.h>
+
+#include "main.h"
+#include "metrics.h"
+#include "settings.h"
+#include "workers.h"
+
+struct _wd_worker_job {
+	wd_worker_func_t					*func;
+	wi_runtime_instance_t				*argument1;
+	wi_runtime_instance_t				*argument2;
+	wi_time_interval_t					time;
+	
+	struct _wd_worker_job				*next;
+};
+typedef struct _wd_worker_job			wd_worker_job_t;
+
+
+struct _wd_worker_queue {
+	wi_runtime_base_t					base;
+	
+	wi_boolean_t						serial;
+	wi_boolean_t						scheduled;
+	wi_uinteger_t						count;
+	
+	wd_worker_job_t						*head, *tail;
+	wd_worker_queue_t					*next;
+};
+
+
+static void								wd_workers_thread(wi_runtime_instance_t *);
+static void								wd_workers_schedule_queue(wd_worker_queue_t *);
+static wd_worker_queue_t *				wd_workers_next_queue(void);
+
+static wd_worker_queue_t *				wd_worker_queue_alloc(void);
+static wd_worker_queue_t *				wd_worker_queue_init(wd_worker_queue_t *, wi_boolean_t);
+static void								wd_worker_queue_dealloc(wi_runtime_instance_t *);
+static wd_worker_job_t *				wd_worker_queue_shift_job(wd_worker_queue_t *);
+
+
+static wi_condition_lock_t				*wd_workers_lock;
+static wd_worker_queue_t				*wd_workers_head, *wd_workers_tail;
+static wd_worker_queue_t				*wd_workers_unordered_queue;
+static wi_uinteger_t					wd_workers_threads, wd_workers_max_threads;
+static wi_uinteger_t					wd_workers_max_depth;
+
+static wi_runtime_id_t					wd_worker_queue_runtime_id = WI_RUNTIME_ID_NULL;
+static wi_runtime_class_t				wd_worker_queue_runtime_class = {
+	"wd_worker_queue_t",
+	wd_worker_queue_dealloc,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+
+
+void wd_workers_initialize(void) {
+	wd_worker_queue_runtime_id = wi_runtime_register_class(&wd_worker_queue_runtime_class);
+	
+	wd_workers_lock = wi_condition_lock_init_with_condition(wi_condition_lock_alloc(), 0);
+	
+	wd_workers_unordered_queue = wd_worker_queue_init(wd_worker_queue_alloc(), false);
+}
+
+
+
+void wd_workers_apply_settings(wi_set_t *changes) {
+	wi_integer_t	threads, depth;
+	
+	threads	= wi_config_integer_for_name(wd_config, WI_STR("handler threads"));
+	depth	= wi_config_integer_for_name(wd_config, WI_STR("handler queue depth"));
+	
+	wi_condition_lock_lock(wd_workers_lock);
+	
+	wd_workers_max_threads	= WI_MAX(1, threads);
+	wd_workers_max_depth	= WI_MAX(1, depth);
+	
+	wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+}
+
+
+
+void wd_workers_schedule(void) {
+	wi_uinteger_t	threads;
+	
+	wi_condition_lock_lock(wd_workers_lock);
+	
+	threads = wd_workers_threads;
+	
+	while(wd_workers_threads < wd_workers_max_threads) {
+		if(!wi_thread_create_thread(wd_workers_thread, NULL)) {
+			wi_log_error(WI_STR("Could not create a handler thread: %m"));
+			
+			break;
+		}
+		
+		wd_workers_threads++;
+	}
+	
+	wd_metrics_set(WD_METRIC_HANDLER_THREADS, wd_workers_threads);
+	
+	wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+	
+	if(wd_workers_threads == 0)
+		wi_log_fatal(WI_STR("Could not create any handler threads"));
+	
+	if(wd_workers_threads != threads)
+		wi_log_info(WI_STR("Running %u handler threads"), wd_workers_threads);
+}
+
+
+
+#pragma mark -
+
+void wd_workers_submit(wd_worker_queue_t *queue, wd_worker_func_t *func, wi_runtime_instance_t *argument1, wi_runtime_instance_t *argument2) {
+	wd_worker_job_t		*job;
+	
+	if(!queue)
+		queue = wd_workers_unordered_queue;
+	
+	job				= wi_malloc(sizeof(wd_worker_job_t));
+	job->func		= func;
+	job->argument1	= wi_retain(argument1);
+	job->argument2	= wi_retain(argument2);
+	job->time		= wi_time_interval();
+	
+	wi_condition_lock_lock(wd_workers_lock);
+	
+	if(queue->tail)
+		queue->tail->next = job;
+	else
+		queue->head = job;
+	
+	queue->tail = job;
+	queue->count++;
+	
+	if(!queue->scheduled)
+		wd_workers_schedule_queue(queue);
+	
+	wi_condition_lock_unlock_with_condition(wd_workers_lock, 1);
+	
+	wd_metrics_add(WD_METRIC_HANDLER_QUEUED, 1);
+}
+
+
+
+wi_uinteger_t wd_workers_queue_depth(void) {
+	wi_uinteger_t	depth;
+	
+	wi_condition_lock_lock(wd_workers_lock);
+	depth = wd_workers_max_depth;
+	wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+	
+	return depth;
+}
+
+
+
+#pragma mark -
+
+static void wd_workers_thread(wi_runtime_instance_t *argument) {
+	wi_pool_t				*pool;
+	wd_worker_queue_t		*queue;
+	wd_worker_job_t			*job;
+	wi_time_interval_t		wait;
+	
+	pool = wi_pool_init(wi_pool_alloc());
+	
+	while(true) {
+		wi_condition_lock_lock_when_condition(wd_workers_lock, 1, 0.0);
+		
+		if(wd_workers_threads > wd_workers_max_threads) {
+			wd_workers_threads--;
+			
+			wd_metrics_set(WD_METRIC_HANDLER_THREADS, wd_workers_threads);
+			
+			wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+			
+			break;
+		}
+		
+		queue	= wd_workers_next_queue();
+		job		= wd_worker_queue_shift_job(queue);
+		
+		if(!queue->serial) {
+			queue->scheduled = false;
+			
+			if(queue->count > 0)
+				wd_workers_schedule_queue(queue);
+		}
+		
+		wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+		
+		wait = wi_time_interval() - job->time;
+		
+		wd_metrics_add(WD_METRIC_HANDLER_QUEUED, -1);
+		wd_metrics_add(WD_METRIC_HANDLER_JOBS, 1);
+		wd_metrics_add(WD_METRIC_HANDLER_QUEUE_WAIT, wait * 1000000.0);
+		wd_metrics_set_max(WD_METRIC_HANDLER_QUEUE_WAIT_MAX, wait * 1000000.0);
+		
+		(*job->func)(job->argument1, job->argument2);
+		
+		wi_release(job->argument1);
+		wi_release(job->argument2);
+		wi_free(job);
+		
+		if(queue->serial) {
+			wi_condition_lock_lock(wd_workers_lock);
+			
+			if(queue->count > 0)
+				wd_workers_schedule_queue(queue);
+			else
+				queue->scheduled = false;
+			
+			wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+		}
+		
+		wi_release(queue);
+		
+		wi_pool_drain(pool);
+	}
+	
+	wi_release(pool);
+}
+
+
+
+static void wd_workers_schedule_queue(wd_worker_queue_t *queue) {
+	queue->scheduled	= true;
+	queue->next			= NULL;
+	
+	if(wd_workers_tail)
+		wd_workers_tail->next = wi_retain(queue);
+	else
+		wd_workers_head = wi_retain(queue);
+	
+	wd_workers_tail = queue;
+}
+
+
+
+static wd_worker_queue_t * wd_workers_next_queue(void) {
+	wd_worker_queue_t		*queue;
+	
+	queue = wd_workers_head;
+	wd_workers_head = queue->next;
+	
+	if(!wd_workers_head)
+		wd_workers_tail = NULL;
+	
+	queue->next = NULL;
+	
+	return queue;
+}
+
+
+
+#pragma mark -
+
+wd_worker_queue_t * wd_worker_queue(void) {
+	return wi_autorelease(wd_worker_queue_init(wd_worker_queue_alloc(), true));
+}
+
+
+
+#pragma mark -
+
+static wd_worker_queue_t * wd_worker_queue_alloc(void) {
+	return wi_runtime_create_instance(wd_worker_queue_runtime_id, sizeof(wd_worker_queue_t));
+}
+
+
+
+static wd_worker_queue_t * wd_worker_queue_init(wd_worker_queue_t *queue, wi_boolean_t serial) {
+	queue->serial = serial;
+	
+	return queue;
+}
+
+
+
+static void wd_worker_queue_dealloc(wi_runtime_instance_t *instance) {
+	wd_worker_queue_t		*queue = instance;
+	wd_worker_job_t			*job;
+	
+	while((job = wd_worker_queue_shift_job(queue))) {
+		wi_release(job->argument1);
+		wi_release(job->argument2);
+		wi_free(job);
+	}
+}
+
+
+
+#pragma mark -
+
+wi_uinteger_t wd_worker_queue_count(wd_worker_queue_t *queue) {
+	wi_uinteger_t	count;
+	
+	wi_condition_lock_lock(wd_workers_lock);
+	count = queue->count;
+	wi_condition_lock_unlock_with_condition(wd_workers_lock, wd_workers_head ? 1 : 0);
+	
+	return count;
+}
+
+
+
+static wd_worker_job_t * wd_worker_queue_shift_job(wd_worker_queue_t *queue) {
+	wd_worker_job_t		*job;
+	
+	job = queue->head;
+	
+	if(job) {
+		queue->head = job->next;
+		
+		if(!queue->head)
+			queue->tail = NULL;
+		
+		queue->count--;
+	}
+	
+	return job;
+}